@@ -0,0 +1,23 @@
+/*
+ * BenchHandler.hpp
+ *
+ *  Event handler for benchmarks that open a GL manager but never read its
+ *  events: whatever the manager posts is queued and left there.
+ */
+
+#ifndef BENCHHANDLER_HPP_
+#define BENCHHANDLER_HPP_
+
+#include <Portability/PublicInterfaces/RendererEvents.hpp>
+
+
+class NullHandler : public RendererEventHandler
+{
+public:
+  void enqueueEvent(const RendererEvent& event) { pushEvent(event); }
+
+protected:
+  bool popEvent(RendererEvent* event) { return pullEvent(event); }
+};
+
+#endif /* BENCHHANDLER_HPP_ */
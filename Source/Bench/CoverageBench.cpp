@@ -0,0 +1,175 @@
+/*
+ * CoverageBench.cpp
+ *
+ *  What a CoverageMask buys: draws a shader headless at several coverage
+ *  ratios and reports fragments shaded per frame (counted with a
+ *  GL_SAMPLES_PASSED query), how many that saves against the full target,
+ *  and the frame time, with glFinish() after every frame so the GPU's work
+ *  is in it.
+ *
+ *  usage: CoverageBench [shader] [frames] [WxH]
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <Portability/PublicInterfaces/OpenGLManager.hpp>
+#include <Portability/PublicInterfaces/LoopClock.hpp>
+#include <Renderer/GLShader.hpp>
+#include "BenchHandler.hpp"
+
+using namespace std;
+
+
+#define WARMUP_FRAMES 10
+
+//a few dozen trig calls a pixel; enough that shading dominates the frame
+static const char* default_shader =
+  "void mainImage(out vec4 fragColor, in vec2 fragCoord)\n"
+  "{\n"
+  "  vec2 uv = fragCoord / iResolution.xy;\n"
+  "  float v = 0.0;\n"
+  "  for(int i = 0; i < 32; i++)\n"
+  "    v += sin(uv.x * float(i) + iTime) * cos(uv.y * float(i));\n"
+  "  fragColor = vec4(vec3(0.5 + 0.02 * v), 1.0);\n"
+  "}\n";
+
+
+struct CoverageCase
+{
+  const char* name;
+  double ratio;       //for letterboxes; circles are sized from it too
+  bool circle;
+};
+
+static const CoverageCase cases[] =
+  {
+    {"full", 1.0, false},
+    {"letterbox 75%", 0.75, false},
+    {"letterbox 50%", 0.50, false},
+    {"circle 50%", 0.50, true},
+    {"letterbox 25%", 0.25, false},
+    {"circle 25%", 0.25, true},
+    {"letterbox 10%", 0.10, false},
+  };
+
+
+static string specFor(const CoverageCase& test, int w, int h)
+{
+  stringstream spec;
+  if(test.ratio >= 1.0)
+    spec << "full";
+  else if(test.circle)
+    //area ratio*w*h; radius is relative to the shorter side
+    spec << "circle 0.5 0.5 "
+         << sqrt(test.ratio * w * h / M_PI) / (w < h ? w : h);
+  else
+    spec << "letterbox " << (double) w / (h * test.ratio);
+  return spec.str();
+}
+
+
+//the ShaderToy lives here so it is deleted before the context it was made in
+static void runCases(const string& source, RendererParams* params,
+                     ShaderToyParams* toy_params, GLuint fbo, int frames)
+{
+  ShaderToy toy(source, params, toy_params);
+  if(!toy.initialize())
+    return;
+  int w = params->window_width, h = params->window_height;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glViewport(0, 0, w, h);
+  GLuint query;
+  glGenQueries(1, &query);
+
+  cout << w << "x" << h << ", " << frames << " frames per case" << endl;
+  double full_ms = 0.0;
+  for(size_t idx = 0; idx < sizeof(cases) / sizeof(cases[0]); idx++)
+    {
+      toy.coverage()->parse(specFor(cases[idx], w, h));
+      TimeHistogram times;
+      GLuint64 fragments = 0;
+      for(int frame = -WARMUP_FRAMES; frame < frames; frame++)
+        {
+          params->frame = frame + WARMUP_FRAMES;
+          params->current_time_ms = params->frame * 16;
+          long long start = LoopClock::Now();
+          glBeginQuery(GL_SAMPLES_PASSED, query);
+          toy.draw();
+          glEndQuery(GL_SAMPLES_PASSED);
+          glFinish();
+          if(frame < 0)
+            continue;
+          times.Record(LoopClock::Now() - start);
+          GLuint64 passed;
+          glGetQueryObjectui64v(query, GL_QUERY_RESULT, &passed);
+          fragments += passed;
+        }
+
+      double per_frame = (double) fragments / frames;
+      double p50_ms = times.Percentile(0.5) / 1e6;
+      if(!idx)
+        full_ms = p50_ms;
+      printf("%-14s coverage %5.1f%% (%.1f%% mask), %9.0f fragments/frame, "
+             "%5.1f%% saved, p50 %7.2f ms, p99 %7.2f ms, %.2fx\n",
+             cases[idx].name, 100.0 * per_frame / ((double) w * h),
+             100.0 * toy.coverage()->coverage(w, h), per_frame,
+             100.0 * (1.0 - per_frame / ((double) w * h)), p50_ms,
+             times.Percentile(0.99) / 1e6, p50_ms > 0.0 ? full_ms / p50_ms : 0.0);
+    }
+
+  glDeleteQueries(1, &query);
+}
+
+
+int main(int argc, const char* argv[])
+{
+  string source = default_shader;
+  if(argc > 1)
+    {
+      ifstream in(argv[1]);
+      if(!in)
+        {
+          cerr << "Unable to read " << argv[1] << endl;
+          return 1;
+        }
+      stringstream contents;
+      contents << in.rdbuf();
+      source = contents.str();
+    }
+  int frames = argc > 2 ? atoi(argv[2]) : 60;
+  int w = 1280, h = 720;
+  if(argc > 3 && sscanf(argv[3], "%dx%d", &w, &h) != 2)
+    return 1;
+
+  RendererEventHandlerPtr handler(new NullHandler());
+  OpenGLManager* manager = OpenGLManager::GetGLManager(handler, handler,
+                                                       GL_BACKEND_HEADLESS);
+  if(!manager->init(false))
+    {
+      cerr << "Unable to initialize OpenGL" << endl;
+      return 1;
+    }
+  manager->RequestWindowSize(w, h);
+  manager->WindowSizeChanged();
+  w = manager->GetWindowWidth();
+  h = manager->GetWindowHeight();
+
+  RendererParams params;
+  memset(&params, 0, sizeof(params));
+  params.window_width = params.render_width = w;
+  params.window_height = params.render_height = h;
+  ShaderToyParams toy_params;
+  toy_params.orientation = 0.0f;
+
+  runCases(source, &params, &toy_params, manager->GetDefaultFramebuffer(),
+           frames);
+  delete manager;
+  return 0;
+}
+
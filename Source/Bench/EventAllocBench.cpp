@@ -0,0 +1,173 @@
+/*
+ * EventAllocBench.cpp
+ *
+ *  Counts heap allocations on the input path. Replaces the global operator
+ *  new/delete with counting versions, then runs a synthetic storm of X11
+ *  pointer events and inline software messages through RendererEvent and
+ *  the handler's rings, popping them as the render loop does. After a warm-up
+ *  pass the steady state should report zero allocations per event.
+ *
+ *  usage: EventAllocBench [events]
+ */
+
+#include <iostream>
+#include <new>
+#include <stdlib.h>
+#include <X11/Xlib.h>
+#include <Portability/PublicInterfaces/RendererEvents.hpp>
+
+using namespace std;
+
+
+//events pushed before the consumer drains; under the input ring size so the
+//storm measures the normal path rather than the full-ring policy
+#define STORM_BATCH 256
+#define WARMUP_EVENTS 10000
+
+
+static long allocations = 0;
+static long frees = 0;
+
+void* operator new(size_t size)
+{
+  allocations++;
+  void* ptr = malloc(size ? size : 1);
+  if(!ptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* ptr) throw()
+{
+  if(ptr)
+    frees++;
+  free(ptr);
+}
+
+void operator delete[](void* ptr) throw()
+{
+  operator delete(ptr);
+}
+
+
+class StormHandler : public RendererEventHandler
+{
+public:
+  void enqueueEvent(const RendererEvent& event) { pushEvent(event); }
+  bool nextEvent(RendererEvent* event) { return popEvent(event); }
+
+protected:
+  bool popEvent(RendererEvent* event) { return pullEvent(event); }
+};
+
+
+//the mix a busy pointer produces: mostly motion, some clicks and wheel
+static void makeXEvent(long idx, XEvent* xe)
+{
+  switch(idx % 8)
+    {
+    case 0:
+      xe->type = ButtonPress;
+      xe->xbutton.button = Button1;
+      xe->xbutton.x = idx % 640;
+      xe->xbutton.y = idx % 480;
+      break;
+    case 1:
+      xe->type = ButtonPress;
+      xe->xbutton.button = (idx & 16) ? Button4 : Button5;
+      xe->xbutton.x = idx % 640;
+      xe->xbutton.y = idx % 480;
+      break;
+    default:
+      xe->type = MotionNotify;
+      xe->xmotion.x = idx % 640;
+      xe->xmotion.y = idx % 480;
+      break;
+    }
+}
+
+static RendererEvent makeEvent(long idx, XEvent* xe)
+{
+  //every 32nd event is a software message with inline contents
+  if(idx % 32 == 31)
+    {
+      RendererEvent message(SCENEOBJECT_REQUEST);
+      message.data.message.contents.pair[0] = idx;
+      message.data.message.contents.pair[1] = -idx;
+      return message;
+    }
+
+  makeXEvent(idx, xe);
+  if(xe->type == MotionNotify)
+    return RendererEvent((void*) xe, MOUSE_MOVE);
+  if(xe->xbutton.button == Button1)
+    return RendererEvent((void*) xe, MOUSE_DOWN);
+  return RendererEvent((void*) xe, MOUSE_SCROLL);
+}
+
+//returns a checksum so the work can't be optimised away
+static long storm(StormHandler* handler, long events)
+{
+  XEvent xe;
+  long sum = 0;
+  RendererEvent event;
+  for(long done = 0; done < events; done += STORM_BATCH)
+    {
+      for(long idx = done; idx < done + STORM_BATCH; idx++)
+        handler->enqueueEvent(makeEvent(idx, &xe));
+      handler->flushInput();
+
+      while(handler->nextEvent(&event))
+        {
+          switch(event.type)
+            {
+            case MOUSE_MOVE:
+              sum += event.data.move.window_x;
+              break;
+            case MOUSE_DOWN:
+              sum += event.data.press.where.window_y;
+              break;
+            case MOUSE_SCROLL:
+              sum += event.data.wheel.wheel_delta;
+              break;
+            case SOFTWARE:
+              sum += event.data.message.contents.pair[0];
+              break;
+            default:
+              break;
+            }
+          event.releaseContents();
+        }
+    }
+  return sum;
+}
+
+
+int main(int argc, const char* argv[])
+{
+  long events = argc > 1 ? atol(argv[1]) : 1000000;
+
+  StormHandler* handler = new StormHandler();
+  storm(handler, WARMUP_EVENTS);
+
+  long start_allocations = allocations;
+  long start_frees = frees;
+  long sum = storm(handler, events);
+  long allocated = allocations - start_allocations;
+  long freed = frees - start_frees;
+
+  EventRingStats stats = handler->ringStats();
+  cout << "sizeof(RendererEvent): " << sizeof(RendererEvent) << " bytes" << endl
+       << events << " events: " << allocated << " allocations, " << freed
+       << " frees (" << (double) allocated / events << " per event)" << endl
+       << "dropped input " << stats.dropped_input << ", dropped messages "
+       << stats.dropped_messages << " (checksum " << sum << ")" << endl;
+
+  delete handler;
+  return allocated ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * EventQueueBench.cpp
+ *
+ *  Microbenchmark of the renderer event queues: SlowSynchronizedQueue against
+ *  the lock-free EventRing in its single- and multi-producer forms. Reports
+ *  saturated throughput (events/s) and enqueue-to-pop latency percentiles at
+ *  a paced rate closer to real input.
+ *
+ *  usage: EventQueueBench [events] [producers]
+ */
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+#include <boost/thread.hpp>
+#include <Services/VmsCriticalSections/VmsSynchronizedQueue.hpp>
+#include <Portability/PublicInterfaces/RendererEvents.hpp>
+
+using namespace std;
+
+
+//gap between events in the latency run; ~100k events/s, a busy mouse and
+//keyboard many times over
+#define LATENCY_PACE_NS 10000
+
+
+static long long nowNs(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+//the payload the renderer actually moves, plus a send timestamp
+struct BenchItem
+{
+  RendererEvent event;
+  long long sent_ns;
+};
+
+
+struct SlowQueueAdapter
+{
+  SlowSynchronizedQueue<BenchItem> queue;
+  bool push(BenchItem& item) { queue.push(item); return true; }
+  bool pop(BenchItem& item) { return queue.pop(item); }
+};
+
+template <bool SingleProducer>
+struct RingAdapter
+{
+  RingAdapter(void) : ring(INPUT_RING_SIZE) {}
+  EventRing<BenchItem, SingleProducer> ring;
+  bool push(BenchItem& item) { return ring.tryPush(item); }
+  bool pop(BenchItem& item) { return ring.tryPop(item); }
+};
+
+
+template <class Queue>
+static void produce(Queue* queue, RendererEvent event, long count,
+                    long long pace_ns)
+{
+  long long next_ns = nowNs();
+  for(long idx = 0; idx < count; idx++)
+    {
+      if(pace_ns)
+        {
+          while(nowNs() < next_ns)
+            ;
+          next_ns += pace_ns;
+        }
+      BenchItem item;
+      item.event = event;
+      item.sent_ns = nowNs();
+      while(!queue->push(item))
+        sched_yield();
+    }
+}
+
+//runs producers against one consumer; fills latencies (ns) if given and
+//returns events per second
+template <class Queue>
+static double run(int producers, long per_producer, long long pace_ns,
+                  vector<long long>* latencies)
+{
+  Queue queue;
+  RendererEvent event(REGISTER_SCENEOBJECT);
+
+  long total = per_producer * producers;
+  if(latencies)
+    latencies->reserve(total);
+
+  long long start = nowNs();
+  boost::thread_group threads;
+  for(int idx = 0; idx < producers; idx++)
+    threads.create_thread(boost::bind(&produce<Queue>, &queue, event,
+                                      per_producer, pace_ns));
+
+  BenchItem item;
+  for(long popped = 0; popped < total; )
+    if(queue.pop(item))
+      {
+        if(latencies)
+          latencies->push_back(nowNs() - item.sent_ns);
+        popped++;
+      }
+    else
+      sched_yield();
+  long long elapsed = nowNs() - start;
+  threads.join_all();
+
+  return total * 1e9 / elapsed;
+}
+
+
+template <class Queue>
+static void report(const char* name, int producers, long events)
+{
+  double rate = run<Queue>(producers, events / producers, 0, 0);
+
+  vector<long long> latencies;
+  run<Queue>(producers, events / (producers * 10), LATENCY_PACE_NS * producers,
+             &latencies);
+  sort(latencies.begin(), latencies.end());
+  size_t n = latencies.size();
+
+  cout << name << " (" << producers << " producer"
+       << (producers > 1 ? "s" : "") << "): "
+       << (long) (rate / 1000) << "k events/s, latency p50 "
+       << latencies[n / 2] << " ns, p99 " << latencies[n * 99 / 100]
+       << " ns, max " << latencies[n - 1] << " ns" << endl;
+}
+
+
+int main(int argc, const char* argv[])
+{
+  long events = argc > 1 ? atol(argv[1]) : 2000000;
+  int producers = argc > 2 ? atoi(argv[2]) : 4;
+
+  report<SlowQueueAdapter>("SlowSynchronizedQueue", 1, events);
+  report< RingAdapter<true> >("EventRing SPSC       ", 1, events);
+  report<SlowQueueAdapter>("SlowSynchronizedQueue", producers, events);
+  report< RingAdapter<false> >("EventRing MPSC       ", producers, events);
+  return 0;
+}
@@ -0,0 +1,607 @@
+/*
+ * ShaderToyBench.cpp
+ *
+ *  shadertoy-bench: renders every .frag in a directory headless, at each of
+ *  a list of resolutions, and writes the results as JSON: per shader the
+ *  compile, link and total setup time, the first frame (where drivers that
+ *  compile lazily do it), and peak resident memory; per resolution the
+ *  ms/frame mean, percentiles and max, with glFinish() after every frame
+ *  so the GPU's work is in it. Percentiles are exact, not histogram
+ *  buckets, so small regressions aren't rounded away. A shader with
+ *  "// variant:" tiers is benched once per tier, as NAME.frag:TIER, so the
+ *  cost of each quality setting is there to compare.
+ *
+ *  compare reads two such files and lists the change in every shader and
+ *  resolution they share, flagging those slower by more than the threshold;
+ *  it exits 2 if there were any, for scripts.
+ *
+ *  usage: shadertoy-bench run DIR [--sizes=WxH,...] [--warmup=N]
+ *                                 [--frames=N] [--output=PATH]
+ *         shadertoy-bench compare BASE.json NEW.json [--threshold=PCT]
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <Portability/PublicInterfaces/OpenGLManager.hpp>
+#include <Portability/PublicInterfaces/LoopClock.hpp>
+#include <Renderer/GLShader.hpp>
+#include "BenchHandler.hpp"
+#include <Renderer/ShaderVariants.hpp>
+
+using namespace std;
+
+
+#define DEFAULT_SIZES "640x360,1280x720,1920x1080"
+#define DEFAULT_WARMUP_FRAMES 10
+#define DEFAULT_FRAMES 100
+#define DEFAULT_THRESHOLD_PCT 5.0
+
+//changes smaller than these are noise however large they are relatively
+#define FRAME_NOISE_MS 0.05
+#define COMPILE_NOISE_MS 2.0
+
+
+static bool readFile(const string& path, string* contents)
+{
+  ifstream in(path.c_str());
+  if(!in)
+    return false;
+  stringstream buffer;
+  buffer << in.rdbuf();
+  *contents = buffer.str();
+  return true;
+}
+
+static string jsonString(const string& text)
+{
+  string quoted = "\"";
+  for(size_t idx = 0; idx < text.size(); idx++)
+    {
+      unsigned char c = text[idx];
+      if(c == '"' || c == '\\')
+        quoted += '\\', quoted += c;
+      else if(c == '\n')
+        quoted += "\\n";
+      else if(c < 0x20)
+        {
+          char escape[8];
+          snprintf(escape, sizeof(escape), "\\u%04x", c);
+          quoted += escape;
+        }
+      else
+        quoted += c;
+    }
+  return quoted + "\"";
+}
+
+
+//peak resident set since the last resetPeakMemory(), in KB. The kernel's
+//high water mark can be reset per process since Linux 4.0; before that, or
+//without /proc, this is the peak of the whole run
+static void resetPeakMemory(void)
+{
+  FILE* refs = fopen("/proc/self/clear_refs", "w");
+  if(refs)
+    {
+      fputs("5", refs);
+      fclose(refs);
+    }
+}
+
+static long peakMemoryKB(void)
+{
+  FILE* status = fopen("/proc/self/status", "r");
+  char line[256];
+  long kb = -1;
+  while(status && fgets(line, sizeof(line), status))
+    if(sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+      break;
+  if(status)
+    fclose(status);
+  if(kb >= 0)
+    return kb;
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+
+//exact percentile of sorted frame times
+static double percentile(const vector<double>& sorted, double p)
+{
+  size_t idx = (size_t) (p * (sorted.size() - 1) + 0.5);
+  return sorted[idx];
+}
+
+
+struct BenchOptions
+{
+  string directory;
+  vector<pair<int, int> > sizes;
+  int warmup, frames;
+  string output_path;     //"-" is stdout
+};
+
+//the rest of name's entry, once its opening fields are written: source at
+//every size. The ShaderToy is deleted before the context
+static void benchSource(OpenGLManager* manager, const string& name,
+                        const string& source, const BenchOptions& opts,
+                        ostream& json)
+{
+  resetPeakMemory();
+  RendererParams params;
+  memset(&params, 0, sizeof(params));
+  params.window_width = params.render_width = opts.sizes[0].first;
+  params.window_height = params.render_height = opts.sizes[0].second;
+  ShaderToyParams toy_params;
+  toy_params.orientation = 0.0f;
+
+  ShaderToy toy(source, &params, &toy_params);
+  long long start = LoopClock::Now();
+  if(!toy.initialize())
+    {
+      json << ", \"ok\": false, \"error\": " << jsonString(toy.getLog()) << "}";
+      cerr << name << ": failed to build" << endl;
+      return;
+    }
+  double init_ms = (LoopClock::Now() - start) / 1e6;
+  char line[256];
+  snprintf(line, sizeof(line), ", \"ok\": true, \"compile_ms\": %.3f, "
+           "\"link_ms\": %.3f, \"init_ms\": %.3f", toy.compileTime() / 1e6,
+           toy.linkTime() / 1e6, init_ms);
+  json << line;
+
+  double first_frame_ms = -1.0;
+  stringstream runs;
+  for(size_t size = 0; size < opts.sizes.size(); size++)
+    {
+      manager->RequestWindowSize(opts.sizes[size].first, opts.sizes[size].second);
+      manager->WindowSizeChanged();
+      int w = manager->GetWindowWidth(), h = manager->GetWindowHeight();
+      params.window_width = params.render_width = w;
+      params.window_height = params.render_height = h;
+      glBindFramebuffer(GL_FRAMEBUFFER, manager->GetDefaultFramebuffer());
+      glViewport(0, 0, w, h);
+
+      vector<double> times;
+      for(int frame = -opts.warmup; frame < opts.frames; frame++)
+        {
+          params.frame = frame + opts.warmup;
+          params.current_time_ms = params.frame * 16;
+          start = LoopClock::Now();
+          toy.draw();
+          glFinish();
+          double ms = (LoopClock::Now() - start) / 1e6;
+          if(first_frame_ms < 0.0)
+            first_frame_ms = ms;
+          if(frame >= 0)
+            times.push_back(ms);
+        }
+      sort(times.begin(), times.end());
+      double sum = 0.0;
+      for(size_t idx = 0; idx < times.size(); idx++)
+        sum += times[idx];
+
+      snprintf(line, sizeof(line), "%s\n        {\"width\": %d, \"height\": %d, "
+               "\"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p90_ms\": %.4f, "
+               "\"p99_ms\": %.4f, \"max_ms\": %.4f}", size ? "," : "", w, h,
+               sum / times.size(), percentile(times, 0.5),
+               percentile(times, 0.9), percentile(times, 0.99), times.back());
+      runs << line;
+      cerr << name << " " << w << "x" << h << ": p50 " << percentile(times, 0.5)
+           << " ms" << endl;
+    }
+
+  snprintf(line, sizeof(line), ", \"first_frame_ms\": %.3f, "
+           "\"peak_rss_kb\": %ld,\n      \"runs\": [", first_frame_ms,
+           peakMemoryKB());
+  json << line << runs.str() << "]}";
+}
+
+//every variant of a shader, or just the shader if it has none
+static void benchShader(OpenGLManager* manager, const string& path,
+                        const BenchOptions& opts, ostream& json)
+{
+  string name = path.substr(path.rfind('/') + 1);
+  string source;
+  if(!readFile(path, &source))
+    {
+      json << "    {\"name\": " << jsonString(name)
+           << ", \"ok\": false, \"error\": \"unreadable\"}";
+      return;
+    }
+
+  vector<ShaderVariant> variants;
+  if(!ShaderVariants::Parse(source, &variants))
+    {
+      json << "    {\"name\": " << jsonString(name);
+      benchSource(manager, name, source, opts, json);
+      return;
+    }
+  for(size_t idx = 0; idx < variants.size(); idx++)
+    {
+      string variant_name = name + ":" + variants[idx].name;
+      json << (idx ? ",\n" : "") << "    {\"name\": "
+           << jsonString(variant_name) << ", \"defines\": "
+           << jsonString(ShaderVariants::Key(variants[idx].defines));
+      benchSource(manager, variant_name,
+                  ShaderVariants::Source(source, variants[idx]), opts, json);
+    }
+}
+
+static int runBench(const BenchOptions& opts)
+{
+  vector<string> shaders;
+  DIR* dir = opendir(opts.directory.c_str());
+  if(!dir)
+    {
+      cerr << "Unable to read " << opts.directory << endl;
+      return 1;
+    }
+  while(struct dirent* entry = readdir(dir))
+    {
+      string name = entry->d_name;
+      if(name.size() > 5 && !name.compare(name.size() - 5, 5, ".frag"))
+        shaders.push_back(opts.directory + "/" + name);
+    }
+  closedir(dir);
+  sort(shaders.begin(), shaders.end());
+  if(shaders.empty())
+    {
+      cerr << "No .frag files in " << opts.directory << endl;
+      return 1;
+    }
+
+  //the managers log to cout, which may be where the JSON goes
+  streambuf* saved_cout = cout.rdbuf(cerr.rdbuf());
+  RendererEventHandlerPtr handler(new NullHandler());
+  OpenGLManager* manager = OpenGLManager::GetGLManager(handler, handler,
+                                                       GL_BACKEND_HEADLESS);
+  if(!manager->init(false))
+    {
+      cout.rdbuf(saved_cout);
+      cerr << "Unable to initialize OpenGL" << endl;
+      delete manager;
+      return 1;
+    }
+
+  stringstream json;
+  json << "{\n  \"renderer\": "
+       << jsonString((const char*) glGetString(GL_RENDERER))
+       << ",\n  \"warmup_frames\": " << opts.warmup
+       << ",\n  \"frames\": " << opts.frames << ",\n  \"shaders\": [\n";
+  for(size_t idx = 0; idx < shaders.size(); idx++)
+    {
+      benchShader(manager, shaders[idx], opts, json);
+      json << (idx + 1 < shaders.size() ? ",\n" : "\n");
+    }
+  json << "  ]\n}\n";
+  delete manager;
+  cout.rdbuf(saved_cout);
+
+  if(opts.output_path == "-")
+    cout << json.str();
+  else
+    {
+      ofstream out(opts.output_path.c_str());
+      out << json.str();
+      if(!out)
+        {
+          cerr << "Unable to write " << opts.output_path << endl;
+          return 1;
+        }
+    }
+  return 0;
+}
+
+
+//just enough JSON to read back what runBench() writes
+struct JsonValue
+{
+  enum { NONE, NUMBER, STRING, BOOLEAN, ARRAY, OBJECT } type;
+  double number;
+  string text;
+  vector<JsonValue> items;
+  map<string, JsonValue> members;
+
+  JsonValue(void) : type(NONE), number(0.0) {}
+
+  const JsonValue& operator[](const string& key) const
+  {
+    static const JsonValue none;
+    map<string, JsonValue>::const_iterator found = members.find(key);
+    return found == members.end() ? none : found->second;
+  }
+};
+
+class JsonParser
+{
+public:
+  JsonParser(const string& text) : text(text), pos(0) {}
+
+  bool parse(JsonValue* value)
+  {
+    return parseValue(value) && (skipSpace(), pos == text.size());
+  }
+
+private:
+  const string& text;
+  size_t pos;
+
+  void skipSpace(void)
+  {
+    while(pos < text.size() && isspace((unsigned char) text[pos]))
+      pos++;
+  }
+
+  bool expect(char c)
+  {
+    skipSpace();
+    if(pos >= text.size() || text[pos] != c)
+      return false;
+    pos++;
+    return true;
+  }
+
+  bool parseString(string* out)
+  {
+    if(!expect('"'))
+      return false;
+    out->clear();
+    while(pos < text.size() && text[pos] != '"')
+      {
+        char c = text[pos++];
+        if(c == '\\' && pos < text.size())
+          {
+            c = text[pos++];
+            if(c == 'n')
+              c = '\n';
+            else if(c == 'u')
+              {
+                //only ever control characters here
+                c = (char) strtol(text.substr(pos, 4).c_str(), 0, 16);
+                pos += 4;
+              }
+          }
+        *out += c;
+      }
+    return expect('"');
+  }
+
+  bool parseValue(JsonValue* value)
+  {
+    skipSpace();
+    if(pos >= text.size())
+      return false;
+    char c = text[pos];
+    if(c == '{')
+      {
+        value->type = JsonValue::OBJECT;
+        pos++;
+        if(expect('}'))
+          return true;
+        do
+          {
+            string key;
+            if(!parseString(&key) || !expect(':') ||
+               !parseValue(&value->members[key]))
+              return false;
+          }
+        while(expect(','));
+        return expect('}');
+      }
+    if(c == '[')
+      {
+        value->type = JsonValue::ARRAY;
+        pos++;
+        if(expect(']'))
+          return true;
+        do
+          {
+            value->items.push_back(JsonValue());
+            if(!parseValue(&value->items.back()))
+              return false;
+          }
+        while(expect(','));
+        return expect(']');
+      }
+    if(c == '"')
+      {
+        value->type = JsonValue::STRING;
+        return parseString(&value->text);
+      }
+    if(!text.compare(pos, 4, "true") || !text.compare(pos, 5, "false"))
+      {
+        value->type = JsonValue::BOOLEAN;
+        value->number = text[pos] == 't';
+        pos += text[pos] == 't' ? 4 : 5;
+        return true;
+      }
+    char* end;
+    value->type = JsonValue::NUMBER;
+    value->number = strtod(text.c_str() + pos, &end);
+    if(end == text.c_str() + pos)
+      return false;
+    pos = end - text.c_str();
+    return true;
+  }
+};
+
+static bool readJson(const string& path, JsonValue* value)
+{
+  string text;
+  if(!readFile(path, &text) || !JsonParser(text).parse(value) ||
+     value->type != JsonValue::OBJECT)
+    {
+      cerr << "Unable to read results from " << path << endl;
+      return false;
+    }
+  return true;
+}
+
+
+//prints one comparison; true if it is a regression
+static bool compareValue(const string& what, double base, double now,
+                         double threshold_pct, double noise)
+{
+  double change = base > 0.0 ? (now - base) * 100.0 / base : 0.0;
+  bool regressed = change > threshold_pct && now - base > noise;
+  bool improved = change < -threshold_pct && base - now > noise;
+  printf("%-48s %10.3f %10.3f %+8.1f%%%s\n", what.c_str(), base, now, change,
+         regressed ? "  REGRESSION" : (improved ? "  improved" : ""));
+  return regressed;
+}
+
+static int compareRuns(const string& base_path, const string& new_path,
+                       double threshold_pct)
+{
+  JsonValue base, now;
+  if(!readJson(base_path, &base) || !readJson(new_path, &now))
+    return 1;
+
+  map<string, const JsonValue*> base_shaders;
+  for(size_t idx = 0; idx < base["shaders"].items.size(); idx++)
+    base_shaders[base["shaders"].items[idx]["name"].text] =
+      &base["shaders"].items[idx];
+
+  printf("%-48s %10s %10s %9s\n", "", "base", "new", "change");
+  int regressions = 0;
+  for(size_t idx = 0; idx < now["shaders"].items.size(); idx++)
+    {
+      const JsonValue& shader = now["shaders"].items[idx];
+      const string& name = shader["name"].text;
+      map<string, const JsonValue*>::iterator found = base_shaders.find(name);
+      if(found == base_shaders.end())
+        {
+          printf("%s: new\n", name.c_str());
+          continue;
+        }
+      const JsonValue& old = *found->second;
+      base_shaders.erase(found);
+      if(!shader["ok"].number || !old["ok"].number)
+        {
+          bool broke = old["ok"].number && !shader["ok"].number;
+          printf("%s: %s\n", name.c_str(), broke ? "no longer builds  REGRESSION" :
+                 (shader["ok"].number ? "builds now" : "fails in both"));
+          regressions += broke;
+          continue;
+        }
+
+      regressions += compareValue(name + " compile+link ms",
+                                  old["compile_ms"].number + old["link_ms"].number,
+                                  shader["compile_ms"].number + shader["link_ms"].number,
+                                  threshold_pct, COMPILE_NOISE_MS);
+      for(size_t run = 0; run < shader["runs"].items.size(); run++)
+        {
+          const JsonValue& current = shader["runs"].items[run];
+          for(size_t prev = 0; prev < old["runs"].items.size(); prev++)
+            {
+              const JsonValue& before = old["runs"].items[prev];
+              if(before["width"].number != current["width"].number ||
+                 before["height"].number != current["height"].number)
+                continue;
+              stringstream what;
+              what << name << " " << current["width"].number << "x"
+                   << current["height"].number << " p50 ms";
+              regressions += compareValue(what.str(), before["p50_ms"].number,
+                                          current["p50_ms"].number,
+                                          threshold_pct, FRAME_NOISE_MS);
+            }
+        }
+    }
+  for(map<string, const JsonValue*>::iterator left = base_shaders.begin();
+      left != base_shaders.end(); left++)
+    printf("%s: missing from %s\n", left->first.c_str(), new_path.c_str());
+
+  printf("%d regressions over %.1f%%\n", regressions, threshold_pct);
+  return regressions ? 2 : 0;
+}
+
+
+static void usage(const char* argv0)
+{
+  cerr << "usage: " << argv0 << " run DIR [options]\n"
+       << "  --sizes=WxH,...          resolutions (default " DEFAULT_SIZES ")\n"
+       << "  --warmup=N               unmeasured frames first (default "
+       << DEFAULT_WARMUP_FRAMES << ")\n"
+       << "  --frames=N               measured frames (default "
+       << DEFAULT_FRAMES << ")\n"
+       << "  --output=PATH            JSON results, - for stdout (default)\n"
+       << "       " << argv0 << " compare BASE.json NEW.json [--threshold=PCT]\n"
+       << "                           flags p50 and build times more than PCT\n"
+       << "                           slower (default " << DEFAULT_THRESHOLD_PCT
+       << ")" << endl;
+}
+
+static bool parseSizes(const char* list, vector<pair<int, int> >* sizes)
+{
+  sizes->clear();
+  stringstream in(list);
+  string size;
+  while(getline(in, size, ','))
+    {
+      int w, h;
+      if(sscanf(size.c_str(), "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+        return false;
+      sizes->push_back(make_pair(w, h));
+    }
+  return !sizes->empty();
+}
+
+
+int main(int argc, const char* argv[])
+{
+  if(argc >= 4 && !strcmp(argv[1], "compare"))
+    {
+      double threshold_pct = DEFAULT_THRESHOLD_PCT;
+      if(argc > 4 && sscanf(argv[4], "--threshold=%lf", &threshold_pct) != 1)
+        {
+          usage(argv[0]);
+          return 1;
+        }
+      return compareRuns(argv[2], argv[3], threshold_pct);
+    }
+  if(argc < 3 || strcmp(argv[1], "run"))
+    {
+      usage(argv[0]);
+      return 1;
+    }
+
+  BenchOptions opts;
+  opts.directory = argv[2];
+  parseSizes(DEFAULT_SIZES, &opts.sizes);
+  opts.warmup = DEFAULT_WARMUP_FRAMES;
+  opts.frames = DEFAULT_FRAMES;
+  opts.output_path = "-";
+  for(int idx = 3; idx < argc; idx++)
+    {
+      const char* arg = argv[idx];
+      bool ok = true;
+      if(!strncmp(arg, "--sizes=", 8))
+        ok = parseSizes(arg + 8, &opts.sizes);
+      else if(!strncmp(arg, "--warmup=", 9))
+        ok = (opts.warmup = atoi(arg + 9)) >= 0;
+      else if(!strncmp(arg, "--frames=", 9))
+        ok = (opts.frames = atoi(arg + 9)) > 0;
+      else if(!strncmp(arg, "--output=", 9))
+        opts.output_path = arg + 9;
+      else
+        ok = false;
+      if(!ok)
+        {
+          usage(argv[0]);
+          return 1;
+        }
+    }
+  return runBench(opts);
+}
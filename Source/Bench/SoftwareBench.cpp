@@ -0,0 +1,109 @@
+/*
+ * SoftwareBench.cpp
+ *
+ *  Throughput of the CPU fragment kernels: renders every built-in kernel
+ *  with every ISA this machine supports on one thread, and reports
+ *  megapixels per second per core along with the speedup over scalar code.
+ *  Each ISA's output is checked against the scalar one, so a kernel that
+ *  only vectorizes by being wrong shows up.
+ *
+ *  usage: SoftwareBench [frames] [WxH] [kernel]
+ */
+
+#include <iostream>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Portability/PublicInterfaces/LoopClock.hpp>
+#include <Renderer/SoftwareRenderer.hpp>
+
+using namespace std;
+
+
+#define WARMUP_FRAMES 2
+
+
+//largest per-channel difference between two frames
+static int maxDifference(const vector<unsigned int>& a,
+                         const vector<unsigned int>& b)
+{
+  int worst = 0;
+  for(size_t idx = 0; idx < a.size(); idx++)
+    for(int shift = 0; shift < 24; shift += 8)
+      {
+        int diff = abs((int) ((a[idx] >> shift) & 0xff) -
+                       (int) ((b[idx] >> shift) & 0xff));
+        if(diff > worst)
+          worst = diff;
+      }
+  return worst;
+}
+
+
+int main(int argc, const char* argv[])
+{
+  int frames = argc > 1 ? atoi(argv[1]) : 10;
+  int w = 640, h = 360;
+  if(argc > 2 && sscanf(argv[2], "%dx%d", &w, &h) != 2)
+    return 1;
+  vector<string> kernels;
+  SoftwareRenderer::KernelNames(&kernels);
+  if(argc > 3)
+    kernels.assign(1, argv[3]);
+
+  vector<unsigned int> pixels((size_t) w * h), reference((size_t) w * h);
+  SoftwareFramebuffer fb;
+  fb.pixels = &pixels[0];
+  fb.width = fb.stride = w;
+  fb.height = h;
+
+  RendererParams params;
+  memset(&params, 0, sizeof(params));
+  params.window_width = params.render_width = w;
+  params.window_height = params.render_height = h;
+  ShaderToyParams toy_params;
+  toy_params.orientation = 0.0f;
+
+  cout << w << "x" << h << ", " << frames << " frames, one thread" << endl;
+  for(size_t kernel = 0; kernel < kernels.size(); kernel++)
+    {
+      double scalar_rate = 0.0;
+      for(int isa = 0; isa < SOFT_ISA_COUNT; isa++)
+        {
+          if(!SoftwareRenderer::Supported((softisa) isa))
+            continue;
+          SoftwareRenderer renderer(kernels[kernel], (softisa) isa);
+          if(!renderer.valid())
+            {
+              cerr << "No kernel " << kernels[kernel] << endl;
+              return 1;
+            }
+
+          TimeHistogram times;
+          for(int frame = -WARMUP_FRAMES; frame < frames; frame++)
+            {
+              params.frame = frame + WARMUP_FRAMES;
+              params.current_time_ms = params.frame * 16;
+              long long start = LoopClock::Now();
+              renderer.render(&params, &toy_params, fb);
+              if(frame >= 0)
+                times.Record(LoopClock::Now() - start);
+            }
+
+          //the last frame drawn is the same for every ISA
+          if(isa == SOFT_ISA_SCALAR)
+            reference = pixels;
+          double p50_ms = times.Percentile(0.5) / 1e6;
+          double rate = p50_ms > 0.0 ? (double) w * h / (p50_ms * 1e3) : 0.0;
+          if(isa == SOFT_ISA_SCALAR)
+            scalar_rate = rate;
+          printf("%-10s %-6s p50 %8.2f ms/frame, %8.2f Mpix/s/core, %5.2fx "
+                 "scalar, max diff %d\n", kernels[kernel].c_str(),
+                 SoftwareRenderer::IsaName((softisa) isa), p50_ms, rate,
+                 scalar_rate > 0.0 ? rate / scalar_rate : 0.0,
+                 maxDifference(pixels, reference));
+        }
+    }
+  return 0;
+}
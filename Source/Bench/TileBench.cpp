@@ -0,0 +1,129 @@
+/*
+ * TileBench.cpp
+ *
+ *  Scaling of the software renderer across cores: draws one kernel through
+ *  TileSchedulers of 1, 2, 4 ... threads, with and without work stealing,
+ *  and reports the speedup over one thread, how busy the threads were and
+ *  how often they stole. The raymarch kernel is the default because its
+ *  uneven cost per pixel is what stealing is for; with it off, the thread
+ *  dealt the slowest band of tiles sets the frame time. Every frame is
+ *  checked against the one-thread frame.
+ *
+ *  usage: TileBench [frames] [WxH] [kernel] [max threads]
+ */
+
+#include <iostream>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Portability/PublicInterfaces/LoopClock.hpp>
+#include <Renderer/SoftwareRenderer.hpp>
+#include <Renderer/TileScheduler.hpp>
+
+using namespace std;
+
+
+#define WARMUP_FRAMES 2
+
+
+struct Result
+{
+  double p50_ms;
+  double utilisation;   //mean over the threads
+  double steals;        //per frame
+  bool matches;         //same pixels as one thread drew
+};
+
+static Result measure(SoftwareRenderer* renderer, TileScheduler* scheduler,
+                      int frames, SoftwareFramebuffer& fb,
+                      const vector<unsigned int>& reference)
+{
+  RendererParams params;
+  memset(&params, 0, sizeof(params));
+  params.window_width = params.render_width = fb.width;
+  params.window_height = params.render_height = fb.height;
+  ShaderToyParams toy_params;
+  toy_params.orientation = 0.0f;
+
+  renderer->setScheduler(scheduler);
+  TimeHistogram times;
+  for(int frame = -WARMUP_FRAMES; frame < frames; frame++)
+    {
+      if(frame == 0)
+        scheduler->resetStats();
+      params.frame = frame + WARMUP_FRAMES;
+      params.current_time_ms = params.frame * 16;
+      long long start = LoopClock::Now();
+      renderer->render(&params, &toy_params, fb);
+      if(frame >= 0)
+        times.Record(LoopClock::Now() - start);
+    }
+
+  Result result;
+  result.p50_ms = times.Percentile(0.5) / 1e6;
+  result.utilisation = result.steals = 0.0;
+  for(int idx = 0; idx < scheduler->threads(); idx++)
+    {
+      result.utilisation += scheduler->utilisation(idx) / scheduler->threads();
+      result.steals += (double) scheduler->stats(idx).steals / frames;
+    }
+  result.matches = reference.empty() ||
+    !memcmp(fb.pixels, &reference[0], reference.size() * sizeof(unsigned int));
+  return result;
+}
+
+
+int main(int argc, const char* argv[])
+{
+  int frames = argc > 1 ? atoi(argv[1]) : 10;
+  int w = 1280, h = 720;
+  if(argc > 2 && sscanf(argv[2], "%dx%d", &w, &h) != 2)
+    return 1;
+  string kernel = argc > 3 ? argv[3] : "raymarch";
+  int max_threads = argc > 4 ? atoi(argv[4]) : 0;
+
+  SoftwareRenderer renderer(kernel);
+  if(!renderer.valid())
+    {
+      cerr << "No kernel " << kernel << endl;
+      return 1;
+    }
+  //a default scheduler is one thread per core
+  if(max_threads <= 0)
+    max_threads = TileScheduler().threads();
+
+  vector<unsigned int> pixels((size_t) w * h), reference;
+  SoftwareFramebuffer fb;
+  fb.pixels = &pixels[0];
+  fb.width = fb.stride = w;
+  fb.height = h;
+
+  cout << kernel << " (" << SoftwareRenderer::IsaName(renderer.isa()) << ") at "
+       << w << "x" << h << ", " << frames << " frames, up to " << max_threads
+       << " threads" << endl;
+  double one_thread_ms = 0.0;
+  for(int threads = 1; threads <= max_threads;
+      threads = threads * 2 > max_threads && threads < max_threads ?
+        max_threads : threads * 2)
+    for(int stealing = 1; stealing >= 0; stealing--)
+      {
+        if(threads == 1 && !stealing)
+          continue;
+        TileScheduler scheduler(threads);
+        scheduler.setStealing(stealing);
+        Result result = measure(&renderer, &scheduler, frames, fb, reference);
+        if(threads == 1)
+          {
+            one_thread_ms = result.p50_ms;
+            reference = pixels;
+          }
+        double speedup = result.p50_ms > 0.0 ? one_thread_ms / result.p50_ms : 0.0;
+        printf("%2d threads, stealing %-3s p50 %8.2f ms, %5.2fx (%5.1f%% "
+               "efficient), %5.1f%% busy, %6.1f steals/frame%s\n", threads,
+               stealing ? "on" : "off", result.p50_ms, speedup,
+               speedup * 100.0 / threads, result.utilisation * 100.0,
+               result.steals, result.matches ? "" : ", PIXELS DIFFER");
+      }
+  return 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * CacheFiles.cpp
+ */
+
+#include "CacheFiles.hpp"
+#include <sstream>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+
+void MakeDirectories(const string& directory)
+{
+  for(size_t pos = 1; pos <= directory.size(); pos++)
+    if(pos == directory.size() || directory[pos] == '/')
+      mkdir(directory.substr(0, pos).c_str(), 0755);
+}
+
+bool ReplaceFile(const string& path, const string& contents)
+{
+  //named for this process, so two writing at once don't share a temp file
+  stringstream tmp;
+  tmp << path << ".tmp." << getpid();
+  string tmp_path = tmp.str();
+  FILE* fp = fopen(tmp_path.c_str(), "wb");
+  if(!fp)
+    return false;
+  bool ok = fwrite(contents.data(), 1, contents.size(), fp) == contents.size();
+  ok = (fclose(fp) == 0) && ok;
+  if(!ok || rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+      unlink(tmp_path.c_str());
+      return false;
+    }
+  return true;
+}
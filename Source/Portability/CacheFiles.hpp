@@ -0,0 +1,23 @@
+/*
+ * CacheFiles.hpp
+ *
+ *  Helpers for the files kept under the cache directory (program binaries,
+ *  the framebuffer config choice), which several instances may be reading
+ *  and writing at once.
+ */
+
+#ifndef CACHEFILES_HPP_
+#define CACHEFILES_HPP_
+
+#include <string>
+
+
+//creates directory and any missing parents; existing ones are fine
+void MakeDirectories(const std::string& directory);
+
+//replaces path with contents by writing a temporary file beside it and
+//renaming it over path, so a reader (or another instance writing at the
+//same time) never sees half a file. False, with path untouched, on failure
+bool ReplaceFile(const std::string& path, const std::string& contents);
+
+#endif /* CACHEFILES_HPP_ */
@@ -0,0 +1,456 @@
+/*
+ * EGLGLManager.cpp
+ *
+ * The EGLGLManager acquires an openGL context without any window system, so
+ * the renderer can run on display-less (and GPU-less, via llvmpipe) machines.
+ * Frames go to a pbuffer when the driver offers one; otherwise the context is
+ * made current surfaceless and an FBO stands in for the default framebuffer.
+ */
+
+
+
+#include "EGLGLManager.hpp"
+#include "LoopClock.hpp"
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <Portability/PublicInterfaces/RendererEvents.hpp>
+
+
+using namespace std;
+
+static const EGLint config_attribs[] =
+  {
+    EGL_SURFACE_TYPE    , EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE , EGL_OPENGL_BIT,
+    EGL_RED_SIZE        , 8,
+    EGL_GREEN_SIZE      , 8,
+    EGL_BLUE_SIZE       , 8,
+    EGL_ALPHA_SIZE      , 8,
+    EGL_DEPTH_SIZE      , 24,
+    EGL_STENCIL_SIZE    , 8,
+    EGL_NONE
+  };
+
+//same as config_attribs, minus the pbuffer requirement
+static const EGLint surfaceless_config_attribs[] =
+  {
+    EGL_RENDERABLE_TYPE , EGL_OPENGL_BIT,
+    EGL_RED_SIZE        , 8,
+    EGL_GREEN_SIZE      , 8,
+    EGL_BLUE_SIZE       , 8,
+    EGL_ALPHA_SIZE      , 8,
+    EGL_NONE
+  };
+
+
+//space-delimited token match, so "EGL_KHR_foo" doesn't match "EGL_KHR_foobar"
+static bool hasEGLExtension(const char *extList, const char *extension)
+{
+  if ( !extList )
+    return false;
+
+  size_t len = strlen( extension );
+  for ( const char *start = extList; (start = strstr( start, extension )); start += len )
+    if ( ( start == extList || *(start - 1) == ' ' ) &&
+         ( start[len] == ' ' || start[len] == '\0' ) )
+      return true;
+
+  return false;
+}
+
+
+EGLGLManager::EGLGLManager(RendererEventHandlerPtr sysCtrl_handler,
+                           RendererEventHandlerPtr gl_renderer_handler,
+                           int width, int height)
+{
+  this->display = EGL_NO_DISPLAY;
+  this->surface = EGL_NO_SURFACE;
+  this->ctx = EGL_NO_CONTEXT;
+  this->fbo = this->color_rb = this->depth_stencil_rb = 0;
+  this->surfaceless = false;
+  this->surfaceWidth = width;
+  this->surfaceHeight = height;
+  this->surfaceSizeChanged = true;
+  this->parent = true;
+  this->parent_handler = gl_renderer_handler;
+  this->system_handler = sysCtrl_handler;
+  this->event_handler = gl_renderer_handler;
+}
+
+EGLGLManager::~EGLGLManager(void)
+{
+  if(this->display != EGL_NO_DISPLAY)
+    {
+      if(this->ctx != EGL_NO_CONTEXT)
+        {
+          SetContextCurrent();
+          DestroyDrawable();
+          eglMakeCurrent( this->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                          EGL_NO_CONTEXT );
+          eglDestroyContext( this->display, this->ctx );
+        }
+      eglTerminate( this->display );
+    }
+}
+
+
+//eglGetProcAddress takes a char* and returns a function pointer type
+static void* eglProcAddress(const GLubyte* name)
+{
+  return (void*) eglGetProcAddress( (const char*) name );
+}
+
+bool EGLGLManager::initGLDebug(void)
+{
+  return setGLDebugFuncs(eglProcAddress);
+}
+
+
+bool EGLGLManager::initializeRenderingEnvironment(bool debug_context)
+{
+  this->startup_phases.clear();
+  long long phase = LoopClock::Now();
+  GetDisplay();
+  EndPhase("egl init", &phase);
+  ConfigSurface();
+  EndPhase("egl config", &phase);
+  GetContext(debug_context);
+  EndPhase("create context", &phase);
+
+  //a pbuffer can be created before the context is current; the FBO cannot
+  if(!this->surfaceless)
+    CreateDrawable();
+  SetContextCurrent();
+  EndPhase("make current", &phase);
+
+  //Initiate glew. A GLX-built glew reports the missing GLX display after it
+  //has already loaded the core entry points, which is all we need
+  glewExperimental = GL_TRUE;
+  GLenum error = glewInit();
+  EndPhase("glew init", &phase);
+  if (error != GLEW_OK && error != GLEW_ERROR_NO_GLX_DISPLAY)
+    return false;
+
+  if(this->surfaceless)
+    {
+      CreateDrawable();
+      SetContextCurrent();
+      EndPhase("create drawable", &phase);
+    }
+
+  //no window system events, but watched fds still go through an epoll set
+  this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  WatchMessages(this->event_handler);
+
+  cout << "Headless renderer: " << glGetString(GL_RENDERER) << ", "
+       << this->surfaceWidth << "x" << this->surfaceHeight
+       << (this->fbo ? " (surfaceless FBO)" : " (pbuffer)") << endl;
+  return true;
+}
+
+void EGLGLManager::GetDisplay(void)
+{
+  const char* client_exts = eglQueryString( EGL_NO_DISPLAY, EGL_EXTENSIONS );
+
+  //the surfaceless platform never touches a window system or a DRM node
+  //owned by one, which is exactly what a render farm box has
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+  if ( hasEGLExtension( client_exts, "EGL_MESA_platform_surfaceless" ) )
+    {
+      PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+        eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+      if ( getPlatformDisplay )
+        this->display = getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA,
+                                            EGL_DEFAULT_DISPLAY, 0 );
+    }
+#endif
+
+  if ( this->display == EGL_NO_DISPLAY )
+    this->display = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+
+  EGLint major, minor;
+  if ( this->display == EGL_NO_DISPLAY ||
+       !eglInitialize( this->display, &major, &minor ) )
+    {
+      cout << "Failed to open an EGL display" << endl;
+      exit(1);
+    }
+  cout << "EGL version " << major << '.' << minor << endl;
+}
+
+void EGLGLManager::ConfigSurface(void)
+{
+  EGLint count = 0;
+  this->config = 0;
+  if ( !eglChooseConfig( this->display, config_attribs, &this->config, 1,
+                         &count ) || count < 1 )
+    {
+      this->config = 0;
+      const char* exts = eglQueryString( this->display, EGL_EXTENSIONS );
+      if ( !hasEGLExtension( exts, "EGL_KHR_surfaceless_context" ) ||
+           !eglChooseConfig( this->display, surfaceless_config_attribs,
+                             &this->config, 1, &count ) || count < 1 )
+        {
+          cout << "Failed to find an EGL config for offscreen rendering" << endl;
+          exit(1);
+        }
+      cout << "No pbuffer configs; rendering surfaceless into an FBO" << endl;
+      this->surfaceless = true;
+    }
+}
+
+void EGLGLManager::GetContext(bool debug_context)
+{
+  if ( !eglBindAPI( EGL_OPENGL_API ) )
+    {
+      cout << "EGL implementation has no desktop OpenGL support" << endl;
+      exit(1);
+    }
+
+  const char* exts = eglQueryString( this->display, EGL_EXTENSIONS );
+  if ( hasEGLExtension( exts, "EGL_KHR_create_context" ) )
+    {
+      EGLint context_attribs[] =
+        {
+          EGL_CONTEXT_MAJOR_VERSION_KHR, 4,
+          EGL_CONTEXT_MINOR_VERSION_KHR, 2,
+          EGL_CONTEXT_FLAGS_KHR,
+          EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE_BIT_KHR |
+          (debug_context ? EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR : 0),
+          EGL_NONE
+        };
+
+      cout << "Creating context" << endl;
+      this->ctx = eglCreateContext( this->display, this->config,
+                                    EGL_NO_CONTEXT, context_attribs );
+      if ( this->ctx != EGL_NO_CONTEXT )
+        cout << "Created GL 4.2 context" << endl;
+      else
+        {
+          //same fallback as X11GLManager::GetContext
+          context_attribs[1] = 2;
+          context_attribs[3] = 0;
+          cout << "Failed to create GL 4.2 context"
+                  " ... using GL 2.0 context" << endl;
+          this->ctx = eglCreateContext( this->display, this->config,
+                                        EGL_NO_CONTEXT, context_attribs );
+        }
+      memcpy( this->ctxAttribs, context_attribs, sizeof( this->ctxAttribs ) );
+    }
+  else
+    {
+      this->ctxAttribs[0] = EGL_NONE;
+      this->ctx = eglCreateContext( this->display, this->config,
+                                    EGL_NO_CONTEXT, 0 );
+    }
+
+  if ( this->ctx == EGL_NO_CONTEXT )
+    {
+      cout << "Failed to create an OpenGL context" << endl;
+      exit(1);
+    }
+}
+
+
+void EGLGLManager::CreateDrawable(void)
+{
+  DestroyDrawable();
+  if(this->surfaceless)
+    {
+      //color + depth/stencil renderbuffers on an FBO that the renderer treats
+      //as its default framebuffer
+      glGenFramebuffers(1, &this->fbo);
+      glGenRenderbuffers(1, &this->color_rb);
+      glGenRenderbuffers(1, &this->depth_stencil_rb);
+
+      glBindRenderbuffer(GL_RENDERBUFFER, this->color_rb);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8,
+                            this->surfaceWidth, this->surfaceHeight);
+      glBindRenderbuffer(GL_RENDERBUFFER, this->depth_stencil_rb);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8,
+                            this->surfaceWidth, this->surfaceHeight);
+      glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+      glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                GL_RENDERBUFFER, this->color_rb);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                                GL_RENDERBUFFER, this->depth_stencil_rb);
+      if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+          cout << "Offscreen framebuffer is incomplete" << endl;
+          exit(1);
+        }
+    }
+  else
+    {
+      EGLint pbuffer_attribs[] =
+        {
+          EGL_WIDTH, this->surfaceWidth,
+          EGL_HEIGHT, this->surfaceHeight,
+          EGL_NONE
+        };
+      this->surface = eglCreatePbufferSurface( this->display, this->config,
+                                               pbuffer_attribs );
+      if ( this->surface == EGL_NO_SURFACE )
+        {
+          cout << "Failed to create a " << this->surfaceWidth << "x"
+               << this->surfaceHeight << " pbuffer" << endl;
+          exit(1);
+        }
+    }
+  this->surfaceSizeChanged = true;
+}
+
+void EGLGLManager::DestroyDrawable(void)
+{
+  if(this->fbo)
+    {
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      glDeleteFramebuffers(1, &this->fbo);
+      glDeleteRenderbuffers(1, &this->color_rb);
+      glDeleteRenderbuffers(1, &this->depth_stencil_rb);
+      this->fbo = this->color_rb = this->depth_stencil_rb = 0;
+    }
+  if(this->surface != EGL_NO_SURFACE)
+    {
+      eglMakeCurrent( this->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                      EGL_NO_CONTEXT );
+      eglDestroySurface( this->display, this->surface );
+      this->surface = EGL_NO_SURFACE;
+    }
+}
+
+
+void EGLGLManager::RequestWindowSize(int w, int h)
+{
+  if(w == this->surfaceWidth && h == this->surfaceHeight)
+    return;
+  this->surfaceWidth = w;
+  this->surfaceHeight = h;
+  CreateDrawable();
+  SetContextCurrent();
+}
+
+GLuint EGLGLManager::GetDefaultFramebuffer(void)
+{
+  return this->fbo;
+}
+
+bool EGLGLManager::WindowSizeChanged(void)
+{
+  return this->surfaceSizeChanged;
+}
+
+int EGLGLManager::GetWindowWidth(void)
+{
+  this->surfaceSizeChanged = false;
+  return this->surfaceWidth;
+}
+
+int EGLGLManager::GetWindowHeight(void)
+{
+  this->surfaceSizeChanged = false;
+  return this->surfaceHeight;
+}
+
+//used to set/unset the renderer's context as the current GL context
+void EGLGLManager::SetContextCurrent(void)
+{
+  eglMakeCurrent( this->display, this->surface, this->surface, this->ctx );
+  if(this->fbo)
+    glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+}
+
+void EGLGLManager::UnsetContextCurrent(void)
+{
+  eglMakeCurrent( this->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                  EGL_NO_CONTEXT );
+}
+
+void EGLGLManager::SwapFrameBuffers(void)
+{
+  //swapping a pbuffer is a no-op; make sure the frame still gets rendered
+  glFlush();
+}
+
+bool EGLGLManager::HandleWindowEvents(void)
+{
+  DispatchWatchedFds(0);
+  return false;
+}
+
+class EGLSharedContext : public SharedGLContext
+{
+public:
+  EGLSharedContext(EGLDisplay display, EGLSurface surface, EGLContext ctx)
+    : display(display), surface(surface), ctx(ctx) {}
+  ~EGLSharedContext(void)
+  {
+    eglDestroyContext( this->display, this->ctx );
+    if ( this->surface != EGL_NO_SURFACE )
+      eglDestroySurface( this->display, this->surface );
+  }
+
+  bool MakeCurrent(void)
+  {
+    //EGL binds the API per thread
+    eglBindAPI( EGL_OPENGL_API );
+    return eglMakeCurrent( this->display, this->surface, this->surface,
+                           this->ctx );
+  }
+
+  void Release(void)
+  {
+    eglMakeCurrent( this->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                    EGL_NO_CONTEXT );
+  }
+
+private:
+  EGLDisplay display;
+  EGLSurface surface;
+  EGLContext ctx;
+};
+
+SharedGLContext* EGLGLManager::CreateSharedContext(void)
+{
+  //the API is bound per thread, and this is usually the render thread, not
+  //the one init() ran on; bound to GL ES, sharing with ctx is a mismatch
+  eglBindAPI( EGL_OPENGL_API );
+  EGLContext shared = eglCreateContext( this->display, this->config, this->ctx,
+                                        this->ctxAttribs );
+  if ( shared == EGL_NO_CONTEXT )
+    {
+      cout << "Failed to create a shared EGL context" << endl;
+      return 0;
+    }
+
+  //a 1x1 pbuffer to be current on, unless we can go surfaceless
+  EGLSurface surface = EGL_NO_SURFACE;
+  if ( !this->surfaceless )
+    {
+      EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+      surface = eglCreatePbufferSurface( this->display, this->config,
+                                         pbuffer_attribs );
+    }
+  return new EGLSharedContext(this->display, surface, shared);
+}
+
+
+void EGLGLManager::GetGLCLShareParameters(void** handle_pair)
+{
+  handle_pair[0] = this->display;
+  handle_pair[1] = this->ctx;
+}
+
+void EGLGLManager::toggleFullScreen(void)
+{
+}
+
+void EGLGLManager::toggleEventRecipient(void)
+{
+  parent = !parent;
+  this->event_handler = parent ? this->parent_handler:this->system_handler;
+}
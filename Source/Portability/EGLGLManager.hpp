@@ -0,0 +1,100 @@
+/*
+ * EGLGLManager.hpp
+ *
+ * Headless OpenGLManager backend: an EGL context rendering into an offscreen
+ * pbuffer, or into an FBO on a surfaceless context when the driver offers no
+ * pbuffer configs (e.g. Mesa's surfaceless platform with llvmpipe).
+ */
+
+#ifndef EGLGLMANAGER_HPP_
+#define EGLGLMANAGER_HPP_
+
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <boost/shared_ptr.hpp>
+#include <Portability/Instrumentation/Instrumentation.h>
+#include <Portability/PublicInterfaces/OpenGLManager.hpp>
+
+
+class EGLGLManager : public OpenGLManager
+{
+public:
+  EGLGLManager(RendererEventHandlerPtr sysCtrl_handler,
+               RendererEventHandlerPtr gl_renderer_handler,
+               int width, int height);
+  ~EGLGLManager(void);
+
+  bool initializeRenderingEnvironment(bool debug_context);
+  bool initGLDebug(void);
+
+  int GetWindowHeight(void);
+  int GetWindowWidth(void);
+  void RequestWindowSize(int w, int h);
+  GLuint GetDefaultFramebuffer(void);
+
+  void GetGLCLShareParameters(void** handle_pair);
+
+  SharedGLContext* CreateSharedContext(void);
+
+  //used to set/unset the renderer's context as the current GL context
+  void SetContextCurrent(void);
+  void UnsetContextCurrent(void);
+
+  //there is nothing to present; flushes so the frame is actually rendered
+  void SwapFrameBuffers(void);
+
+  //no window system, so the only events are from watched fds
+  bool HandleWindowEvents(void);
+
+  bool WindowSizeChanged(void);
+
+  void toggleFullScreen(void);
+
+  void toggleEventRecipient(void);
+
+private:
+  EGLDisplay display;
+  EGLConfig config;
+
+  //EGL_NO_SURFACE when running surfaceless
+  EGLSurface surface;
+  EGLContext ctx;
+
+  //attributes ctx was created with, reused for shared contexts
+  EGLint ctxAttribs[7];
+
+  //no pbuffer configs: context is made current without a surface and fbo
+  //stands in for the default framebuffer
+  bool surfaceless;
+  GLuint fbo;
+  GLuint color_rb;
+  GLuint depth_stencil_rb;
+
+  int surfaceWidth, surfaceHeight;
+  bool surfaceSizeChanged;
+
+  //Opens the surfaceless platform if available, else the default display.
+  //Exits program on failure
+  void GetDisplay(void);
+
+  //Picks an RGBA8/D24S8 config, preferring one with pbuffer support
+  //Exits program if no suitable config exists
+  void ConfigSurface(void);
+
+  //Gets a 4.2 context, falling back to 2.0 like X11GLManager
+  //Exits if unable to create any context
+  void GetContext(bool debug_context);
+
+  //(Re)creates the pbuffer or FBO at surfaceWidth x surfaceHeight
+  void CreateDrawable(void);
+  void DestroyDrawable(void);
+
+  bool parent;
+  RendererEventHandlerPtr parent_handler;
+  RendererEventHandlerPtr system_handler;
+  RendererEventHandlerPtr event_handler;
+};
+
+
+#endif /* EGLGLMANAGER_HPP_ */
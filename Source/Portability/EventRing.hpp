@@ -0,0 +1,132 @@
+/*
+ * EventRing.hpp
+ *
+ *  Bounded lock-free ring used to pass events to the renderer. Based on
+ *  Dmitry Vyukov's bounded MPMC queue: each cell carries a sequence number
+ *  that tells producers and the consumer whether it is free or filled, so
+ *  there is no lock and no shared count. With SingleProducer the enqueue
+ *  position is owned by one thread and needs no CAS. There is always a single
+ *  consumer.
+ *
+ *  Values are swapped in and out of cells rather than copied, so a payload
+ *  that owns resources costs no copies; plain value events are simply moved
+ *  in and out of storage allocated once, up front.
+ */
+
+#ifndef EVENTRING_HPP_
+#define EVENTRING_HPP_
+
+#include <boost/atomic.hpp>
+#include <algorithm>
+#include <stddef.h>
+
+
+//keeps the producer and consumer positions on separate cache lines
+#define EVENT_RING_CACHE_LINE 64
+
+
+template <class T, bool SingleProducer>
+class EventRing
+{
+public:
+  //capacity is rounded up to a power of two
+  EventRing(size_t capacity)
+  {
+    size_t size = 2;
+    while(size < capacity)
+      size <<= 1;
+    mask = size - 1;
+    cells = new Cell[size];
+    for(size_t idx = 0; idx < size; idx++)
+      cells[idx].sequence.store(idx, boost::memory_order_relaxed);
+    enqueue_pos.store(0, boost::memory_order_relaxed);
+    dequeue_pos.store(0, boost::memory_order_relaxed);
+  }
+
+  ~EventRing(void)
+  {
+    delete [] cells;
+  }
+
+  size_t capacity(void) { return mask + 1; }
+
+  //swaps value into the ring; value is left holding whatever the cell held
+  //(a default T). Returns false, leaving value untouched, when full
+  bool tryPush(T& value)
+  {
+    Cell* cell;
+    size_t pos = enqueue_pos.load(boost::memory_order_relaxed);
+    for(;;)
+      {
+        cell = &cells[pos & mask];
+        size_t seq = cell->sequence.load(boost::memory_order_acquire);
+        ptrdiff_t dif = (ptrdiff_t) seq - (ptrdiff_t) pos;
+        if(dif == 0)
+          {
+            if(SingleProducer)
+              {
+                enqueue_pos.store(pos + 1, boost::memory_order_relaxed);
+                break;
+              }
+            if(enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                                 boost::memory_order_relaxed))
+              break;
+          }
+        else if(dif < 0)
+          return false;
+        else
+          pos = enqueue_pos.load(boost::memory_order_relaxed);
+      }
+
+    std::swap(cell->value, value);
+    cell->sequence.store(pos + 1, boost::memory_order_release);
+    return true;
+  }
+
+  //swaps the oldest value out of the ring into value. Single consumer only
+  bool tryPop(T& value)
+  {
+    size_t pos = dequeue_pos.load(boost::memory_order_relaxed);
+    Cell* cell = &cells[pos & mask];
+    size_t seq = cell->sequence.load(boost::memory_order_acquire);
+    if((ptrdiff_t) seq - (ptrdiff_t) (pos + 1) < 0)
+      return false;
+
+    dequeue_pos.store(pos + 1, boost::memory_order_relaxed);
+    std::swap(cell->value, value);
+    //whatever value held before is dropped here rather than left in the cell
+    cell->value = T();
+    cell->sequence.store(pos + mask + 1, boost::memory_order_release);
+    return true;
+  }
+
+  //approximate; exact only when called from the consumer with no producers
+  bool empty(void)
+  {
+    size_t pos = dequeue_pos.load(boost::memory_order_relaxed);
+    return (ptrdiff_t) cells[pos & mask].sequence.load(boost::memory_order_acquire) -
+      (ptrdiff_t) (pos + 1) < 0;
+  }
+
+private:
+  struct Cell
+  {
+    boost::atomic<size_t> sequence;
+    T value;
+  };
+
+  Cell* cells;
+  size_t mask;
+
+  char pad0[EVENT_RING_CACHE_LINE];
+  boost::atomic<size_t> enqueue_pos;
+  char pad1[EVENT_RING_CACHE_LINE];
+  boost::atomic<size_t> dequeue_pos;
+  char pad2[EVENT_RING_CACHE_LINE];
+
+  //not copyable
+  EventRing(const EventRing&);
+  EventRing& operator=(const EventRing&);
+};
+
+#endif /* EVENTRING_HPP_ */
@@ -1,4 +1,5 @@
 #include "LoopClock.hpp"
+#include <string.h>
 
 
 using namespace std;
@@ -10,14 +11,27 @@ LoopClock::LoopClock(void)
     loop_times[idx] = 41666666;
   loop_time_index = 0;
   frames = 0;
-  clock_gettime(CLOCK_REALTIME, &frame_begin_time);
+  last_loop_FPS = 0.0;
+  loop_begin_time = last_end_time = 0;
+  fr_begin_time = Now();
+  end_index = end_count = 0;
+  budget = 0;
+  ResetStats();
+}
+
+
+long long LoopClock::Now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
 }
 
 
 //records the start of the rendering time
 void LoopClock::LoopStart(void)
 {
-  clock_gettime(CLOCK_REALTIME, &loop_begin_time);
+  loop_begin_time = Now();
 }
 
 //calculates total elapsed rendering time for the most recent frame
@@ -25,74 +39,175 @@ void LoopClock::LoopStart(void)
 bool LoopClock::LoopEnd(void)
 {
   ++frames;
-  clock_gettime(CLOCK_REALTIME, &end_time);
+  long long end_time = Now();
 
-  
   //update loop time
-  loop_times[loop_time_index] = MSecDiff(end_time, loop_begin_time);
-  loop_time_index = (loop_time_index + 1) % 5;
+  loop_times[loop_time_index] = end_time - loop_begin_time;
+  loop_time_index = (loop_time_index + 1) % numTimes;
+
+  cpu_times.Record(end_time - loop_begin_time);
+  if(last_end_time)
+    {
+      long long frame_ns = end_time - last_end_time;
+      frame_times.Record(frame_ns);
+      if(budget && frame_ns > budget + budget / 2)
+        missed++;
+    }
+  last_end_time = end_time;
+
+  end_times[end_index] = end_time;
+  end_index = (end_index + 1) % LOOP_CLOCK_FPS_WINDOW;
+  if(end_count < LOOP_CLOCK_FPS_WINDOW)
+    end_count++;
 
-  
   //check FR timer
-  float sd;
-  if((sd = SecDiff(frame_begin_time, end_time)) >= 1.0)
+  long long elapsed = end_time - fr_begin_time;
+  if(elapsed >= 1000000000LL)
     {
-      this->last_loop_FPS = ((float) frames) / sd;
+      this->last_loop_FPS = frames * 1e9f / elapsed;
       frames = 0;
-      clock_gettime(CLOCK_REALTIME, &frame_begin_time);
+      fr_begin_time = end_time;
       return true;
     }
   else
     return false;
 }
 
-//returns the framerate
+//returns the framerate over the last LOOP_CLOCK_FPS_WINDOW frames, or the
+//last once-a-second figure until there are enough of them
 float LoopClock::GetFR(void)
 {
-  return this->last_loop_FPS;
+  if(end_count < 2)
+    return this->last_loop_FPS;
+  unsigned int newest = (end_index + LOOP_CLOCK_FPS_WINDOW - 1) %
+    LOOP_CLOCK_FPS_WINDOW;
+  unsigned int oldest = (end_index + LOOP_CLOCK_FPS_WINDOW - end_count) %
+    LOOP_CLOCK_FPS_WINDOW;
+  long long span = end_times[newest] - end_times[oldest];
+  return span > 0 ? (end_count - 1) * 1e9f / span : this->last_loop_FPS;
 }
 
 
-float LoopClock::SecDiff(struct timespec start, struct timespec end)
+int LoopClock::EstimateSleepTime(float max_framerate)
 {
+  long long min_frame_time_ns = (long long) (1e9 / max_framerate);
+  long long avg_frame_time_ns = 0;
+  for(int idx = 0; idx < numTimes; idx++)
+    avg_frame_time_ns += loop_times[idx];
+
+  avg_frame_time_ns /= numTimes;
 
-  float secs = 0.0;
-  if ((end.tv_nsec-start.tv_nsec)<0) {
-    secs = end.tv_sec-start.tv_sec-1.0;
-    secs += (1000000000+end.tv_nsec-start.tv_nsec) / 1000000000.0;
-  } else {
-    secs = 1.0 * (end.tv_sec-start.tv_sec);
-    secs += (end.tv_nsec-start.tv_nsec)/1000000000.0;
-  }
-  return secs;
+  int sleeper_time = (int) ((min_frame_time_ns - avg_frame_time_ns) / 1000000);
+
+  return (sleeper_time >= 0) ? sleeper_time : 0;
 }
 
-int LoopClock::MSecDiff(struct timespec start, struct timespec end)
+
+void LoopClock::SetFrameBudget(long long budget_ns)
 {
+  budget = budget_ns;
+}
 
-  int msecs = 0.0;
-  if ((end.tv_nsec-start.tv_nsec)<0) {
-    msecs = (end.tv_sec-start.tv_sec)*1000;
-    msecs += (1000000+end.tv_nsec-start.tv_nsec) / 1000000;
-  } else {
-    msecs = 1000 * (end.tv_sec-start.tv_sec);
-    msecs += (end.tv_nsec-start.tv_nsec)/1000000;
-  }
-  return msecs;
+void LoopClock::ResetStats(void)
+{
+  frame_times.Reset();
+  cpu_times.Reset();
+  gpu_draw_times.Reset();
+  gpu_swap_times.Reset();
+  missed = 0;
 }
 
+void LoopClock::RecordGpuTimes(long long draw_ns, long long swap_ns)
+{
+  gpu_draw_times.Record(draw_ns);
+  gpu_swap_times.Record(swap_ns);
+}
 
 
-int LoopClock::EstimateSleepTime(float max_framerate)
+TimeSummary LoopClock::Summarize(TimeHistogram& histogram)
 {
-  int min_frame_time_ms = (int) (1000.0 / max_framerate);
-  int avg_frame_time_ms = 0;
-  for(int idx = 0; idx < numTimes; idx++)
-    avg_frame_time_ms +=loop_times[idx];
-  
-  avg_frame_time_ms /= 5;
+  TimeSummary summary;
+  summary.count = histogram.Count();
+  summary.p50_ns = histogram.Percentile(0.50);
+  summary.p90_ns = histogram.Percentile(0.90);
+  summary.p99_ns = histogram.Percentile(0.99);
+  summary.max_ns = histogram.Max();
+  return summary;
+}
 
-  int sleeper_time = min_frame_time_ms - avg_frame_time_ms;
+FrameTimeStats LoopClock::GetStats(void)
+{
+  FrameTimeStats stats;
+  stats.frame = Summarize(frame_times);
+  stats.cpu = Summarize(cpu_times);
+  stats.gpu_draw = Summarize(gpu_draw_times);
+  stats.gpu_swap = Summarize(gpu_swap_times);
+  stats.missed_deadlines = missed;
+  stats.fps = GetFR();
+  return stats;
+}
 
-  return (sleeper_time >= 0) ? sleeper_time : 0;
+
+
+void TimeHistogram::Reset(void)
+{
+  memset(buckets, 0, sizeof(buckets));
+  recorded = 0;
+  max_ns = 0;
+}
+
+int TimeHistogram::BucketFor(long long ns)
+{
+  unsigned long long units = (unsigned long long) (ns > 0 ? ns : 0) >>
+    LOOP_CLOCK_UNIT_SHIFT;
+  if(units < LOOP_CLOCK_SUB_BUCKETS)
+    return (int) units;
+
+  int msb = 63 - __builtin_clzll(units);
+  int octave = msb - LOOP_CLOCK_SUB_BITS + 1;
+  if(octave >= LOOP_CLOCK_OCTAVES)
+    return LOOP_CLOCK_BUCKETS - 1;
+  int sub = (int) (units >> (msb - LOOP_CLOCK_SUB_BITS)) &
+    (LOOP_CLOCK_SUB_BUCKETS - 1);
+  return octave * LOOP_CLOCK_SUB_BUCKETS + sub;
+}
+
+long long TimeHistogram::BucketValue(int bucket)
+{
+  int octave = bucket / LOOP_CLOCK_SUB_BUCKETS;
+  long long sub = bucket % LOOP_CLOCK_SUB_BUCKETS;
+  if(octave == 0)
+    return (2 * sub + 1) << (LOOP_CLOCK_UNIT_SHIFT - 1);
+  long long low = (LOOP_CLOCK_SUB_BUCKETS + sub) << (octave - 1);
+  long long width = 1LL << (octave - 1);
+  return (2 * low + width) << (LOOP_CLOCK_UNIT_SHIFT - 1);
+}
+
+void TimeHistogram::Record(long long ns)
+{
+  buckets[BucketFor(ns)]++;
+  recorded++;
+  if(ns > max_ns)
+    max_ns = ns;
+}
+
+long long TimeHistogram::Percentile(double p)
+{
+  if(!recorded)
+    return 0;
+  unsigned long long rank = (unsigned long long) (p * recorded);
+  if(rank >= recorded)
+    rank = recorded - 1;
+
+  unsigned long long seen = 0;
+  for(int bucket = 0; bucket < LOOP_CLOCK_BUCKETS; bucket++)
+    {
+      seen += buckets[bucket];
+      if(seen > rank)
+        {
+          long long value = BucketValue(bucket);
+          return value < max_ns ? value : max_ns;
+        }
+    }
+  return max_ns;
 }
@@ -1,44 +1,140 @@
+#ifndef LOOPCLOCK_HPP_
+#define LOOPCLOCK_HPP_
+
 #include <time.h>
 
+//frame times are bucketed log-linearly: LOOP_CLOCK_SUB_BUCKETS linear steps
+//per power of two, starting at 2^LOOP_CLOCK_UNIT_SHIFT ns (~1us). Bucket
+//width is at most 1/16 of its value, over 1us to over an hour
+#define LOOP_CLOCK_UNIT_SHIFT 10
+#define LOOP_CLOCK_SUB_BITS 4
+#define LOOP_CLOCK_SUB_BUCKETS (1 << LOOP_CLOCK_SUB_BITS)
+#define LOOP_CLOCK_OCTAVES 29
+#define LOOP_CLOCK_BUCKETS (LOOP_CLOCK_OCTAVES * LOOP_CLOCK_SUB_BUCKETS)
+
+//frames the rolling framerate is measured over
+#define LOOP_CLOCK_FPS_WINDOW 120
+
+
+//Fixed-memory histogram of durations in ns
+class TimeHistogram
+{
+public:
+  TimeHistogram(void) { Reset(); }
+
+  void Record(long long ns);
+  void Reset(void);
 
+  //duration below which a fraction p (0-1) of the recorded ones fell, to
+  //within one bucket
+  long long Percentile(double p);
+  long long Max(void) { return max_ns; }
+  unsigned long long Count(void) { return recorded; }
 
+private:
+  unsigned int buckets[LOOP_CLOCK_BUCKETS];
+  unsigned long long recorded;
+  long long max_ns;
 
+  static int BucketFor(long long ns);
+  //midpoint of the bucket's range, in ns
+  static long long BucketValue(int bucket);
+};
+
+
+struct TimeSummary
+{
+  unsigned long long count;
+  long long p50_ns, p90_ns, p99_ns; //to within one histogram bucket
+  long long max_ns;                 //exact
+};
+
+//snapshot of everything recorded since the last ResetStats()
+struct FrameTimeStats
+{
+  TimeSummary frame;    //LoopEnd to LoopEnd
+  TimeSummary cpu;      //LoopStart to LoopEnd
+  TimeSummary gpu_draw; //GPU time spent drawing, from RecordGpuTimes()
+  TimeSummary gpu_swap; //GPU time across the buffer swap
+  unsigned long long missed_deadlines;
+  float fps;            //rolling, over the last few frames
+};
+
+
+//Frame time is the CLOCK_MONOTONIC interval between successive LoopEnd()
+//calls, i.e. the cadence the viewer sees; cpu time is the part of it between
+//LoopStart() and LoopEnd(). A frame misses its deadline when its frame time
+//runs past one and a half budgets, meaning at least one frame slot went by
+//without a new frame. GPU times arrive frames late from timer queries and
+//are kept alongside, so a slow frame can be pinned on the shader or the host.
 class LoopClock
 {
-  //keep track of average loop time in milliseconds.
+  //keep track of average loop (LoopStart to LoopEnd) time in nanoseconds.
   static const int numTimes = 5;
-  long loop_times[numTimes];
-  struct timespec frame_begin_time;
-  struct timespec loop_begin_time;
-  struct timespec end_time;
+  long long loop_times[numTimes];
+  long long loop_begin_time;
+  long long last_end_time;
+  long long fr_begin_time;
 
   //keeps track of which loop time is the oldest and should be replaced next
   unsigned short loop_time_index;
 
   //keeps track of number of frames processed since the last framerate update
   unsigned int frames;
-  
+
   float last_loop_FPS;
 
-  //returns the elapsed time from t2 to t1 in seconds
-  float SecDiff(struct timespec t1, struct timespec t2);
+  //frame end times for the rolling framerate; end_index is the next to go
+  long long end_times[LOOP_CLOCK_FPS_WINDOW];
+  unsigned int end_index, end_count;
 
-  //returns the elapsed time from t2 to t1 in mseconds
-  int MSecDiff(struct timespec t1, struct timespec t2);
+  TimeHistogram frame_times;
+  TimeHistogram cpu_times;
+  TimeHistogram gpu_draw_times;
+  TimeHistogram gpu_swap_times;
+  long long budget;
+  unsigned long long missed;
+
+  static TimeSummary Summarize(TimeHistogram& histogram);
 
-  
 public:
   LoopClock(void);
 
+  //nanoseconds on CLOCK_MONOTONIC
+  static long long Now(void);
+
   //records the start of the looping time
   void LoopStart(void);
 
   //calculates total elapsed looping time for the most recent frame
-  //returns true if a new framerate value is available
+  //returns true if a new framerate value is available (once a second)
   bool LoopEnd(void);
 
-  //returns the framerate
+  //returns the rolling framerate
   float GetFR(void);
 
+  //LoopStart to LoopEnd of the most recent frame, in ns
+  long long LastLoopTime(void)
+  {
+    return loop_times[(loop_time_index + numTimes - 1) % numTimes];
+  }
+
   int EstimateSleepTime(float max_framerate);
+
+  //time allowed per frame for deadline accounting; 0 (the default) counts
+  //nothing as missed
+  void SetFrameBudget(long long budget_ns);
+
+  //adds one frame's GPU timings, however late they were read back
+  void RecordGpuTimes(long long draw_ns, long long swap_ns);
+
+  //frame time below which a fraction p (0-1) of the recorded frames fell
+  long long Percentile(double p) { return frame_times.Percentile(p); }
+
+  FrameTimeStats GetStats(void);
+
+  //clears the histograms and missed-deadline count, e.g. after warm-up
+  void ResetStats(void);
 };
+
+#endif /* LOOPCLOCK_HPP_ */
@@ -0,0 +1,211 @@
+/*
+ * OpenGLManager.cpp
+ *
+ * Backend selection for OpenGLManager::GetGLManager.
+ */
+
+
+
+#include "X11GLManager.hpp"
+#include "EGLGLManager.hpp"
+#include "SoftwareManager.hpp"
+#include "LoopClock.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+
+
+//size of the offscreen drawable the headless backend starts with; the
+//renderer can change it with RequestWindowSize()
+#define HEADLESS_DEFAULT_WIDTH 1280
+#define HEADLESS_DEFAULT_HEIGHT 720
+
+
+GLBackend OpenGLManager::ParseBackend(const char* name)
+{
+  if(!name)
+    return GL_BACKEND_DEFAULT;
+  if(!strcmp(name, "x11") || !strcmp(name, "glx"))
+    return GL_BACKEND_X11;
+  if(!strcmp(name, "headless") || !strcmp(name, "egl"))
+    return GL_BACKEND_HEADLESS;
+  if(!strcmp(name, "software") || !strcmp(name, "cpu"))
+    return GL_BACKEND_SOFTWARE;
+  return GL_BACKEND_DEFAULT;
+}
+
+
+bool OpenGLManager::ListOutputs(std::vector<DisplayOutput>* outputs)
+{
+  return X11GLManager::EnumerateOutputs(0, outputs);
+}
+
+
+OpenGLManager* OpenGLManager::GetGLManager(RendererEventHandlerPtr sysCtrl_handler, RendererEventHandlerPtr parent_handler)
+{
+  return GetGLManager(sysCtrl_handler, parent_handler, GL_BACKEND_DEFAULT);
+}
+
+
+OpenGLManager* OpenGLManager::GetGLManager(RendererEventHandlerPtr sysCtrl_handler, RendererEventHandlerPtr parent_handler, GLBackend backend)
+{
+  if(backend == GL_BACKEND_DEFAULT)
+    backend = ParseBackend(getenv("SHADERTOY_GL_BACKEND"));
+
+  //X11GLManager exits when it can't open a display, so only pick it by
+  //default when there's a display to open
+  if(backend == GL_BACKEND_DEFAULT)
+    {
+      const char* x_display = getenv("DISPLAY");
+      backend = (x_display && *x_display) ? GL_BACKEND_X11 : GL_BACKEND_HEADLESS;
+    }
+
+  if(backend == GL_BACKEND_SOFTWARE)
+    {
+      lfPrintf("Using software backend");
+      return new SoftwareManager(sysCtrl_handler, parent_handler,
+                                 HEADLESS_DEFAULT_WIDTH, HEADLESS_DEFAULT_HEIGHT);
+    }
+  if(backend == GL_BACKEND_HEADLESS)
+    {
+      lfPrintf("Using headless EGL backend");
+      return new EGLGLManager(sysCtrl_handler, parent_handler,
+                              HEADLESS_DEFAULT_WIDTH, HEADLESS_DEFAULT_HEIGHT);
+    }
+  return new X11GLManager(sysCtrl_handler,parent_handler);
+}
+
+
+void OpenGLManager::EndPhase(const char* name, long long* start)
+{
+  long long now = LoopClock::Now();
+  StartupPhase phase;
+  phase.name = name;
+  phase.ns = now - *start;
+  this->startup_phases.push_back(phase);
+  *start = now;
+}
+
+
+bool OpenGLManager::StartFramePacing(double fps, bool detached)
+{
+  if(epoll_fd < 0 || fps <= 0.0)
+    return false;
+  if(timer_fd >= 0 && detached != timer_detached)
+    {
+      if(!timer_detached)
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, timer_fd, 0);
+      close(timer_fd);
+      timer_fd = -1;
+    }
+  if(timer_fd < 0)
+    {
+      timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+      if(timer_fd < 0)
+        return false;
+      timer_detached = detached;
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.fd = timer_fd;
+      if(!detached && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event) != 0)
+        {
+          close(timer_fd);
+          timer_fd = -1;
+          return false;
+        }
+    }
+
+  long long period_ns = (long long) (1e9 / fps);
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = period_ns / 1000000000LL;
+  spec.it_interval.tv_nsec = period_ns % 1000000000LL;
+  //the first frame is due now; the rest follow on a fixed grid from here
+  clock_gettime(CLOCK_MONOTONIC, &spec.it_value);
+  return timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, 0) == 0;
+}
+
+
+unsigned int OpenGLManager::WaitForWake(void)
+{
+  unsigned int wake = 0;
+  if(epoll_fd < 0)
+    return WAKE_FRAME;
+
+  int timeout_ms = (timer_fd < 0) ? 0 : -1;
+  if(WindowEventsPending())
+    {
+      wake |= WAKE_INPUT;
+      timeout_ms = 0;
+    }
+
+  for(;;)
+    {
+      struct epoll_event events[8];
+      int ready = epoll_wait(epoll_fd, events, 8, timeout_ms);
+      if(ready < 0 && errno == EINTR)
+        continue;
+      for(int idx = 0; idx < ready; idx++)
+        {
+          int fd = events[idx].data.fd;
+          if(fd == timer_fd)
+            {
+              uint64_t expirations;
+              if(read(timer_fd, &expirations, sizeof(expirations)) ==
+                 sizeof(expirations))
+                {
+                  missed_frames += expirations - 1;
+                  wake |= WAKE_FRAME;
+                }
+            }
+          else if(fd == window_fd)
+            wake |= WAKE_INPUT;
+          else if(fd == message_fd)
+            {
+              //cleared before the caller pops, so a message pushed after
+              //that signals it again
+              uint64_t count;
+              if(read(message_fd, &count, sizeof(count)) == sizeof(count))
+                wake |= WAKE_MESSAGE;
+            }
+          else
+            {
+              std::map<int, FdWatcher*>::iterator watcher =
+                fd_watchers.find(fd);
+              if(watcher != fd_watchers.end())
+                watcher->second->FdReady(fd);
+            }
+        }
+      //a watched fd alone isn't a reason to return to the caller
+      if(wake || timeout_ms == 0 || ready <= 0)
+        break;
+    }
+
+  if(timer_fd < 0)
+    wake |= WAKE_FRAME;
+  return wake;
+}
+
+
+void OpenGLManager::WaitForFrame(void)
+{
+  if(timer_fd < 0)
+    return;
+  struct pollfd timer;
+  timer.fd = timer_fd;
+  timer.events = POLLIN;
+  for(;;)
+    {
+      uint64_t expirations;
+      if(read(timer_fd, &expirations, sizeof(expirations)) ==
+         sizeof(expirations))
+        {
+          missed_frames += expirations - 1;
+          return;
+        }
+      if(poll(&timer, 1, -1) < 0 && errno != EINTR)
+        return;
+    }
+}
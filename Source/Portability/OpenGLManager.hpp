@@ -1,17 +1,156 @@
+#ifndef OPENGLMANAGER_HPP_
+#define OPENGLMANAGER_HPP_
+
+#include <GL/glew.h>
 #include <boost/shared_ptr.hpp>			// boost used for SceneObjectWrapperPtr
 #include <Portability/PublicInterfaces/RendererEvents.hpp>
 #include <Portability/PublicInterfaces/VmsKeys.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+
+//reasons WaitForWake() returned; more than one may be set
+#define WAKE_FRAME 0x01  //the frame timer expired: time to draw
+#define WAKE_INPUT 0x02  //the window system has events for HandleWindowEvents()
+#define WAKE_MESSAGE 0x04 //a software message was pushed to the event handler
+
+
+//which windowing/context backend GetGLManager should construct
+typedef enum {
+  GL_BACKEND_DEFAULT,  //SHADERTOY_GL_BACKEND if set, else X11 when $DISPLAY is
+                       //set and headless otherwise
+  GL_BACKEND_X11,      //GLX context in an X window
+  GL_BACKEND_HEADLESS, //EGL pbuffer/surfaceless context, no X server needed
+  GL_BACKEND_SOFTWARE  //no GL at all: frames are drawn on the CPU into a
+                       //SoftwareFramebuffer, shown in an X window if $DISPLAY
+                       //is set
+} GLBackend;
+
+
+//how SwapFrameBuffers() waits for the display's vertical blank
+typedef enum {
+  VSYNC_DEFAULT,   //whatever the driver/user configuration says; untouched
+  VSYNC_OFF,       //swap immediately, tearing
+  VSYNC_ON,        //wait for the next vblank
+  VSYNC_ADAPTIVE   //wait, unless the frame missed its vblank: then tear
+                   //rather than wait a whole extra refresh
+} vsyncmode;
+
+
+//how init() lays windows out over the display's monitors
+typedef enum {
+  OUTPUTS_SINGLE,  //one window, wherever the window manager puts it
+  OUTPUTS_SPAN,    //one undecorated window over every output on the screen
+  OUTPUTS_EACH     //an undecorated window per output; this manager's is on
+                   //the first, see CreateOutputManager() for the rest
+} outputlayout;
+
+//a monitor, in root window coordinates
+struct DisplayOutput {
+  std::string name;        //the RandR output's, or xinerama-N / screen-N
+  int x, y, width, height;
+  double refresh_hz;       //0 when the server doesn't say
+  int screen;              //X screen it belongs to
+};
+
+
+//when frames are reaching the display, on CLOCK_MONOTONIC
+struct PresentTiming {
+  long long last_present_ns;    //vblank the last completed swap was shown at,
+                                //to within a refresh
+  long long predicted_ns;       //vblank a frame begun now will be shown at
+  long long refresh_ns;         //the display's refresh period
+  unsigned long long presents;  //swaps seen completed since init
+};
+
+
+//gets called when a watched file descriptor is readable, on whichever thread
+//is waiting on the manager (see WatchFd()), which with a render thread isn't
+//the one drawing
+class FdWatcher {
+public:
+  virtual ~FdWatcher(void){};
+  virtual void FdReady(int fd) = 0;
+};
+
+
+//a second context sharing objects (programs, buffers, textures, but not
+//VAOs/FBOs) with the renderer's, for compiling/uploading on another thread.
+//MakeCurrent() must be called from the thread that is going to use it
+class SharedGLContext {
+public:
+  virtual ~SharedGLContext(void){};
+  virtual bool MakeCurrent(void) = 0;
+  virtual void Release(void) = 0;
+};
+
+
+//pixels of a backend without a GL context, rows top first, each pixel
+//0xAARRGGBB in native byte order
+struct SoftwareFramebuffer {
+  unsigned int* pixels;
+  int width, height;
+  int stride;              //pixels from one row to the next
+};
+
+
+//what the last HandleWindowEvents() call took off the window system's queue
+struct WindowEventStats {
+  unsigned int raw;        //native events read
+  unsigned int coalesced;  //of those, motion/resize events folded into a later one
+  bool truncated;          //the drain limit was hit with events still queued
+};
+
+
+//one timed step of initializeRenderingEnvironment()
+struct StartupPhase {
+  const char* name;
+  long long ns;
+};
 
 
 class OpenGLManager {
 public:
+  OpenGLManager(void) : epoll_fd(-1), window_fd(-1), message_fd(-1),
+                        output_layout(OUTPUTS_SINGLE), timer_fd(-1),
+                        timer_detached(false), missed_frames(0)
+  {
+    event_stats.raw = event_stats.coalesced = 0;
+    event_stats.truncated = false;
+  }
+
   //returns a system-appropriate openGL manager object. 
   static OpenGLManager* GetGLManager(RendererEventHandlerPtr
                                      sysCtrl_event_handler,
                                      RendererEventHandlerPtr
                                      gl_renderer_event_handler);
+
+  //returns an openGL manager object for the requested backend
+  static OpenGLManager* GetGLManager(RendererEventHandlerPtr
+                                     sysCtrl_event_handler,
+                                     RendererEventHandlerPtr
+                                     gl_renderer_event_handler,
+                                     GLBackend backend);
+
+  //maps "x11"/"headless"/"software" to a backend; anything else is
+  //GL_BACKEND_DEFAULT
+  static GLBackend ParseBackend(const char* name);
+
+  //the monitors of the X display $DISPLAY names: XRandR's outputs where the
+  //server has RandR 1.2, else Xinerama's screens, else one per X screen.
+  //False when there's no display to ask
+  static bool ListOutputs(std::vector<DisplayOutput>* outputs);
   
-  virtual ~OpenGLManager(void){};
+  virtual ~OpenGLManager(void)
+  {
+    if(timer_fd >= 0)
+      close(timer_fd);
+    if(epoll_fd >= 0)
+      close(epoll_fd);
+  };
 
   virtual bool initializeRenderingEnvironment(bool debug_context) = 0;
   virtual bool initGLDebug(void) = 0;
@@ -50,47 +189,211 @@ public:
   }
   
   bool debug_loaded_successfully;
+
+  //the steps the last init() took, in order, with how long each one took
+  const std::vector<StartupPhase>& GetStartupPhases(void) { return startup_phases; }
+
+  //file a backend may remember its framebuffer config choice in, so the
+  //next launch can ask for it directly; empty, the default, disables that.
+  //Set before init()
+  void SetConfigCachePath(const std::string& path) { config_cache_path = path; }
+
+  //how windows are laid out over the outputs; set before init(). Backends
+  //without a display ignore it
+  void SetOutputLayout(outputlayout layout) { output_layout = layout; }
+
+  //the outputs init() laid windows out over, as ListOutputs() gives them;
+  //empty without a display
+  const std::vector<DisplayOutput>& GetOutputs(void) { return outputs; }
+
+  //with OUTPUTS_EACH, a manager for output index's window, sharing objects
+  //(programs, buffers, textures) with this one. Its context isn't current
+  //anywhere. Its window's events come through this manager's
+  //HandleWindowEvents(), and fds it watches are dispatched from this one's
+  //WaitForWake(). Null for index 0 (this manager's own), for outputs on
+  //another X screen, or where the backend can't
+  virtual OpenGLManager* CreateOutputManager(size_t index) { return 0; }
   
   virtual int GetWindowWidth(void) = 0;
   virtual int GetWindowHeight(void) = 0;
 
-  //used to set/unset the renderer's context as the current GL context
+  //asks for a new drawable size; the change is reported through
+  //WindowSizeChanged() once it has taken effect
+  virtual void RequestWindowSize(int w, int h) = 0;
+
+  //framebuffer object that stands in for the window's back buffer. Backends
+  //without a default framebuffer (surfaceless EGL) render into an FBO instead
+  virtual GLuint GetDefaultFramebuffer(void) { return 0; }
+
+  //for software backends, fills fb with the buffer the next
+  //SwapFrameBuffers() presents, and returns true; GL backends return false.
+  //The buffer may move after every swap, so fetch it once per frame
+  virtual bool GetSoftwareFramebuffer(SoftwareFramebuffer* fb) { return false; }
+
+  //used to set/unset the renderer's context as the current GL context. To
+  //hand the context to another thread, unset it here and set it there
   virtual void SetContextCurrent(void) = 0;
   virtual void UnsetContextCurrent(void) = 0;
 
   //swaps the front/back frame buffers, making the most recent frame visible
   virtual void SwapFrameBuffers(void) = 0;
 
+  //sets how swaps sync to the display; false, leaving it as it was, if the
+  //backend can't do mode
+  virtual bool SetSwapInterval(vsyncmode mode) { return false; }
+
+  //fills timing from the display's swap counters; false when the backend
+  //has none, which leaves frames to be timed by when they're drawn
+  virtual bool GetPresentTiming(PresentTiming* timing) { return false; }
+
   virtual bool WindowSizeChanged(void) = 0;
 
   virtual bool HandleWindowEvents(void) = 0;
 
+  WindowEventStats LastEventStats(void) { return event_stats; }
+
+  //arms a timerfd in the epoll set that fires every 1/fps seconds on
+  //absolute CLOCK_MONOTONIC deadlines, so a late frame doesn't push the
+  //following ones back. Call after init(). Detached, the timer is kept out
+  //of the epoll set: a render thread waits for frames with WaitForFrame()
+  //while the thread that owns the window system waits on WaitForWake()
+  bool StartFramePacing(double fps, bool detached = false);
+
+  //blocks until the next frame is due, the window system has input or the
+  //event handler has a software message, calling the watchers of any other
+  //fds that become ready meanwhile. Returns a mask of WAKE_ flags. Without
+  //frame pacing, never blocks and always includes WAKE_FRAME. With a
+  //detached timer, never includes it and blocks until input or a message
+  unsigned int WaitForWake(void);
+
+  //render thread side of a detached timer: blocks until the next frame is
+  //due. Without frame pacing, returns straight away
+  void WaitForFrame(void);
+
+  //frame deadlines that passed while the previous frame was still running
+  unsigned long long MissedFrames(void) { return missed_frames; }
+
   //returns a platform-specific device/context handle pair.
   //attribs must have space for two void*'s
   virtual void GetGLCLShareParameters(void** handle_pair) = 0;
 
+  //creates a context sharing objects with this one; call from the render
+  //thread after init(). Returns null if the platform can't share
+  virtual SharedGLContext* CreateSharedContext(void) = 0;
+
+  //adds fd to the set the window system's events are polled with; the
+  //watcher is called when fd is readable from WaitForWake() or
+  //HandleWindowEvents(), on whichever thread calls them. In runThreaded()
+  //and runOutputs() that's the input thread, not the render thread, so
+  //FdReady() must be safe to run alongside the drawing
+  bool WatchFd(int fd, FdWatcher* watcher)
+  {
+    if(epoll_fd < 0)
+      return false;
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+      return false;
+    fd_watchers[fd] = watcher;
+    return true;
+  }
+
+  void UnwatchFd(int fd)
+  {
+    if(epoll_fd >= 0)
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, 0);
+    fd_watchers.erase(fd);
+  }
+
   virtual void toggleFullScreen() = 0;
 
   virtual void toggleEventRecipient() = 0;
 
-  bool HandleGlobalEvents(RendererEventPtr event) //checks every event to see if it is a global one, returns whether it used it or not
+  bool HandleGlobalEvents(const RendererEvent* event) //checks every event to see if it is a global one, returns whether it used it or not
   {
     if(!event)
 	return false;
     
     if(event->type == KEY_DOWN)
 	{
-      if((event->data->key_data->which == VMS_ENTER) && (event->mask & SHIFT_MASK) && (event->mask & CTRL_MASK)){
+      if((event->data.key.which == VMS_ENTER) && (event->mask & SHIFT_MASK) && (event->mask & CTRL_MASK)){
         lfPrintf("recieved message toggle signal: switching event recipient");
         this->toggleEventRecipient();
 		return true;
-	  }else if(event->data->key_data->which == VMS_F11){
+	  }else if(event->data.key.which == VMS_F11){
 	    this->toggleFullScreen();
 		return true;
 	  }
 	}
 	return false;
   }
-};
 
+protected:
+  //epoll set holding the window system connection (if any) and every fd
+  //passed to WatchFd()
+  int epoll_fd;
+  std::map<int, FdWatcher*> fd_watchers;
+
+  //filled in by HandleWindowEvents()
+  WindowEventStats event_stats;
+
+  //the window system connection's fd in the epoll set, or -1
+  int window_fd;
+
+  //the event handler's MessageFd() in the epoll set, or -1
+  int message_fd;
+
+  std::vector<StartupPhase> startup_phases;
+  std::string config_cache_path;
+
+  outputlayout output_layout;
+  //filled in by init() for backends with a display
+  std::vector<DisplayOutput> outputs;
+
+  //records phase name as lasting from *start until now, and moves *start
+  //to now for the next one
+  void EndPhase(const char* name, long long* start);
+
+  //adds handler's MessageFd() to the epoll set, so a software message sent
+  //from another thread wakes WaitForWake(); call once epoll_fd is open
+  void WatchMessages(const RendererEventHandlerPtr& handler)
+  {
+    if(epoll_fd < 0 || !handler || handler->MessageFd() < 0)
+      return;
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = handler->MessageFd();
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event.data.fd, &event) == 0)
+      message_fd = event.data.fd;
+  }
+
+  //called before WaitForWake() blocks: flushes any output and returns true
+  //if events were already read off window_fd (so epoll won't report them)
+  virtual bool WindowEventsPending(void) { return false; }
+
+  //waits up to timeout_ms for any fd in the set, calling the watchers of the
+  //ones that are ready. Returns the number of ready fds, watched or not
+  int DispatchWatchedFds(int timeout_ms)
+  {
+    if(epoll_fd < 0)
+      return 0;
+    struct epoll_event events[8];
+    int ready = epoll_wait(epoll_fd, events, 8, timeout_ms);
+    for(int idx = 0; idx < ready; idx++)
+      {
+        std::map<int, FdWatcher*>::iterator watcher =
+          fd_watchers.find(events[idx].data.fd);
+        if(watcher != fd_watchers.end())
+          watcher->second->FdReady(events[idx].data.fd);
+      }
+    return ready > 0 ? ready : 0;
+  }
+
+private:
+  int timer_fd;
+  bool timer_detached;
+  unsigned long long missed_frames;
+};
 
+#endif /* OPENGLMANAGER_HPP_ */
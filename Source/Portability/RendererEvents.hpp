@@ -13,12 +13,19 @@
 
 #include <Include/VMS_Defines.h>   // has uint32, float32, float64
 #include <boost/shared_ptr.hpp>    // boost used for SceneObjectWrapperPtr
-#include <Services/VmsCriticalSections/VmsSynchronizedQueue.hpp>
+#include <Portability/PublicInterfaces/EventRing.hpp>
+#include <Portability/PublicInterfaces/LoopClock.hpp>
 #include <Portability/Instrumentation/Instrumentation.h>
 #include <Portability/PublicInterfaces/PortTstring.h>
 #include <Services/VmsTextures/VmsTexture.h>
 #include <Synthesizer/SceneObject.h>
 #include <utility>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 
 
@@ -37,8 +44,9 @@ typedef enum {
   MOUSE_DBLCLK, //double click
   KEY_UP,       //when a key is pressed or released
   KEY_DOWN,
-  SOFTWARE     //if the renderer wants to send a non-input related message to
+  SOFTWARE,    //if the renderer wants to send a non-input related message to
                //system control, or someone wants to MSG the renderer
+  NO_EVENT     //a default-constructed event that carries nothing
 } eventtype;
 
 
@@ -99,89 +107,103 @@ enum renderer_message {
   SCENEOBJECT_RETURN
 };
 
+//bytes of message contents stored inside the event itself
+#define MESSAGE_INLINE_BYTES 16
+
 struct SoftwareMessageData
 {
-  //I don't like this pointer implementation for contents. The user has to be
-  //wary of making sure they don't need whatever is stored in contents, as it
-  //will be deleted when the struct is.
-  ~SoftwareMessageData()
-  {
-    switch(msg_type)
-    {
-	case LOG_FRAMES:
-	  vms_delete (uint32*)contents;
-	  break;
-	case RENDERER_HANDLES_EVENTS:
-		vms_delete (bool*)contents;
-		break;
-	case RENDERER_SCREENCAPTURE:
-		vms_delete (tstring*)contents;
-		break;
-	case REGISTER_TEXTURE:
-		vms_delete (RegisterTextureInfo*) contents;
-		break;
-	case RENDERER_STOP:
-		vms_delete (char*) contents;
-		break;
-	case REGISTER_SCENEOBJECT:
-		break;
-	case DEREGISTER_SCENEOBJECT:
-		vms_delete (int*) contents;
-		break;
-	case SCENEOBJECT_REQUEST:
-		vms_delete (std::pair<int,int>*) contents;
-		break;
-	case SCENEOBJECT_RETURN:
-		break;
-    }
-  }
-
   renderer_message msg_type;
-  void* contents;
-};
 
-typedef struct EventDataWrapper {
-  EventDataWrapper(): press_data(0), move_data(0), key_data(0), wheel_data(0),
-                      double_data(0), message_data(0) {;}
-  ~EventDataWrapper()
+  //small contents live inline, so common messages never allocate:
+  //  LOG_FRAMES                frames
+  //  RENDERER_HANDLES_EVENTS   flag
+  //  DEREGISTER_SCENEOBJECT    id
+  //  SCENEOBJECT_REQUEST       pair
+  //RENDERER_SCREENCAPTURE (tstring*) and REGISTER_TEXTURE
+  //(RegisterTextureInfo*) carry a heap pointer that the event owns; see
+  //RendererEvent::releaseContents()
+  union
   {
-    vms_delete press_data;
-    vms_delete move_data;
-    vms_delete key_data;
-    vms_delete double_data;
-    vms_delete wheel_data;
-    vms_delete message_data;
-  }
-  MousePressData* press_data;
-  MouseMoveData* move_data;
-  KeystrokeData* key_data;
-  MouseWheelData* wheel_data;
-  MouseDoubleData* double_data;
-  SoftwareMessageData* message_data;
-} RendererDataWrapper;
+    uint32 frames;
+    bool flag;
+    int32 id;
+    int32 pair[2];
+    void* heap;
+    char bytes[MESSAGE_INLINE_BYTES];
+  } contents;
+};
 
+//exactly one of these is valid, selected by RendererEvent::type
+union EventData
+{
+  MousePressData press;     //MOUSE_DOWN, MOUSE_UP
+  MouseMoveData move;       //MOUSE_MOVE
+  KeystrokeData key;        //KEY_DOWN, KEY_UP
+  MouseWheelData wheel;     //MOUSE_SCROLL
+  MouseDoubleData dbl;      //MOUSE_DBLCLK
+  SoftwareMessageData message; //SOFTWARE
+};
 
 
+
+//A compact value type: events are copied through the queues rather than
+//allocated, so input costs no heap traffic. The one exception is a message
+//whose contents don't fit inline; copying such an event copies the pointer,
+//so exactly one copy (normally the one the consumer pops) must call
+//releaseContents().
 class RendererEvent
 {
 public:
+  RendererEvent(void) : type(NO_EVENT), mask(0), arrival_ns(0), server_time(0)
+  {
+    memset(&data, 0, sizeof(data));
+  }
+
   //platform specific constructor that takes a windows/x11/osx event and
   //converts it to a RendererEvent
   RendererEvent(void* event_ptr, eventtype type);
-  RendererEvent(SoftwareMessageData* msg)
+
+  //a software message; fill in data.message.contents afterwards
+  RendererEvent(renderer_message msg_type)
   {
-    hfPrintf("Creating software message event of type %u", msg->msg_type);
-    this->data = new EventDataWrapper();
+    hfPrintf("Creating software message event of type %u", msg_type);
+    memset(&data, 0, sizeof(data));
     this->type = SOFTWARE;
     this->mask = RendererEvent::current_mask;
-    this->data->message_data = msg;
+    this->data.message.msg_type = msg_type;
+    this->arrival_ns = LoopClock::Now();
+    this->server_time = 0;
   };
-  
-  ~RendererEvent() {vms_delete data;}
+
+  //frees heap-held message contents, if any
+  void releaseContents(void)
+  {
+    if(type != SOFTWARE || !data.message.contents.heap)
+      return;
+    switch(data.message.msg_type)
+    {
+	case RENDERER_SCREENCAPTURE:
+		vms_delete (tstring*) data.message.contents.heap;
+		break;
+	case REGISTER_TEXTURE:
+		vms_delete (RegisterTextureInfo*) data.message.contents.heap;
+		break;
+	default:
+		return;
+    }
+    data.message.contents.heap = 0;
+  }
+
   eventtype type; //mouse? keyboard? other?
   char mask; //modifiers, such as ctrl key held down, or caps lock on
-  EventDataWrapper* data; //for mice, which button was held down? For
-                              //keyboards, which key?
+  EventData data; //for mice, which button was held down? For
+                  //keyboards, which key?
+
+  long long arrival_ns;      //LoopClock::Now() when the event was taken off
+                             //the window system's queue, or the message sent
+  unsigned long server_time; //the window system's own timestamp, in ms on
+                             //its clock; 0 for software messages
+
 private:
   void updateMask(char new_mask);
   static char current_mask; //the current key mask, copied to mask in the
@@ -190,21 +212,153 @@ private:
 };
 
 
+//slots in each of RendererEventHandler's rings
+#define INPUT_RING_SIZE 1024
+#define MESSAGE_RING_SIZE 256
+//how long a software message producer waits for room before giving up
+#define MESSAGE_RING_BLOCK_NS 1000000
 
+//counters for the full-ring policy, see RendererEventHandler
+struct EventRingStats
+{
+  unsigned long coalesced_moves;
+  unsigned long dropped_input;
+  unsigned long dropped_messages;
+};
 
-typedef boost::shared_ptr<RendererEvent> RendererEventPtr;
-
+//Input and software messages travel on separate lock-free rings: input from
+//the one thread pumping the window system, messages from any thread. When a
+//ring is full:
+//  - MOUSE_MOVE is coalesced: only the newest move is kept, and it is pushed
+//    ahead of the next input event (or by flushInput())
+//  - other input is dropped and counted, as it is while a coalesced move is
+//    still waiting for room, so nothing newer overtakes that move; the
+//    producer never blocks, since it may be the very thread that should be
+//    draining the ring
+//  - software messages block, yielding, for up to MESSAGE_RING_BLOCK_NS and
+//    are then dropped and counted
+//Messages are popped before input so control traffic isn't stuck behind a
+//flood of mouse events, and each one pushed signals MessageFd(), so a thread
+//blocked in OpenGLManager::WaitForWake() wakes up to handle it.
 class RendererEventHandler
 {
 public:
-  virtual void enqueueEvent(RendererEventPtr event) = 0;
+  RendererEventHandler(void)
+    : input_ring(INPUT_RING_SIZE), message_ring(MESSAGE_RING_SIZE),
+      has_pending_move(false)
+  {
+    coalesced_moves.store(0);
+    dropped_input.store(0);
+    dropped_messages.store(0);
+    message_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  }
+  virtual ~RendererEventHandler(void)
+  {
+    if(message_fd >= 0)
+      close(message_fd);
+  }
+
+  virtual void enqueueEvent(const RendererEvent& event) = 0;
+
+  //input producer only: pushes a coalesced MOUSE_MOVE left over from a full
+  //ring. Call after each batch of window system events
+  void flushInput(void)
+  {
+    if(has_pending_move && input_ring.tryPush(pending_move))
+      has_pending_move = false;
+  }
+
+  //an eventfd that becomes readable when a software message is pushed, or
+  //-1; the consumer reads it to clear it before popping the messages
+  int MessageFd(void) { return message_fd; }
+
+  EventRingStats ringStats(void)
+  {
+    EventRingStats stats;
+    stats.coalesced_moves = coalesced_moves.load(boost::memory_order_relaxed);
+    stats.dropped_input = dropped_input.load(boost::memory_order_relaxed);
+    stats.dropped_messages = dropped_messages.load(boost::memory_order_relaxed);
+    return stats;
+  }
 
 protected:
-  virtual RendererEventPtr popEvent() = 0;
-  //queue of RendererEvent's
-  SlowSynchronizedQueue<RendererEventPtr> event_queue;
-  
+  //copies the next event into *event; false when there are none
+  virtual bool popEvent(RendererEvent* event) = 0;
+
+  //routes event to the right ring, applying the full-ring policy. Returns
+  //false if the event was dropped (its heap contents, if any, are released)
+  bool pushEvent(RendererEvent event)
+  {
+    if(event.type == SOFTWARE)
+      return pushMessage(event);
+
+    flushInput();
+    //a move still parked is older than event, so event can't go ahead of it
+    if(!has_pending_move && input_ring.tryPush(event))
+      return true;
+    if(event.type == MOUSE_MOVE)
+      {
+        if(has_pending_move)
+          coalesced_moves.fetch_add(1, boost::memory_order_relaxed);
+        pending_move = event;
+        has_pending_move = true;
+        return true;
+      }
+    dropped_input.fetch_add(1, boost::memory_order_relaxed);
+    return false;
+  }
+
+  //single consumer
+  bool pullEvent(RendererEvent* event)
+  {
+    return message_ring.tryPop(*event) || input_ring.tryPop(*event);
+  }
+
+  EventRing<RendererEvent, true> input_ring;
+  EventRing<RendererEvent, false> message_ring;
+
 private:
+  bool pushMessage(RendererEvent& event)
+  {
+    if(message_ring.tryPush(event))
+      return signalMessage();
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do
+      {
+        sched_yield();
+        if(message_ring.tryPush(event))
+          return signalMessage();
+        clock_gettime(CLOCK_MONOTONIC, &now);
+      }
+    while((now.tv_sec - start.tv_sec) * 1000000000L +
+          (now.tv_nsec - start.tv_nsec) < MESSAGE_RING_BLOCK_NS);
+
+    dropped_messages.fetch_add(1, boost::memory_order_relaxed);
+    event.releaseContents();
+    return false;
+  }
+
+  //always true: the message is queued whether or not the write succeeds,
+  //and it only fails once the counter is saturated, which still reads ready
+  bool signalMessage(void)
+  {
+    uint64_t one = 1;
+    if(message_fd >= 0)
+      write(message_fd, &one, sizeof(one));
+    return true;
+  }
+
+  //input producer's newest MOUSE_MOVE that didn't fit
+  RendererEvent pending_move;
+  bool has_pending_move;
+
+  boost::atomic<unsigned long> coalesced_moves;
+  boost::atomic<unsigned long> dropped_input;
+  boost::atomic<unsigned long> dropped_messages;
+
+  int message_fd;
 };
 
 typedef boost::shared_ptr<RendererEventHandler> RendererEventHandlerPtr;
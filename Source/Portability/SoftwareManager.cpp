@@ -0,0 +1,564 @@
+/*
+ * SoftwareManager.cpp
+ *
+ * The SoftwareManager stands in for a GL manager on machines with no GPU (or
+ * no GL at all): it owns a plain X window, or none, and a CPU-side
+ * framebuffer the renderer draws into. SwapFrameBuffers() shows that in the
+ * window: from shared memory with XShmPutImage when the X server is on this
+ * machine, so the server copies the frame while the next one is drawn, or
+ * else by sending it over the connection with XPutImage.
+ */
+
+
+
+#include "SoftwareManager.hpp"
+#include "LoopClock.hpp"
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/socket.h>
+#include <Portability/PublicInterfaces/RendererEvents.hpp>
+
+//most X events handled per HandleWindowEvents() call, as in X11GLManager
+#define SOFTWARE_EVENT_DRAIN_MAX 256
+
+
+using namespace std;
+
+
+//XShmAttach fails asynchronously, through the error handler
+static bool shmErrorOccurred = false;
+static int shmErrorHandler(Display* dpy, XErrorEvent* ev)
+{
+  shmErrorOccurred = true;
+  return 0;
+}
+
+static Bool isShmCompletion(Display* dpy, XEvent* xe, XPointer completion_type)
+{
+  return xe->type == *(int*) completion_type;
+}
+
+
+SoftwareManager::SoftwareManager(RendererEventHandlerPtr sysCtrl_handler,
+                                 RendererEventHandlerPtr gl_renderer_handler,
+                                 int width, int height)
+{
+  this->display = 0;
+  this->win = 0;
+  this->gc = 0;
+  this->visual = 0;
+  this->depth = 0;
+  this->image = 0;
+  this->use_shm = false;
+  this->shm_completion = 0;
+  memset(this->shm, 0, sizeof(this->shm));
+  this->back = 0;
+  this->front = -1;
+  this->presents = this->shm_waits = 0;
+  this->width = width;
+  this->height = height;
+  this->sizeChanged = true;
+  this->isFullscreen = false;
+  this->parent = true;
+  this->parent_handler = gl_renderer_handler;
+  this->system_handler = sysCtrl_handler;
+  this->event_handler = gl_renderer_handler;
+}
+
+SoftwareManager::~SoftwareManager(void)
+{
+  if(this->image)
+    {
+      //the pixels belong to the vector, not to Xlib
+      this->image->data = 0;
+      XDestroyImage(this->image);
+    }
+  if(this->use_shm)
+    {
+      cout << this->shm_waits << " of " << this->presents
+           << " frames waited for the X server to read the last one" << endl;
+      DestroyShmBuffers();
+    }
+  if(this->display)
+    {
+      if(this->gc)
+        XFreeGC(this->display, this->gc);
+      if(this->win)
+        XDestroyWindow(this->display, this->win);
+      XCloseDisplay(this->display);
+    }
+}
+
+
+bool SoftwareManager::initializeRenderingEnvironment(bool debug_context)
+{
+  this->startup_phases.clear();
+  long long phase = LoopClock::Now();
+  this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  WatchMessages(this->event_handler);
+
+  const char* x_display = getenv("DISPLAY");
+  if(x_display && *x_display && !CreateWindow())
+    return false;
+  if(!this->display)
+    cout << "No display; rendering in memory" << endl;
+  else
+    EndPhase("create window", &phase);
+
+  CreateImage();
+  EndPhase("create image", &phase);
+  return true;
+}
+
+bool SoftwareManager::initGLDebug(void)
+{
+  return false;
+}
+
+
+bool SoftwareManager::CreateWindow(void)
+{
+  this->display = XOpenDisplay(0);
+  if(!this->display)
+    {
+      cout << "Failed to open X display" << endl;
+      return false;
+    }
+
+  int screen = DefaultScreen(this->display);
+  this->visual = DefaultVisual(this->display, screen);
+  this->depth = DefaultDepth(this->display, screen);
+  //the kernels write 0xAARRGGBB; anything else would need a conversion pass
+  if((this->depth != 24 && this->depth != 32) ||
+     this->visual->red_mask != 0xff0000 || this->visual->green_mask != 0xff00 ||
+     this->visual->blue_mask != 0xff)
+    {
+      cout << "Default visual isn't 24 bit 0xRRGGBB TrueColor" << endl;
+      return false;
+    }
+
+  XSetWindowAttributes swa;
+  swa.background_pixel = BlackPixel(this->display, screen);
+  swa.border_pixel = 0;
+  swa.event_mask = KeyPressMask | KeyReleaseMask | ButtonPressMask |
+    ButtonReleaseMask | StructureNotifyMask | PointerMotionMask |
+    ExposureMask;
+  this->win = XCreateWindow(this->display, RootWindow(this->display, screen),
+                            0, 0, this->width, this->height, 0, this->depth,
+                            InputOutput, this->visual,
+                            CWBackPixel | CWBorderPixel | CWEventMask, &swa);
+  if(!this->win)
+    {
+      cout << "Failed to create window." << endl;
+      return false;
+    }
+  XStoreName(this->display, this->win, "Software Window");
+  this->gc = XCreateGC(this->display, this->win, 0, 0);
+  XMapWindow(this->display, this->win);
+  this->use_shm = QueryShm();
+
+  this->window_fd = XConnectionNumber(this->display);
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = this->window_fd;
+  epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->window_fd, &event);
+  return true;
+}
+
+bool SoftwareManager::QueryShm(void)
+{
+  //a segment id means nothing to a server on another machine, and one
+  //reached through ssh forwarding could attach a different segment with the
+  //same id over there, so only unix socket connections qualify
+  struct sockaddr_storage address;
+  socklen_t length = sizeof(address);
+  if(getsockname(ConnectionNumber(this->display), (struct sockaddr*) &address,
+                 &length) || address.ss_family != AF_UNIX)
+    {
+      cout << "X server isn't local; presenting with XPutImage" << endl;
+      return false;
+    }
+  int major, minor;
+  Bool pixmaps;
+  if(!XShmQueryVersion(this->display, &major, &minor, &pixmaps))
+    {
+      cout << "No MIT-SHM; presenting with XPutImage" << endl;
+      return false;
+    }
+  this->shm_completion = XShmGetEventBase(this->display) + ShmCompletion;
+  cout << "Presenting through MIT-SHM " << major << "." << minor << endl;
+  return true;
+}
+
+bool SoftwareManager::CreateShmBuffer(ShmBuffer* buffer)
+{
+  buffer->pending = 0;
+  buffer->image = XShmCreateImage(this->display, this->visual, this->depth,
+                                  ZPixmap, 0, &buffer->info, this->width,
+                                  this->height);
+  if(!buffer->image)
+    return false;
+  if(buffer->image->bits_per_pixel != 32)
+    {
+      XDestroyImage(buffer->image);
+      buffer->image = 0;
+      return false;
+    }
+
+  buffer->info.shmid = shmget(IPC_PRIVATE, (size_t) buffer->image->bytes_per_line *
+                              buffer->image->height, IPC_CREAT | 0600);
+  void* memory = buffer->info.shmid < 0 ? (void*) -1 :
+    shmat(buffer->info.shmid, 0, 0);
+  if(memory == (void*) -1)
+    {
+      if(buffer->info.shmid >= 0)
+        shmctl(buffer->info.shmid, IPC_RMID, 0);
+      XDestroyImage(buffer->image);
+      buffer->image = 0;
+      return false;
+    }
+  buffer->info.shmaddr = buffer->image->data = (char*) memory;
+  buffer->info.readOnly = True;
+
+  shmErrorOccurred = false;
+  int (*oldHandler)(Display*, XErrorEvent*) = XSetErrorHandler(&shmErrorHandler);
+  XShmAttach(this->display, &buffer->info);
+  XSync(this->display, False);
+  XSetErrorHandler(oldHandler);
+  //marked for removal now, so it goes with the last detach even if we crash
+  shmctl(buffer->info.shmid, IPC_RMID, 0);
+  if(shmErrorOccurred)
+    {
+      shmdt(buffer->info.shmaddr);
+      buffer->image->data = 0;
+      XDestroyImage(buffer->image);
+      buffer->image = 0;
+      return false;
+    }
+
+  unsigned int* pixels = (unsigned int*) buffer->image->data;
+  size_t count = (size_t) buffer->image->bytes_per_line / 4 * this->height;
+  for(size_t idx = 0; idx < count; idx++)
+    pixels[idx] = 0xff000000;
+  return true;
+}
+
+void SoftwareManager::DestroyShmBuffers(void)
+{
+  for(int idx = 0; idx < SOFTWARE_SHM_BUFFERS; idx++)
+    {
+      ShmBuffer* buffer = &this->shm[idx];
+      if(!buffer->image)
+        continue;
+      WaitForShmBuffer(buffer);
+      XShmDetach(this->display, &buffer->info);
+      shmdt(buffer->info.shmaddr);
+      //the data was never Xlib's to free
+      buffer->image->data = 0;
+      XDestroyImage(buffer->image);
+      buffer->image = 0;
+    }
+  this->back = 0;
+  this->front = -1;
+}
+
+void SoftwareManager::WaitForShmBuffer(ShmBuffer* buffer)
+{
+  if(buffer->pending)
+    this->shm_waits++;
+  //only completions are taken off the queue; the rest stay in order for
+  //HandleWindowEvents()
+  while(buffer->pending)
+    {
+      XEvent xe;
+      XIfEvent(this->display, &xe, &isShmCompletion,
+               (XPointer) &this->shm_completion);
+      HandleXEvent(xe);
+    }
+}
+
+void SoftwareManager::PutShmBuffer(int idx)
+{
+  XShmPutImage(this->display, this->win, this->gc, this->shm[idx].image,
+               0, 0, 0, 0, this->width, this->height, True);
+  this->shm[idx].pending++;
+  XFlush(this->display);
+}
+
+
+void SoftwareManager::CreateImage(void)
+{
+  if(this->image)
+    {
+      this->image->data = 0;
+      XDestroyImage(this->image);
+      this->image = 0;
+    }
+  if(this->use_shm)
+    {
+      DestroyShmBuffers();
+      for(int idx = 0; idx < SOFTWARE_SHM_BUFFERS && this->use_shm; idx++)
+        if(!CreateShmBuffer(&this->shm[idx]))
+          {
+            cout << "X server refused shared memory; presenting with "
+                 << "XPutImage" << endl;
+            DestroyShmBuffers();
+            this->use_shm = false;
+          }
+      if(this->use_shm)
+        {
+          this->pixels.clear();
+          this->sizeChanged = true;
+          return;
+        }
+    }
+  this->pixels.assign((size_t) this->width * this->height, 0xff000000);
+  if(this->display)
+    this->image = XCreateImage(this->display, this->visual, this->depth,
+                               ZPixmap, 0, (char*) &this->pixels[0],
+                               this->width, this->height, 32,
+                               this->width * 4);
+  this->sizeChanged = true;
+}
+
+
+bool SoftwareManager::GetSoftwareFramebuffer(SoftwareFramebuffer* fb)
+{
+  fb->width = this->width;
+  fb->height = this->height;
+  if(this->use_shm)
+    {
+      ShmBuffer* buffer = &this->shm[this->back];
+      WaitForShmBuffer(buffer);
+      fb->pixels = (unsigned int*) buffer->image->data;
+      fb->stride = buffer->image->bytes_per_line / 4;
+      return true;
+    }
+  fb->pixels = &this->pixels[0];
+  fb->stride = this->width;
+  return true;
+}
+
+
+bool SoftwareManager::WindowSizeChanged(void)
+{
+  return this->sizeChanged;
+}
+
+int SoftwareManager::GetWindowWidth(void)
+{
+  this->sizeChanged = false;
+  return this->width;
+}
+
+int SoftwareManager::GetWindowHeight(void)
+{
+  this->sizeChanged = false;
+  return this->height;
+}
+
+void SoftwareManager::RequestWindowSize(int w, int h)
+{
+  if(this->display)
+    {
+      //the ConfigureNotify that follows resizes the framebuffer
+      XResizeWindow(this->display, this->win, w, h);
+      XFlush(this->display);
+      return;
+    }
+  if(w == this->width && h == this->height)
+    return;
+  this->width = w;
+  this->height = h;
+  CreateImage();
+}
+
+
+void SoftwareManager::GetGLCLShareParameters(void** handle_pair)
+{
+  handle_pair[0] = this->display;
+  handle_pair[1] = 0;
+}
+
+SharedGLContext* SoftwareManager::CreateSharedContext(void)
+{
+  return 0;
+}
+
+void SoftwareManager::SetContextCurrent(void)
+{
+}
+
+void SoftwareManager::UnsetContextCurrent(void)
+{
+}
+
+
+void SoftwareManager::SwapFrameBuffers(void)
+{
+  if(this->use_shm)
+    {
+      //the server copies it to the window whenever it gets to it; the
+      //ShmCompletion it sends back frees the buffer for drawing again
+      PutShmBuffer(this->back);
+      this->presents++;
+      this->front = this->back;
+      this->back = (this->back + 1) % SOFTWARE_SHM_BUFFERS;
+      return;
+    }
+  if(!this->image)
+    return;
+  XPutImage(this->display, this->win, this->gc, this->image, 0, 0, 0, 0,
+            this->width, this->height);
+  XFlush(this->display);
+}
+
+
+void SoftwareManager::HandleXEvent(XEvent& xe)
+{
+  if(this->use_shm && xe.type == this->shm_completion)
+    {
+      XShmCompletionEvent& done = (XShmCompletionEvent&) xe;
+      for(int idx = 0; idx < SOFTWARE_SHM_BUFFERS; idx++)
+        if(this->shm[idx].image && this->shm[idx].info.shmseg == done.shmseg &&
+           this->shm[idx].pending)
+          this->shm[idx].pending--;
+      return;
+    }
+
+  bool enqueue = true;
+  RendererEvent event;
+  switch(xe.type)
+    {
+    case KeyPress:
+      event = RendererEvent((void*) &xe, KEY_DOWN);
+      break;
+    case KeyRelease:
+      event = RendererEvent((void*) &xe, KEY_UP);
+      break;
+    case ButtonPress:
+      if(xe.xbutton.button == Button4 || xe.xbutton.button == Button5)
+        event = RendererEvent((void*) &xe, MOUSE_SCROLL);
+      else
+        event = RendererEvent((void*) &xe, MOUSE_DOWN);
+      break;
+    case ButtonRelease:
+      event = RendererEvent((void*) &xe, MOUSE_UP);
+      break;
+    case MotionNotify:
+      event = RendererEvent((void*) &xe, MOUSE_MOVE);
+      break;
+    case ConfigureNotify:
+      enqueue = false;
+      if(xe.xconfigure.width != this->width ||
+         xe.xconfigure.height != this->height)
+        {
+          this->width = xe.xconfigure.width;
+          this->height = xe.xconfigure.height;
+          CreateImage();
+        }
+      break;
+    case Expose:
+      //the last frame is still in pixels, or in the front shm buffer
+      enqueue = false;
+      if(xe.xexpose.count)
+        break;
+      if(!this->use_shm)
+        SwapFrameBuffers();
+      else if(this->front >= 0)
+        PutShmBuffer(this->front);
+      break;
+    default:
+      enqueue = false;
+      break;
+    }
+  if(!enqueue)
+    return;
+  this->HandleGlobalEvents(&event);
+  this->event_handler->enqueueEvent(event);
+}
+
+bool SoftwareManager::HandleWindowEvents(void)
+{
+  DispatchWatchedFds(0);
+  this->event_stats.raw = this->event_stats.coalesced = 0;
+  this->event_stats.truncated = false;
+  if(!this->display)
+    return false;
+
+  //runs of pointer motion fold into their last member, as in X11GLManager
+  XEvent motion;
+  bool have_motion = false;
+  XEventsQueued(this->display, QueuedAfterReading);
+  //recounted every time round rather than counted down: handling an event
+  //can take others off the queue (a resize waits for shm completions with
+  //XIfEvent()), and XNextEvent() on an empty queue would block
+  int queued;
+  while((queued = XEventsQueued(this->display, QueuedAlready)) > 0 &&
+        this->event_stats.raw < SOFTWARE_EVENT_DRAIN_MAX)
+    {
+      XEvent xe;
+      XNextEvent(this->display, &xe);
+      this->event_stats.raw++;
+
+      if(xe.type == MotionNotify)
+        {
+          if(have_motion)
+            this->event_stats.coalesced++;
+          motion = xe;
+          have_motion = true;
+          continue;
+        }
+      if(have_motion)
+        {
+          HandleXEvent(motion);
+          have_motion = false;
+        }
+      HandleXEvent(xe);
+    }
+  this->event_stats.truncated = queued > 0;
+  if(have_motion)
+    HandleXEvent(motion);
+
+  bool new_events = this->event_stats.raw > 0;
+  if(new_events)
+    this->event_handler->flushInput();
+  return new_events;
+}
+
+bool SoftwareManager::WindowEventsPending(void)
+{
+  if(!this->display)
+    return false;
+  XFlush(this->display);
+  return XEventsQueued(this->display, QueuedAlready) > 0;
+}
+
+
+void SoftwareManager::toggleFullScreen(void)
+{
+  if(!this->display)
+    return;
+  XEvent xev;
+  memset(&xev, 0, sizeof(xev));
+  xev.type = ClientMessage;
+  xev.xclient.window = this->win;
+  xev.xclient.message_type = XInternAtom(this->display, "_NET_WM_STATE", False);
+  xev.xclient.format = 32;
+  xev.xclient.data.l[0] = 2;
+  xev.xclient.data.l[1] = XInternAtom(this->display, "_NET_WM_STATE_FULLSCREEN",
+                                      False);
+  XSendEvent(this->display, DefaultRootWindow(this->display), False,
+             SubstructureNotifyMask | SubstructureRedirectMask, &xev);
+  this->isFullscreen = !this->isFullscreen;
+}
+
+void SoftwareManager::toggleEventRecipient(void)
+{
+  parent = !parent;
+  this->event_handler = parent ? this->parent_handler:this->system_handler;
+}
@@ -0,0 +1,127 @@
+/*
+ * SoftwareManager.hpp
+ *
+ * OpenGLManager backend without any GL: the renderer draws on the CPU into a
+ * SoftwareFramebuffer, which is shown in a plain X window through an XImage,
+ * or just kept in memory when there's no display to open. On a local X
+ * server the framebuffers are MIT-SHM segments the server reads directly.
+ */
+
+#ifndef SOFTWAREMANAGER_HPP_
+#define SOFTWAREMANAGER_HPP_
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <boost/shared_ptr.hpp>
+#include <Portability/Instrumentation/Instrumentation.h>
+#include <Portability/PublicInterfaces/OpenGLManager.hpp>
+#include <vector>
+
+//shared memory images presented in turn; the renderer draws into one while
+//the server reads the other
+#define SOFTWARE_SHM_BUFFERS 2
+
+
+class SoftwareManager : public OpenGLManager
+{
+public:
+  //width x height is the drawable size when there's no window to size it
+  SoftwareManager(RendererEventHandlerPtr sysCtrl_handler,
+                  RendererEventHandlerPtr gl_renderer_handler,
+                  int width, int height);
+  ~SoftwareManager(void);
+
+  //opens a window if $DISPLAY is set, else runs headless
+  bool initializeRenderingEnvironment(bool debug_context);
+  //there's no GL to debug
+  bool initGLDebug(void);
+
+  int GetWindowHeight(void);
+  int GetWindowWidth(void);
+  void RequestWindowSize(int w, int h);
+
+  //the buffer to draw the next frame into, valid until SwapFrameBuffers().
+  //With MIT-SHM the buffers alternate, so ask again every frame; this waits
+  //if the server is still reading the one that's due
+  bool GetSoftwareFramebuffer(SoftwareFramebuffer* fb);
+
+  //there's no context to share
+  void GetGLCLShareParameters(void** handle_pair);
+  SharedGLContext* CreateSharedContext(void);
+  void SetContextCurrent(void);
+  void UnsetContextCurrent(void);
+
+  //shows the framebuffer in the window. With MIT-SHM this only queues the
+  //server's read of it; without, the pixels are copied over the socket
+  void SwapFrameBuffers(void);
+
+  bool HandleWindowEvents(void);
+
+  bool WindowSizeChanged(void);
+
+  void toggleFullScreen(void);
+
+  void toggleEventRecipient(void);
+
+protected:
+  bool WindowEventsPending(void);
+
+private:
+  //null when headless
+  Display* display;
+  Window win;
+  GC gc;
+  Visual* visual;
+  int depth;
+
+  //wraps pixels for XPutImage; recreated with it on resize
+  XImage* image;
+  std::vector<unsigned int> pixels;
+
+  //the MIT-SHM path, used instead of image and pixels when the server can
+  //attach our segments
+  struct ShmBuffer
+  {
+    XShmSegmentInfo info;
+    XImage* image;
+    int pending;      //XShmPutImages not yet completed
+  };
+  bool use_shm;
+  int shm_completion;   //the ShmCompletion event type
+  ShmBuffer shm[SOFTWARE_SHM_BUFFERS];
+  int back;             //the buffer to draw into next
+  int front;            //the one last presented, or -1
+  unsigned long long presents;
+  unsigned long long shm_waits;   //buffers that weren't free when asked for
+
+  int width, height;
+  bool sizeChanged;
+
+  bool parent;
+  RendererEventHandlerPtr parent_handler;
+  RendererEventHandlerPtr system_handler;
+  RendererEventHandlerPtr event_handler;
+
+  bool isFullscreen;
+
+  //opens the display and creates the window; false if the display can't
+  //present 32 bit 0xRRGGBB pixels
+  bool CreateWindow(void);
+
+  //(re)allocates pixels, and the XImage over them, at width x height
+  void CreateImage(void);
+
+  //true if the server is on this machine and has MIT-SHM
+  bool QueryShm(void);
+  //false, leaving nothing allocated, if the server refused the segment
+  bool CreateShmBuffer(ShmBuffer* buffer);
+  void DestroyShmBuffers(void);
+  //processes ShmCompletions until the server is done with buffer
+  void WaitForShmBuffer(ShmBuffer* buffer);
+  void PutShmBuffer(int idx);
+
+  void HandleXEvent(XEvent& xe);
+};
+
+#endif /* SOFTWAREMANAGER_HPP_ */
@@ -0,0 +1,77 @@
+/*
+ * StateMailbox.hpp
+ *
+ *  Lock-free triple buffer for handing snapshots of state from one thread to
+ *  another. The writer fills its own slot and swaps it with the middle one;
+ *  the reader swaps its slot with the middle one whenever that holds
+ *  something newer. Neither side ever waits on the other: a writer
+ *  publishing faster than the reader reads simply replaces snapshots the
+ *  reader never saw, and a slow reader keeps the one it has until it asks
+ *  again. Suits state where only the latest value matters; anything that
+ *  must not be lost in between (a click, say) has to be folded into the
+ *  state rather than sent as a delta.
+ */
+
+#ifndef STATEMAILBOX_HPP_
+#define STATEMAILBOX_HPP_
+
+#include <boost/atomic.hpp>
+#include <Portability/PublicInterfaces/EventRing.hpp>   // EVENT_RING_CACHE_LINE
+
+
+template <class T>
+class StateMailbox
+{
+public:
+  //every slot starts out holding initial, so the reader has something to
+  //read before the first publish()
+  StateMailbox(const T& initial) : back(0), front(2)
+  {
+    for(int idx = 0; idx < 3; idx++)
+      slots[idx].value = initial;
+    middle.store(1, boost::memory_order_relaxed);
+  }
+
+  //writer only: copies value into the writer's slot and makes it the newest
+  //snapshot
+  void publish(const T& value)
+  {
+    slots[back].value = value;
+    back = middle.exchange(back | FRESH, boost::memory_order_acq_rel) & INDEX;
+  }
+
+  //reader only: moves to the newest snapshot if one was published since the
+  //last call, and returns true if so. Either way *value is left holding the
+  //newest snapshot the reader has
+  bool latest(T* value)
+  {
+    bool fresh = false;
+    if(middle.load(boost::memory_order_relaxed) & FRESH)
+      {
+        front = middle.exchange(front, boost::memory_order_acq_rel) & INDEX;
+        fresh = true;
+      }
+    *value = slots[front].value;
+    return fresh;
+  }
+
+private:
+  //the middle slot's index, with FRESH set while the reader hasn't taken it
+  static const unsigned int INDEX = 0x3;
+  static const unsigned int FRESH = 0x4;
+
+  struct Slot
+  {
+    T value;
+    char padding[EVENT_RING_CACHE_LINE];
+  };
+  Slot slots[3];
+
+  unsigned int back;                    //writer's
+  char writer_padding[EVENT_RING_CACHE_LINE];
+  boost::atomic<unsigned int> middle;
+  char middle_padding[EVENT_RING_CACHE_LINE];
+  unsigned int front;                   //reader's
+};
+
+#endif /* STATEMAILBOX_HPP_ */
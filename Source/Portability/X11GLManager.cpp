@@ -15,17 +15,29 @@
 
 #include "X11GLManager.hpp"
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/epoll.h>
 #include "LoopClock.hpp"
+#include "CacheFiles.hpp"
 #include <X11/X.h>
 #include <X11/extensions/Xrandr.h>
 #include <X11/extensions/Xinerama.h>
 #include <Portability/PublicInterfaces/VmsKeys.h>
 #include <Portability/PublicInterfaces/RendererEvents.hpp>
 
+//most X events handled per HandleWindowEvents() call, so an input flood can't
+//starve rendering; the rest are picked up on following frames
+#define X11_EVENT_DRAIN_MAX 256
+
+//_MOTIF_WM_HINTS: flags, functions, decorations, input mode, status. Flag 2
+//says decorations is set, and 0 there asks for none
+#define MWM_HINTS_DECORATIONS 2
+#define MWM_HINTS_ELEMENTS 5
+
 
 using namespace std;
 
@@ -91,15 +103,18 @@ static int ctxErrorHandler( Display *dpy, XErrorEvent *ev )
 }
 
 
-OpenGLManager* OpenGLManager::GetGLManager(RendererEventHandlerPtr sysCtrl_handler, RendererEventHandlerPtr parent_handler)
-{
-  return new X11GLManager(sysCtrl_handler,parent_handler);
-}
-
-
 X11GLManager::X11GLManager(RendererEventHandlerPtr sysCtrl_handler, RendererEventHandlerPtr gl_renderer_handler)
 {
   this->isFullscreen = false;
+  this->swapIntervalEXT = 0;
+  this->swapIntervalMESA = 0;
+  this->swapControlTear = false;
+  this->getSyncValuesOML = 0;
+  this->swapsIssued = this->swapsCompleted = 0;
+  this->refreshNs = this->lastPresentNs = this->ustOffsetNs = 0;
+  this->presents = 0;
+  this->primary = 0;
+  this->placeX = this->placeY = this->placeWidth = this->placeHeight = 0;
   this->parent = true;
   this->parent_handler = gl_renderer_handler;
   this->event_handler = this->parent ?  gl_renderer_handler:sysCtrl_handler;
@@ -108,9 +123,85 @@ X11GLManager::X11GLManager(RendererEventHandlerPtr sysCtrl_handler, RendererEven
   tellRendererControl(this->parent);
 }
 
+X11GLManager::X11GLManager(X11GLManager* primary, const DisplayOutput& output)
+{
+  this->isFullscreen = false;
+  this->swapIntervalEXT = 0;
+  this->swapIntervalMESA = 0;
+  this->swapControlTear = false;
+  this->getSyncValuesOML = 0;
+  this->swapsIssued = this->swapsCompleted = 0;
+  this->refreshNs = this->lastPresentNs = this->ustOffsetNs = 0;
+  this->presents = 0;
+  this->parent = primary->parent;
+  this->parent_handler = primary->parent_handler;
+  this->event_handler = primary->event_handler;
+  this->system_handler = primary->system_handler;
+  lastMouseButton = vms_new ButtonPressInfo();
+
+  this->primary = primary;
+  this->display = primary->display;
+  this->glx_major = primary->glx_major;
+  this->glx_minor = primary->glx_minor;
+  this->bestFbc = primary->bestFbc;
+  this->createContextAttribs = primary->createContextAttribs;
+  memcpy( this->ctxAttribs, primary->ctxAttribs, sizeof( this->ctxAttribs ) );
+  this->output_layout = OUTPUTS_EACH;
+  this->placeX = output.x;
+  this->placeY = output.y;
+  this->placeWidth = output.width;
+  this->placeHeight = output.height;
+  this->windowWidth = output.width;
+  this->windowHeight = output.height;
+  this->windowSizeChanged = true;
+  this->ctx = 0;
+
+  this->vi = glXGetVisualFromFBConfig( this->display, this->bestFbc );
+  CreateWindow();
+  // A failure is left to CreateOutputManager() rather than exiting
+  ctxErrorOccurred = false;
+  int (*oldHandler)(Display*, XErrorEvent*) =
+      XSetErrorHandler(&ctxErrorHandler);
+  if(this->createContextAttribs)
+    this->ctx = this->createContextAttribs( this->display, this->bestFbc,
+                                            primary->ctx, True,
+                                            this->ctxAttribs );
+  else
+    this->ctx = glXCreateNewContext( this->display, this->bestFbc,
+                                     GLX_RGBA_TYPE, primary->ctx, True );
+  XSync( this->display, False );
+  XSetErrorHandler( oldHandler );
+  if ( ctxErrorOccurred && this->ctx )
+    {
+      glXDestroyContext( this->display, this->ctx );
+      this->ctx = 0;
+    }
+  InitSwapControl();
+
+  //the render thread only waits on the frame timer; anything watched here
+  //(a shader reloader's inotify fd) is dispatched from the primary's wait
+  this->epoll_fd = epoll_create(1);
+  primary->WatchFd(this->epoll_fd, this);
+  primary->output_managers.push_back(this);
+}
+
 X11GLManager::~X11GLManager(void)
 {
-  if(this->display)
+  if(this->primary)
+    {
+      //the connection is the primary's, and whatever it has current stays
+      this->primary->UnwatchFd(this->epoll_fd);
+      vector<X11GLManager*>& managers = this->primary->output_managers;
+      for(size_t idx = 0; idx < managers.size(); idx++)
+        if(managers[idx] == this)
+          managers.erase(managers.begin() + idx--);
+      if(this->ctx)
+        glXDestroyContext( this->display, this->ctx );
+      XDestroyWindow( this->display, this->win );
+      XFreeColormap( this->display, this->cmap );
+      XFlush( this->display );
+    }
+  else if(this->display)
     {
       glXMakeCurrent( this->display, 0, 0 );
       if(this->ctx)
@@ -139,17 +230,34 @@ bool X11GLManager::initGLDebug(void)
 bool X11GLManager::initializeRenderingEnvironment(bool debug_context)
 {
   this->windowSizeChanged = true;
+  this->startup_phases.clear();
+  long long phase = LoopClock::Now();
   GetDisplay();
+  EnumerateOutputs(this->display, &this->outputs);
+  EndPhase("open display", &phase);
   GetGLVersion();
+  EndPhase("glx init", &phase);
   ConfigVisual();
+  EndPhase("fbconfig", &phase);
+  PlaceWindow();
   CreateWindow();
+  EndPhase("create window", &phase);
   GetContext(debug_context);
-  cout << "Setting current context" << endl;
+  EndPhase("create context", &phase);
   glXMakeCurrent(this->display, this->win, this->ctx);
+  EndPhase("make current", &phase);
+  InitSwapControl();
 
-  //Initiate glew
+  struct epoll_event event;
+  this->epoll_fd = XEpollInit(&event);
+  WatchMessages(this->event_handler);
+  this->window_fd = XConnectionNumber(this->display);
+
+  //Initiate glew. glewExperimental makes it look up every entry point, not
+  //just the extensions a core context lists, which is most of its time
   glewExperimental = GL_TRUE;
   GLenum error = glewInit(); 
+  EndPhase("glew init", &phase);
   if (error != GLEW_OK)
     return false;
 
@@ -158,6 +266,9 @@ bool X11GLManager::initializeRenderingEnvironment(bool debug_context)
 
 void X11GLManager::GetDisplay(void)
 {
+  // Shared contexts are made current on worker threads through this same
+  // connection, so Xlib has to do its own locking
+  XInitThreads();
   this->display = XOpenDisplay(0);
   if ( !this->display )
   {
@@ -167,8 +278,129 @@ void X11GLManager::GetDisplay(void)
 }
 
 
+//RandR's rate for a mode; a doublescan mode draws each line twice, an
+//interlaced one half the lines each field
+static double modeRefresh(const XRRModeInfo& mode)
+{
+  double lines = mode.vTotal;
+  if(mode.modeFlags & RR_DoubleScan)
+    lines *= 2;
+  if(mode.modeFlags & RR_Interlace)
+    lines /= 2;
+  if(!mode.hTotal || lines <= 0)
+    return 0.0;
+  return mode.dotClock / (mode.hTotal * lines);
+}
+
+bool X11GLManager::EnumerateOutputs(Display* display,
+                                    vector<DisplayOutput>* outputs)
+{
+  Display* own = display ? 0 : XOpenDisplay(0);
+  if(!display)
+    display = own;
+  if(!display)
+    return false;
+  outputs->clear();
+
+  //RandR 1.2 is the first with outputs and CRTCs. 1.3's Current variant
+  //answers from what the server already knows, where the other probes the
+  //connectors, which can take a good part of a second
+  int event_base, error_base, major = 0, minor = 0;
+  bool randr = XRRQueryExtension(display, &event_base, &error_base) &&
+    XRRQueryVersion(display, &major, &minor) &&
+    (major > 1 || (major == 1 && minor >= 2));
+  for(int screen = 0; randr && screen < ScreenCount(display); screen++)
+    {
+      Window root = RootWindow(display, screen);
+      XRRScreenResources* resources = (major > 1 || minor >= 3) ?
+        XRRGetScreenResourcesCurrent(display, root) :
+        XRRGetScreenResources(display, root);
+      if(!resources)
+        continue;
+      for(int idx = 0; idx < resources->noutput; idx++)
+        {
+          XRROutputInfo* info = XRRGetOutputInfo(display, resources,
+                                                 resources->outputs[idx]);
+          if(!info)
+            continue;
+          //connected but switched off has no CRTC, so nothing to draw on
+          XRRCrtcInfo* crtc = info->connection == RR_Connected && info->crtc ?
+            XRRGetCrtcInfo(display, resources, info->crtc) : 0;
+          if(crtc && crtc->width && crtc->height)
+            {
+              DisplayOutput output;
+              output.name = string(info->name, info->nameLen);
+              output.x = crtc->x;
+              output.y = crtc->y;
+              output.width = crtc->width;
+              output.height = crtc->height;
+              output.refresh_hz = 0.0;
+              for(int mode = 0; mode < resources->nmode; mode++)
+                if(resources->modes[mode].id == crtc->mode)
+                  output.refresh_hz = modeRefresh(resources->modes[mode]);
+              output.screen = screen;
+              outputs->push_back(output);
+            }
+          if(crtc)
+            XRRFreeCrtcInfo(crtc);
+          XRRFreeOutputInfo(info);
+        }
+      XRRFreeScreenResources(resources);
+    }
+
+  //servers without RandR 1.2 outputs (Xvfb +xinerama, Xnest, VNC) may still
+  //say where their monitors are through Xinerama, or as separate X screens
+  if(outputs->empty() &&
+     XineramaQueryExtension(display, &event_base, &error_base) &&
+     XineramaIsActive(display))
+    {
+      int count = 0;
+      XineramaScreenInfo* heads = XineramaQueryScreens(display, &count);
+      for(int idx = 0; heads && idx < count; idx++)
+        {
+          DisplayOutput output;
+          stringstream name;
+          name << "xinerama-" << heads[idx].screen_number;
+          output.name = name.str();
+          output.x = heads[idx].x_org;
+          output.y = heads[idx].y_org;
+          output.width = heads[idx].width;
+          output.height = heads[idx].height;
+          output.refresh_hz = 0.0;
+          output.screen = DefaultScreen(display);
+          outputs->push_back(output);
+        }
+      if(heads)
+        XFree(heads);
+    }
+  int screens = outputs->empty() ? ScreenCount(display) : 0;
+  for(int screen = 0; screen < screens; screen++)
+    {
+      DisplayOutput output;
+      stringstream name;
+      name << "screen-" << screen;
+      output.name = name.str();
+      output.x = output.y = 0;
+      output.width = DisplayWidth(display, screen);
+      output.height = DisplayHeight(display, screen);
+      output.refresh_hz = 0.0;
+      output.screen = screen;
+      outputs->push_back(output);
+    }
+
+  if(own)
+    XCloseDisplay(own);
+  return true;
+}
+
+
 void X11GLManager::toggleFullScreen()
 {
+  //a window over several outputs is as big as it's going to get; full
+  //screen would shrink it onto one
+  if(this->output_layout == OUTPUTS_SPAN)
+    return;
+
   XEvent xev;
 
   xev.type = ClientMessage;
@@ -198,6 +430,13 @@ int X11GLManager::GetWindowHeight(void)
   return this->windowHeight;
 }
 
+void X11GLManager::RequestWindowSize(int w, int h)
+{
+  //the ConfigureNotify that follows updates windowWidth/windowHeight
+  XResizeWindow(this->display, this->win, w, h);
+  XFlush(this->display);
+}
+
 //used to set/unset the renderer's context as the current GL context
 void X11GLManager::SetContextCurrent(void)
 {
@@ -213,6 +452,100 @@ void X11GLManager::UnsetContextCurrent(void)
 void X11GLManager::SwapFrameBuffers(void)
 {
   glXSwapBuffers ( this->display, this->win );
+  this->swapsIssued++;
+}
+
+
+void X11GLManager::InitSwapControl(void)
+{
+  const char *glxExts = glXQueryExtensionsString( this->display,
+                                                  DefaultScreen( this->display ) );
+  if ( isExtensionSupported( glxExts, "GLX_EXT_swap_control" ) )
+    this->swapIntervalEXT = (glXSwapIntervalEXTProc)
+      glXGetProcAddressARB( (const GLubyte *) "glXSwapIntervalEXT" );
+  if ( isExtensionSupported( glxExts, "GLX_MESA_swap_control" ) )
+    this->swapIntervalMESA = (glXSwapIntervalMESAProc)
+      glXGetProcAddressARB( (const GLubyte *) "glXSwapIntervalMESA" );
+  this->swapControlTear = this->swapIntervalEXT &&
+    isExtensionSupported( glxExts, "GLX_EXT_swap_control_tear" );
+
+  if ( !isExtensionSupported( glxExts, "GLX_OML_sync_control" ) )
+    return;
+  glXGetMscRateOMLProc getMscRate = (glXGetMscRateOMLProc)
+    glXGetProcAddressARB( (const GLubyte *) "glXGetMscRateOML" );
+  this->getSyncValuesOML = (glXGetSyncValuesOMLProc)
+    glXGetProcAddressARB( (const GLubyte *) "glXGetSyncValuesOML" );
+  int32_t numerator = 0, denominator = 0;
+  int64_t ust, msc, sbc;
+  if ( !this->getSyncValuesOML || !getMscRate ||
+       !getMscRate( this->display, this->win, &numerator, &denominator ) ||
+       numerator <= 0 || denominator <= 0 ||
+       !this->getSyncValuesOML( this->display, this->win, &ust, &msc, &sbc ) )
+    {
+      this->getSyncValuesOML = 0;
+      return;
+    }
+  this->refreshNs = 1000000000LL * denominator / numerator;
+
+  //UST is microseconds on an unspecified clock. Mesa's is CLOCK_MONOTONIC;
+  //anything else gets an offset fixed now, good to within this call's time
+  long long now = LoopClock::Now();
+  if ( llabs( now - ust * 1000 ) > 1000000000LL )
+    this->ustOffsetNs = now - ust * 1000;
+  this->swapsIssued = this->swapsCompleted = sbc;
+  this->lastPresentNs = ust * 1000 + this->ustOffsetNs;
+  cout << "Present timing from GLX_OML_sync_control, "
+       << 1e9 / this->refreshNs << " Hz" << endl;
+}
+
+bool X11GLManager::SetSwapInterval(vsyncmode mode)
+{
+  if ( mode == VSYNC_DEFAULT )
+    return true;
+  //adaptive is a negative interval: sync, but don't wait out a missed vblank
+  int interval = mode == VSYNC_OFF ? 0 : ( mode == VSYNC_ON ? 1 : -1 );
+  if ( interval < 0 && !this->swapControlTear )
+    return false;
+  if ( this->swapIntervalEXT )
+    {
+      this->swapIntervalEXT( this->display, this->win, interval );
+      return true;
+    }
+  if ( this->swapIntervalMESA && interval >= 0 )
+    return this->swapIntervalMESA( interval ) == 0;
+  return false;
+}
+
+bool X11GLManager::GetPresentTiming(PresentTiming* timing)
+{
+  int64_t ust, msc, sbc;
+  if ( !this->getSyncValuesOML ||
+       !this->getSyncValuesOML( this->display, this->win, &ust, &msc, &sbc ) )
+    return false;
+
+  //ust/msc are the latest vblank, so a swap that completed since the last
+  //call was shown at it, if we ask at least once a refresh
+  long long vblank = ust * 1000 + this->ustOffsetNs;
+  if ( sbc > this->swapsCompleted )
+    {
+      this->presents += sbc - this->swapsCompleted;
+      this->swapsCompleted = sbc;
+      this->lastPresentNs = vblank;
+    }
+
+  //a frame begun now is shown after the swaps still queued ahead of it, one
+  //vblank apiece, and never at a vblank already past
+  int64_t queued = this->swapsIssued > sbc ? this->swapsIssued - sbc : 0;
+  long long predicted = vblank + this->refreshNs * ( 1 + queued );
+  long long now = LoopClock::Now();
+  if ( predicted <= now )
+    predicted += ( ( now - predicted ) / this->refreshNs + 1 ) * this->refreshNs;
+
+  timing->last_present_ns = this->lastPresentNs;
+  timing->predicted_ns = predicted;
+  timing->refresh_ns = this->refreshNs;
+  timing->presents = this->presents;
+  return true;
 }
   
 
@@ -229,9 +562,48 @@ void X11GLManager::GetGLVersion(void)
   }
 }
  
+//true if config still has everything visual_attribs asks for
+static bool configSuitable(Display* display, GLXFBConfig config)
+{
+  for(int idx = 0; visual_attribs[idx] != None; idx += 2)
+    {
+      int attrib = visual_attribs[idx], wanted = visual_attribs[idx + 1];
+      int value;
+      if(glXGetFBConfigAttrib(display, config, attrib, &value) != Success)
+        return false;
+      switch(attrib)
+        {
+        case GLX_DRAWABLE_TYPE:
+        case GLX_RENDER_TYPE:
+          if((value & wanted) != wanted)
+            return false;
+          break;
+        case GLX_X_RENDERABLE:
+        case GLX_X_VISUAL_TYPE:
+        case GLX_DOUBLEBUFFER:
+          if(value != wanted)
+            return false;
+          break;
+        default:
+          //the sizes are minimums
+          if(value < wanted)
+            return false;
+          break;
+        }
+    }
+  return true;
+}
+
 void  X11GLManager::ConfigVisual(void)
 {
-  cout << "Getting matching framebuffer configs\n" << endl;
+  string cache_key;
+  if(!this->config_cache_path.empty())
+    {
+      cache_key = ConfigCacheKey();
+      if(LoadCachedConfig(cache_key))
+        return;
+    }
+
   int fbcount;
   GLXFBConfig *fbc = glXChooseFBConfig( this->display, DefaultScreen( this->display ),
                                         visual_attribs, &fbcount );
@@ -240,32 +612,28 @@ void  X11GLManager::ConfigVisual(void)
       cout <<  "Failed to retrieve a framebuffer config" << endl;
       exit(1);
     }
-  cout <<  "Found " << fbcount << " matching FB configs." << endl;
  
-  // Pick the FB config/visual with the most samples per pixel
-  cout <<  "Getting XVisualInfos" << endl;
-  int best_fbc = -1, worst_fbc = -1, best_num_samp = -1, worst_num_samp = 999;
+  // Pick the FB config/visual with the most samples per pixel. Whether a
+  // config has a visual is an attribute; fetching each XVisualInfo to find
+  // out costs an allocation and a visual list search apiece
+  int best_fbc = -1, best_num_samp = -1;
  
   int i;
   for ( i = 0; i < fbcount; i++ )
     {
-      XVisualInfo *vi = glXGetVisualFromFBConfig( this->display, fbc[i] );
-      if ( vi )
-        {
-          int samp_buf, samples;
-          glXGetFBConfigAttrib( this->display, fbc[i], GLX_SAMPLE_BUFFERS, &samp_buf );
-          glXGetFBConfigAttrib( this->display, fbc[i], GLX_SAMPLES       , &samples  );
- 
-          cout <<  "  Matching fbconfig " << i <<", visual ID " << vi->visualid
-               << "SAMPLE_BUFFERS = " << samp_buf << ", SAMPLES = " << samples 
-               << endl;
- 
-          if ( best_fbc < 0 || (samp_buf && samples > best_num_samp) )
-            best_fbc = i, best_num_samp = samples;
-          if ( worst_fbc < 0 || !samp_buf || samples < worst_num_samp )
-            worst_fbc = i, worst_num_samp = samples;
-        }
-      XFree( vi );
+      int visual_id, samp_buf, samples;
+      glXGetFBConfigAttrib( this->display, fbc[i], GLX_VISUAL_ID, &visual_id );
+      if ( !visual_id )
+        continue;
+      glXGetFBConfigAttrib( this->display, fbc[i], GLX_SAMPLE_BUFFERS, &samp_buf );
+      glXGetFBConfigAttrib( this->display, fbc[i], GLX_SAMPLES       , &samples  );
+      if ( best_fbc < 0 || (samp_buf && samples > best_num_samp) )
+        best_fbc = i, best_num_samp = samples;
+    }
+  if ( best_fbc < 0 )
+    {
+      cout <<  "No framebuffer config with a visual" << endl;
+      exit(1);
     }
  
   this->bestFbc = fbc[ best_fbc ];
@@ -275,13 +643,161 @@ void  X11GLManager::ConfigVisual(void)
  
   // Get a visual
   this->vi = glXGetVisualFromFBConfig( this->display, this->bestFbc );
-  cout <<  "Chosen visual ID = " << this->vi->visualid << endl;
+  int fbconfig_id;
+  glXGetFBConfigAttrib( this->display, this->bestFbc, GLX_FBCONFIG_ID, &fbconfig_id );
+  cout <<  "Chose FB config 0x" << hex << fbconfig_id << ", visual 0x"
+       << this->vi->visualid << dec << " of " << fbcount << " matching" << endl;
+
+  if(!cache_key.empty())
+    SaveCachedConfig(cache_key);
+}
+
+string X11GLManager::ConfigCacheKey(void)
+{
+  //a config id is only meaningful to the server and driver that gave it out
+  int screen = DefaultScreen( this->display );
+  const char* server_vendor = glXQueryServerString( this->display, screen, GLX_VENDOR );
+  const char* server_version = glXQueryServerString( this->display, screen, GLX_VERSION );
+  const char* client_vendor = glXGetClientString( this->display, GLX_VENDOR );
+  const char* client_version = glXGetClientString( this->display, GLX_VERSION );
+  stringstream key;
+  key << DisplayString( this->display ) << "/" << screen << "/"
+      << (server_vendor ? server_vendor : "") << "/"
+      << (server_version ? server_version : "") << "/"
+      << (client_vendor ? client_vendor : "") << "/"
+      << (client_version ? client_version : "");
+  string flat = key.str();
+  for(size_t idx = 0; idx < flat.size(); idx++)
+    if(flat[idx] == '\n')
+      flat[idx] = ' ';
+  return flat;
+}
+
+bool X11GLManager::LoadCachedConfig(const string& key)
+{
+  //one "fbconfig_id visual_id key" line per display
+  ifstream in( this->config_cache_path.c_str() );
+  string line;
+  int fbconfig_id = 0;
+  unsigned long visual_id = 0;
+  while(getline(in, line))
+    {
+      istringstream fields(line);
+      int id;
+      unsigned long visual;
+      string rest;
+      if((fields >> hex >> id >> visual) && getline(fields >> ws, rest) &&
+         rest == key)
+        {
+          fbconfig_id = id;
+          visual_id = visual;
+          break;
+        }
+    }
+  if(!fbconfig_id)
+    return false;
+
+  //asking for an id returns just that config, without sorting the rest
+  int attribs[] = { GLX_FBCONFIG_ID, fbconfig_id, None };
+  int fbcount = 0;
+  GLXFBConfig *fbc = glXChooseFBConfig( this->display, DefaultScreen( this->display ),
+                                        attribs, &fbcount );
+  bool usable = fbc && fbcount == 1 && configSuitable( this->display, fbc[0] );
+  if(usable)
+    {
+      this->bestFbc = fbc[0];
+      this->vi = glXGetVisualFromFBConfig( this->display, this->bestFbc );
+      usable = this->vi && this->vi->visualid == visual_id;
+      if(!usable && this->vi)
+        XFree( this->vi );
+    }
+  if(fbc)
+    XFree( fbc );
+  if(!usable)
+    {
+      cout << "Cached FB config 0x" << hex << fbconfig_id << dec
+           << " no longer suitable" << endl;
+      return false;
+    }
+  cout << "Using cached FB config 0x" << hex << fbconfig_id << ", visual 0x"
+       << visual_id << dec << endl;
+  return true;
+}
+
+void X11GLManager::SaveCachedConfig(const string& key)
+{
+  //other displays' lines are kept
+  stringstream kept;
+  {
+    ifstream in( this->config_cache_path.c_str() );
+    string line;
+    while(getline(in, line))
+      {
+        size_t space = line.find(' ');
+        space = space == string::npos ? space : line.find(' ', space + 1);
+        if(space != string::npos && line.compare(space + 1, string::npos, key))
+          kept << line << "\n";
+      }
+  }
+
+  const string& path = this->config_cache_path;
+  size_t slash = path.rfind('/');
+  if(slash != string::npos && slash > 0)
+    MakeDirectories(path.substr(0, slash));
+  int fbconfig_id;
+  glXGetFBConfigAttrib( this->display, this->bestFbc, GLX_FBCONFIG_ID, &fbconfig_id );
+  kept << hex << fbconfig_id << " " << this->vi->visualid << " " << key << "\n";
+  if(!ReplaceFile(path, kept.str()))
+    cerr << "Could not write framebuffer config cache " << path << endl;
+}
+
+void X11GLManager::PlaceWindow(void)
+{
+  this->placeWidth = this->placeHeight = 0;
+  int screen = DefaultScreen( this->display );
+  if(this->output_layout == OUTPUTS_EACH)
+    {
+      if(!this->outputs.empty() && this->outputs[0].screen == screen)
+        {
+          this->placeX = this->outputs[0].x;
+          this->placeY = this->outputs[0].y;
+          this->placeWidth = this->outputs[0].width;
+          this->placeHeight = this->outputs[0].height;
+        }
+    }
+  else if(this->output_layout == OUTPUTS_SPAN)
+    {
+      //the box around every output of the screen the window is made on
+      int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+      bool any = false;
+      for(size_t idx = 0; idx < this->outputs.size(); idx++)
+        {
+          const DisplayOutput& output = this->outputs[idx];
+          if(output.screen != screen)
+            continue;
+          if(!any || output.x < x1)
+            x1 = output.x;
+          if(!any || output.y < y1)
+            y1 = output.y;
+          if(!any || output.x + output.width > x2)
+            x2 = output.x + output.width;
+          if(!any || output.y + output.height > y2)
+            y2 = output.y + output.height;
+          any = true;
+        }
+      if(any)
+        {
+          this->placeX = x1;
+          this->placeY = y1;
+          this->placeWidth = x2 - x1;
+          this->placeHeight = y2 - y1;
+        }
+    }
 }
 
 void X11GLManager::CreateWindow(void)
 {
   
-  cout <<  "Creating colormap" << endl;
   XSetWindowAttributes swa;
 
   swa.colormap = this->cmap = XCreateColormap( this->display,
@@ -292,9 +808,13 @@ void X11GLManager::CreateWindow(void)
   swa.event_mask        = KeyPressMask | KeyReleaseMask | ButtonPressMask | 
     ButtonReleaseMask | StructureNotifyMask | PointerMotionMask;
  
-  cout <<  "Creating window" << endl;
+  bool placed = this->placeWidth > 0 && this->placeHeight > 0;
   this->win = XCreateWindow( this->display, RootWindow( this->display, this->vi->screen ), 
-                              0, 0, 100, 100, 0, this->vi->depth, InputOutput, 
+                              placed ? this->placeX : 0,
+                              placed ? this->placeY : 0,
+                              placed ? this->placeWidth : 100,
+                              placed ? this->placeHeight : 100,
+                              0, this->vi->depth, InputOutput, 
                               this->vi->visual, 
                               CWBorderPixel|CWColormap|CWEventMask, &swa );
   if ( !this->win )
@@ -307,8 +827,26 @@ void X11GLManager::CreateWindow(void)
   XFree( this->vi );
  
   XStoreName( this->display, this->win, "GL 4.2 Window" );
+
+  if ( placed )
+    {
+      // Without decorations, and asking to be kept where it was put, so it
+      // lines up with the outputs it's for
+      long hints[MWM_HINTS_ELEMENTS] = { MWM_HINTS_DECORATIONS, 0, 0, 0, 0 };
+      Atom motif = XInternAtom( this->display, "_MOTIF_WM_HINTS", False );
+      XChangeProperty( this->display, this->win, motif, motif, 32,
+                       PropModeReplace, (unsigned char*) hints,
+                       MWM_HINTS_ELEMENTS );
+      XSizeHints size;
+      memset( &size, 0, sizeof( size ) );
+      size.flags = USPosition | USSize | PMinSize | PMaxSize;
+      size.x = this->placeX;
+      size.y = this->placeY;
+      size.width = size.min_width = size.max_width = this->placeWidth;
+      size.height = size.min_height = size.max_height = this->placeHeight;
+      XSetWMNormalHints( this->display, this->win, &size );
+    }
  
-  cout <<  "Mapping window" << endl;
   XMapWindow( this->display, this->win );
  
 }
@@ -344,6 +882,7 @@ void X11GLManager::GetContext(bool debug_context)
     cout <<  "glXCreateContextAttribsARB() not found"
             " ... using old-style GLX context" << endl;
     this->ctx = glXCreateNewContext( this->display, this->bestFbc, GLX_RGBA_TYPE, 0, True );
+    this->createContextAttribs = 0;
   }
  
   // If it does, try to get a GL 4.2 context!
@@ -359,7 +898,6 @@ void X11GLManager::GetContext(bool debug_context)
         0
       };
  
-    cout <<  "Creating context" << endl;
     this->ctx = glXCreateContextAttribsARB( this->display, this->bestFbc, 0,
                                       True, context_attribs );
  
@@ -385,6 +923,10 @@ void X11GLManager::GetContext(bool debug_context)
       this->ctx = glXCreateContextAttribsARB( this->display, this->bestFbc, 0, 
                                         True, context_attribs );
     }
+
+    // Remembered so shared contexts match the renderer's
+    this->createContextAttribs = glXCreateContextAttribsARB;
+    memcpy( this->ctxAttribs, context_attribs, sizeof( this->ctxAttribs ) );
   }
  
   // Sync to ensure any errors generated are processed.
@@ -442,71 +984,239 @@ int X11GLManager::XEpollInit(struct epoll_event * event)
 
 void X11GLManager::HandleXEvent(XEvent xe)
 {
+  //an output manager's window shows the same image as this one, so its
+  //resizes are its own, and pointer positions are scaled onto this window
+  X11GLManager* output = OutputManagerFor(xe.xany.window);
+  if(output)
+    {
+      if(xe.type == ConfigureNotify)
+        {
+          output->Resize(xe.xconfigure.width, xe.xconfigure.height);
+          return;
+        }
+      if(output->windowWidth > 0 && output->windowHeight > 0)
+        {
+          if(xe.type == ButtonPress || xe.type == ButtonRelease)
+            {
+              xe.xbutton.x = xe.xbutton.x * this->windowWidth / output->windowWidth;
+              xe.xbutton.y = xe.xbutton.y * this->windowHeight / output->windowHeight;
+            }
+          else if(xe.type == MotionNotify)
+            {
+              xe.xmotion.x = xe.xmotion.x * this->windowWidth / output->windowWidth;
+              xe.xmotion.y = xe.xmotion.y * this->windowHeight / output->windowHeight;
+            }
+        }
+    }
+
   bool enqueue = false;
-  RendererEventPtr event_ptr;
+  RendererEvent event;
   switch(xe.type)
     {
     case KeyPress:
-      event_ptr = RendererEventPtr(vms_new RendererEvent((void*)&xe,KEY_DOWN));
-      if(event_ptr->data->key_data->which == VMS_ENTER && event_ptr->mask & SHIFT_MASK && event_ptr->mask & CTRL_MASK)
+      event = RendererEvent((void*) &xe, KEY_DOWN);
+      if(event.data.key.which == VMS_ENTER && event.mask & SHIFT_MASK && event.mask & CTRL_MASK)
 	      toggleEventRecipient();
       enqueue = true;
       lastMouseButton->lastEvent = false;
       break;
     case KeyRelease:
-      event_ptr = RendererEventPtr(vms_new RendererEvent((void*)&xe,KEY_UP));
+      event = RendererEvent((void*) &xe, KEY_UP);
       enqueue = true;
       lastMouseButton->lastEvent = false;
       break;
     case ButtonPress:
       if(xe.xbutton.button == Button4 || xe.xbutton.button == Button5)
-	      event_ptr = RendererEventPtr(vms_new RendererEvent((void*)&xe,MOUSE_SCROLL));
+	      event = RendererEvent((void*) &xe, MOUSE_SCROLL);
       else
-	      event_ptr = RendererEventPtr(vms_new RendererEvent((void*)&xe,MOUSE_DOWN));
+	      event = RendererEvent((void*) &xe, MOUSE_DOWN);
       enqueue = true;
       break;
     case ButtonRelease:
       if(checkAndUpdateMouseButton(xe.xbutton))
-	      event_ptr = RendererEventPtr(vms_new RendererEvent((void*)&xe,MOUSE_DBLCLK)); //x11 doesn't know about double clicks so it'll have to be handled internally
+	      event = RendererEvent((void*) &xe, MOUSE_DBLCLK); //x11 doesn't know about double clicks so it'll have to be handled internally
       else
-	      event_ptr = RendererEventPtr(new RendererEvent((void*)&xe,MOUSE_UP));
+	      event = RendererEvent((void*) &xe, MOUSE_UP);
       enqueue = true;
       break;
     case MotionNotify:
-      event_ptr = RendererEventPtr(vms_new RendererEvent((void*) &xe,MOUSE_MOVE));
+      event = RendererEvent((void*) &xe, MOUSE_MOVE);
       enqueue = true;
       break;
     case ConfigureNotify:
 	    enqueue = false;
       XConfigureEvent* xce = (XConfigureEvent *) &xe;
+      if(xce->window != this->win)
+        break;
       cout <<"resizing to "<< xce->width<<" pixels wide and "<< xce->height <<" pixels high" << endl;
       Resize(xce->width, xce->height);
       break;
     }
   //this returns whether it used it or not, for the moment it's ignored 
-  this->HandleGlobalEvents(event_ptr);
+  this->HandleGlobalEvents(&event);
   if(enqueue)
   {
-    hfPrintf("Enqueued event of type %u",event_ptr->type);
-    this->event_handler->enqueueEvent(event_ptr);
+    hfPrintf("Enqueued event of type %u",event.type);
+    this->event_handler->enqueueEvent(event);
   }
 }
 
 bool X11GLManager::HandleWindowEvents(void)
 {
+  DispatchWatchedFds(0);
   XFlush(this->display);
-  int poll = XEventsQueued(this->display, QueuedAlready);
-  bool new_events = (poll > 0);
-  for(;poll > 0;poll--)
+
+  //only the newest pointer position and window size matter to the renderer,
+  //so a run of MotionNotify (or ConfigureNotify) events is handled as its
+  //last member. A pending move is still delivered before any other input so
+  //a click sees the position it happened at
+  XEvent motion, configure;
+  bool have_motion = false, have_configure = false;
+  this->event_stats.raw = this->event_stats.coalesced = 0;
+
+  //QueuedAfterReading pulls whatever is waiting on the socket without
+  //blocking; QueuedAlready would only see what Xlib had buffered already
+  int queued = XEventsQueued(this->display, QueuedAfterReading);
+  while(queued > 0 && this->event_stats.raw < X11_EVENT_DRAIN_MAX)
   {
     XEvent xe;
     XNextEvent(this->display, &xe);
-    HandleXEvent(xe);
+    this->event_stats.raw++;
+    if(--queued == 0)
+      queued = XEventsQueued(this->display, QueuedAlready);
+
+    switch(xe.type)
+    {
+      case MotionNotify:
+        if(have_motion)
+          this->event_stats.coalesced++;
+        motion = xe;
+        have_motion = true;
+        break;
+      case ConfigureNotify:
+        //output managers' windows are resized on their own
+        if(xe.xconfigure.window != this->win)
+        {
+          HandleXEvent(xe);
+          break;
+        }
+        if(have_configure)
+          this->event_stats.coalesced++;
+        configure = xe;
+        have_configure = true;
+        break;
+      default:
+        if(have_motion)
+        {
+          HandleXEvent(motion);
+          have_motion = false;
+        }
+        HandleXEvent(xe);
+        break;
+    }
   }
+  //anything left waits for the next frame rather than stalling this one
+  this->event_stats.truncated = queued > 0;
+
+  if(have_configure)
+    HandleXEvent(configure);
+  if(have_motion)
+    HandleXEvent(motion);
+
+  bool new_events = this->event_stats.raw > 0;
+  if(new_events)
+    this->event_handler->flushInput();
   return new_events;
 }
 
 
+X11GLManager* X11GLManager::OutputManagerFor(Window win)
+{
+  for(size_t idx = 0; idx < this->output_managers.size(); idx++)
+    if(this->output_managers[idx]->win == win)
+      return this->output_managers[idx];
+  return 0;
+}
+
+OpenGLManager* X11GLManager::CreateOutputManager(size_t index)
+{
+  //a window on another X screen would need a config and context from that
+  //screen; objects can't be shared with those
+  if(this->primary || this->output_layout != OUTPUTS_EACH || index == 0 ||
+     index >= this->outputs.size() ||
+     this->outputs[index].screen != DefaultScreen( this->display ))
+    return 0;
+  X11GLManager* manager = new X11GLManager(this, this->outputs[index]);
+  if(!manager->ctx)
+    {
+      cout << "Failed to create a context for output "
+           << this->outputs[index].name << endl;
+      delete manager;
+      return 0;
+    }
+  return manager;
+}
+
+void X11GLManager::FdReady(int fd)
+{
+  DispatchWatchedFds(0);
+}
+
+
+bool X11GLManager::WindowEventsPending(void)
+{
+  XFlush(this->display);
+  return XEventsQueued(this->display, QueuedAlready) > 0;
+}
+
+
+class X11SharedContext : public SharedGLContext
+{
+public:
+  X11SharedContext(Display* display, Window win, GLXContext ctx)
+    : display(display), win(win), ctx(ctx) {}
+  ~X11SharedContext(void)
+  {
+    glXDestroyContext( this->display, this->ctx );
+  }
+
+  // GLX needs a drawable to make a context current; the renderer's window
+  // is fine since this context never draws to it
+  bool MakeCurrent(void)
+  {
+    return glXMakeCurrent( this->display, this->win, this->ctx );
+  }
+
+  void Release(void)
+  {
+    glXMakeCurrent( this->display, None, 0 );
+  }
+
+private:
+  Display* display;
+  Window win;
+  GLXContext ctx;
+};
+
+SharedGLContext* X11GLManager::CreateSharedContext(void)
+{
+  GLXContext shared;
+  if(this->createContextAttribs)
+    shared = this->createContextAttribs( this->display, this->bestFbc,
+                                         this->ctx, True, this->ctxAttribs );
+  else
+    shared = glXCreateNewContext( this->display, this->bestFbc, GLX_RGBA_TYPE,
+                                  this->ctx, True );
+  XSync( this->display, False );
+  if(!shared)
+    {
+      cout << "Failed to create a shared GLX context" << endl;
+      return 0;
+    }
+  return new X11SharedContext(this->display, this->win, shared);
+}
+
+
 void X11GLManager::GetGLCLShareParameters(void** handle_pair)
 {
   handle_pair[0] = this->display;
@@ -544,11 +1254,7 @@ void X11GLManager::toggleEventRecipient()
 
 void X11GLManager::tellRendererControl(bool renderer_control)
 {
-  SoftwareMessageData* data = vms_new SoftwareMessageData();
-  data->msg_type = RENDERER_HANDLES_EVENTS;
-  bool* content = vms_new bool;
-  *content = renderer_control;
-  data->contents = (void*)content;
-  RendererEvent* toggleEvent = new RendererEvent(data);
-  this->parent_handler->enqueueEvent(RendererEventPtr(toggleEvent));
+  RendererEvent toggleEvent(RENDERER_HANDLES_EVENTS);
+  toggleEvent.data.message.contents.flag = renderer_control;
+  this->parent_handler->enqueueEvent(toggleEvent);
   }
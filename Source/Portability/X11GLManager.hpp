@@ -18,6 +18,7 @@
 #include <boost/shared_ptr.hpp>
 #include <Portability/Instrumentation/Instrumentation.h>
 #include <Portability/PublicInterfaces/OpenGLManager.hpp>
+#include <stdint.h>
 //#include <Gl/glu.h>
 
 
@@ -25,8 +26,13 @@
 
 typedef GLXContext (*glXCreateContextAttribsARBProc) 
         (Display*, GLXFBConfig, GLXContext, Bool, const int*);
+typedef void (*glXSwapIntervalEXTProc)(Display*, GLXDrawable, int);
+typedef int (*glXSwapIntervalMESAProc)(unsigned int);
+typedef Bool (*glXGetSyncValuesOMLProc)
+        (Display*, GLXDrawable, int64_t*, int64_t*, int64_t*);
+typedef Bool (*glXGetMscRateOMLProc)(Display*, GLXDrawable, int32_t*, int32_t*);
 
-class X11GLManager : public OpenGLManager
+class X11GLManager : public OpenGLManager, public FdWatcher
 {
 public:
   X11GLManager(RendererEventHandlerPtr sysCtrl_handler, RendererEventHandlerPtr gl_renderer_handler);
@@ -39,9 +45,12 @@ public:
   
   int GetWindowHeight(void);
   int GetWindowWidth(void);
+  void RequestWindowSize(int w, int h);
 
   void GetGLCLShareParameters(void** handle_pair);
 
+  SharedGLContext* CreateSharedContext(void);
+
   //used to set/unset the renderer's context as the current GL context
   void SetContextCurrent(void);
   void UnsetContextCurrent(void);
@@ -49,13 +58,48 @@ public:
   //swaps the front/back frame buffers, making the most recent frame visible
   void SwapFrameBuffers(void);
 
+  //through GLX_EXT_swap_control, or GLX_MESA_swap_control for on and off.
+  //Adaptive needs GLX_EXT_swap_control_tear
+  bool SetSwapInterval(vsyncmode mode);
+
+  //through GLX_OML_sync_control
+  bool GetPresentTiming(PresentTiming* timing);
+
   bool HandleWindowEvents(void);
 
   bool WindowSizeChanged(void);
+
+  //a window on the output, with a context sharing ctx. The window's events
+  //are read off this manager's connection along with its own
+  OpenGLManager* CreateOutputManager(size_t index);
+
+  //an output manager's epoll set, watched in this manager's
+  void FdReady(int fd);
+
+  //outputs of display, or of a connection opened just for it when display
+  //is null, in RandR's order; see OpenGLManager::ListOutputs()
+  static bool EnumerateOutputs(Display* display,
+                               std::vector<DisplayOutput>* outputs);
+
+protected:
+  bool WindowEventsPending(void);
+
 private:
+  //an output manager, sharing primary's display connection and config
+  X11GLManager(X11GLManager* primary, const DisplayOutput& output);
+
   //pointer to an X11 display object. Set by getDisplay()
   Display *display;
 
+  //the manager whose connection this one uses, or null if it's its own
+  X11GLManager* primary;
+  //output managers made from this one, for routing their windows' events
+  std::vector<X11GLManager*> output_managers;
+
+  //where CreateWindow() puts the window, undecorated; wherever the window
+  //manager likes when placeWidth is 0
+  int placeX, placeY, placeWidth, placeHeight;
+
   //Check that version is high enough to support FBConfigs (1.3 or higher)
   //Set by GetGLVersion()
   int glx_major, glx_minor;
@@ -75,6 +119,24 @@ private:
 
   //openGL context created by GetGLContext
   GLXContext ctx;
+
+  //how ctx was created, so CreateSharedContext can make a matching one.
+  //createContextAttribs is null when ctx is an old-style context
+  glXCreateContextAttribsARBProc createContextAttribs;
+  int ctxAttribs[7];
+
+  //swap control entry points, null where the extension is missing. Set by
+  //InitSwapControl()
+  glXSwapIntervalEXTProc swapIntervalEXT;
+  glXSwapIntervalMESAProc swapIntervalMESA;
+  bool swapControlTear;
+  glXGetSyncValuesOMLProc getSyncValuesOML;
+
+  //OML swap bookkeeping: swaps issued and seen completed (on the driver's
+  //swap buffer count), and UST to CLOCK_MONOTONIC ns
+  int64_t swapsIssued, swapsCompleted;
+  long long refreshNs, lastPresentNs, ustOffsetNs;
+  unsigned long long presents;
   
   int windowWidth, windowHeight;
   
@@ -86,20 +148,41 @@ private:
   void GetGLVersion(void);
 
   //Finds the optimal frame buffer context, and grabs the corresponding visual
-  //information for configuring the window
+  //information for configuring the window. Uses the config cached by the
+  //last launch when it is still there and still suitable
   //Exits program if no suitable framebuffers exist
   void ConfigVisual(void);
 
+  //identifies the display, screen and GLX implementation a cached config
+  //choice is good for
+  std::string ConfigCacheKey(void);
+
+  //sets bestFbc and vi from the config cached under key; false on a miss
+  bool LoadCachedConfig(const std::string& key);
+
+  //remembers bestFbc and vi under key in config_cache_path
+  void SaveCachedConfig(const std::string& key);
+
+  //sets the place* fields from output_layout and outputs
+  void PlaceWindow(void);
+
   //Creates a new window configured with the settings from ConfigVisual, maps
   //the window to a display, and sets the window name
   //Exits program on window creation failure
   void CreateWindow(void);
 
+  //the output manager whose window is win, or null
+  X11GLManager* OutputManagerFor(Window win);
+
   //Gets an openGL contexts; attemps to get a version 4.0 context, but falls
   //back to an older version if not available
   //Exits if unable to create any context
   void GetContext(bool debug_context);
 
+  //Looks up the swap control and sync control extensions; call with the
+  //context current
+  void InitSwapControl(void);
+
   //Handles expose events
   void HandleExpose(void);
 
@@ -145,63 +145,65 @@ char mapKeys(KeySym sym)
 RendererEvent::RendererEvent(void* event_ptr, eventtype type)
 {
   hfPrintf("Creating renderer event");
-  this->data = vms_new EventDataWrapper();
+  memset(&this->data, 0, sizeof(this->data));
   this->type = type;
+  this->arrival_ns = LoopClock::Now();
+  this->server_time = 0;
   switch(type)
   {
     case MOUSE_UP:
     case MOUSE_DOWN:
       {
-        XButtonEvent event = ((XEvent*)event_ptr)->xbutton;
-        MousePressData* press_data = vms_new MousePress();
-        this->data->press_data = press_data;
+        XButtonEvent* event = &((XEvent*)event_ptr)->xbutton;
+        MousePressData* press_data = &this->data.press;
         press_data->down = type == MOUSE_DOWN; 
-        press_data->which = mouseType(event.button);
-        press_data->where.window_x = event.x;
-        press_data->where.window_y = event.y;
+        press_data->which = mouseType(event->button);
+        press_data->where.window_x = event->x;
+        press_data->where.window_y = event->y;
+        this->server_time = event->time;
         break;
       }
     case MOUSE_DBLCLK:
       {
-        XButtonEvent event = ((XEvent*)event_ptr)->xbutton;
-        MouseDoubleData* dbl_data = vms_new MouseDoubleData();
-        this->data->double_data = dbl_data;
-        dbl_data->which = mouseType(event.button);
-        dbl_data->where.window_x = event.x;
-        dbl_data->where.window_y = event.y;
+        XButtonEvent* event = &((XEvent*)event_ptr)->xbutton;
+        MouseDoubleData* dbl_data = &this->data.dbl;
+        dbl_data->which = mouseType(event->button);
+        dbl_data->where.window_x = event->x;
+        dbl_data->where.window_y = event->y;
+        this->server_time = event->time;
         break;
       }
     case MOUSE_MOVE: 
       {
-        XMotionEvent event = ((XEvent*)event_ptr)->xmotion;
-        MouseMoveData* move = vms_new MouseMoveData();
-        this->data->move_data = move;
-        move->window_x = event.x;
-        move->window_y = event.y;
+        XMotionEvent* event = &((XEvent*)event_ptr)->xmotion;
+        MouseMoveData* move = &this->data.move;
+        move->window_x = event->x;
+        move->window_y = event->y;
+        this->server_time = event->time;
         break;
       }
     case MOUSE_SCROLL:
       {
-        XButtonEvent event = ((XEvent*)event_ptr)->xbutton;
-        MouseWheelData* wheel_data = vms_new MouseWheelData();
-        this->data->wheel_data = wheel_data;
-        wheel_data->where.window_x = event.x;
-        wheel_data->where.window_y = event.y;
-        wheel_data->wheel_delta = event.button == Button4 ? WHEEL_INCREMENT : -WHEEL_INCREMENT;
+        XButtonEvent* event = &((XEvent*)event_ptr)->xbutton;
+        MouseWheelData* wheel_data = &this->data.wheel;
+        wheel_data->where.window_x = event->x;
+        wheel_data->where.window_y = event->y;
+        wheel_data->wheel_delta = event->button == Button4 ? WHEEL_INCREMENT : -WHEEL_INCREMENT;
+        this->server_time = event->time;
         break;
       }
     case KEY_UP:
     case KEY_DOWN:
       {
-        XKeyEvent event = ((XEvent*)event_ptr)->xkey;
-        KeySym sym = XLookupKeysym(&event,0);
+        XKeyEvent* event = &((XEvent*)event_ptr)->xkey;
+        KeySym sym = XLookupKeysym(event,0);
         char maskUpdate = getNewMask(sym);
         current_mask = type == KEY_UP ? current_mask & ~maskUpdate:current_mask | maskUpdate; 
         if(current_mask & SHIFT_MASK)
           applyShiftMask(sym);
-        this->data->key_data = vms_new KeystrokeData();
-        this->data->key_data->down = false;
-        this->data->key_data->which = mapKeys(sym);
+        this->data.key.down = false;
+        this->data.key.which = mapKeys(sym);
+        this->server_time = event->time;
         break;
       }
     case SOFTWARE:
@@ -0,0 +1,432 @@
+/*******************************************************************************
+*  BufferGraph.cpp - shadertoy-style Buffer A-D passes feeding the image pass  *
+*******************************************************************************/
+
+
+#include "BufferGraph.hpp"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+
+using namespace std;
+
+
+//section names other than the buffers
+#define SECTION_COMMON -1
+#define SECTION_IMAGE -2
+#define SECTION_UNKNOWN -3
+
+static const char* pass_directive = "pass:";
+static const char* channel_directive = "ichannel";
+
+
+//"// <directive>" comment lines; returns what follows the directive, or false
+static bool directive(const string& line, const char* name, string* rest)
+{
+  size_t pos = line.find_first_not_of(" \t");
+  if(pos == string::npos || line.compare(pos, 2, "//"))
+    return false;
+  pos = line.find_first_not_of(" \t", pos + 2);
+  if(pos == string::npos || line.size() - pos < strlen(name))
+    return false;
+  for(size_t idx = 0; name[idx]; idx++)
+    if(tolower(line[pos + idx]) != name[idx])
+      return false;
+  *rest = line.substr(pos + strlen(name));
+  return true;
+}
+
+//common, image, bufferA-bufferD or A-D, any case and spacing
+static int sectionIndex(const string& text)
+{
+  string name;
+  for(size_t idx = 0; idx < text.size(); idx++)
+    if(!isspace(text[idx]))
+      name += tolower(text[idx]);
+  if(name == "common")
+    return SECTION_COMMON;
+  if(name == "image")
+    return SECTION_IMAGE;
+  if(!name.compare(0, 6, "buffer"))
+    name = name.substr(6);
+  if(name.size() == 1 && name[0] >= 'a' && name[0] < 'a' + BUFFER_PASSES)
+    return name[0] - 'a';
+  return SECTION_UNKNOWN;
+}
+
+
+bool BufferGraph::Parse(const string& toy_source, vector<PassSource>* buffers,
+                        PassSource* image)
+{
+  //anything before the first marker counts as common
+  string common;
+  vector<string> sections(BUFFER_PASSES);
+  vector<vector<int> > channels(BUFFER_PASSES + 1,
+                                vector<int>(TOY_CHANNELS, -1));
+  string image_section;
+  bool any = false, have_image = false;
+
+  int section = SECTION_COMMON;
+  istringstream in(toy_source);
+  string line, rest;
+  while(getline(in, line))
+    {
+      if(directive(line, pass_directive, &rest))
+        {
+          section = sectionIndex(rest);
+          if(section == SECTION_UNKNOWN)
+            {
+              cout << "Unknown pass" << rest << endl;
+              return false;
+            }
+          any = true;
+          have_image = have_image || section == SECTION_IMAGE;
+          continue;
+        }
+
+      if(directive(line, channel_directive, &rest) && section != SECTION_COMMON &&
+         rest.size() > 1 && rest[0] >= '0' && rest[0] < '0' + TOY_CHANNELS &&
+         rest[1] == ':')
+        {
+          int input = sectionIndex(rest.substr(2));
+          if(input >= 0)
+            channels[section == SECTION_IMAGE ? BUFFER_PASSES : section]
+              [rest[0] - '0'] = input;
+        }
+
+      string* dest = section == SECTION_COMMON ? &common :
+        section == SECTION_IMAGE ? &image_section : &sections[section];
+      *dest += line;
+      *dest += '\n';
+    }
+  if(!any || !have_image)
+    return false;
+
+  buffers->resize(BUFFER_PASSES);
+  for(int idx = 0; idx < BUFFER_PASSES; idx++)
+    {
+      (*buffers)[idx].source = sections[idx].empty() ? "" :
+        common + sections[idx];
+      copy(channels[idx].begin(), channels[idx].end(), (*buffers)[idx].channels);
+    }
+  image->source = common + image_section;
+  copy(channels[BUFFER_PASSES].begin(), channels[BUFFER_PASSES].end(),
+       image->channels);
+  return true;
+}
+
+string BufferGraph::ImageSource(const string& toy_source)
+{
+  vector<PassSource> buffers;
+  PassSource image;
+  return Parse(toy_source, &buffers, &image) ? image.source : toy_source;
+}
+
+
+
+BufferGraph::BufferGraph(const vector<PassSource>& buffers,
+                         const PassSource& image, ShaderToy* image_toy,
+                         RendererParams* params, ShaderToyParams* toy_params)
+  : passes(buffers.size())
+{
+  this->image = image;
+  this->image_toy = image_toy;
+  this->params = params;
+  this->toy_params = toy_params;
+  this->fbo = 0;
+  this->texture_w = this->texture_h = 0;
+  this->planned = false;
+  this->runs = this->skips = 0;
+
+  for(size_t idx = 0; idx < passes.size(); idx++)
+    {
+      Pass& pass = passes[idx];
+      copy(buffers[idx].channels, buffers[idx].channels + TOY_CHANNELS,
+           pass.channels);
+      pass.toy = buffers[idx].source.empty() ? 0 :
+        new ShaderToy(buffers[idx].source, params, toy_params);
+      //buffers always cover their whole texture
+      if(pass.toy)
+        pass.toy->coverage()->parse("full");
+      pass.needed = pass.feedback = pass.persistent = pass.skippable = false;
+      pass.uses_mouse = pass.uses_orientation = false;
+      pass.start = pass.end = 0;
+      pass.slots[0] = pass.slots[1] = -1;
+      pass.current = 0;
+      pass.version = 0;
+      pass.drawn = false;
+    }
+}
+
+BufferGraph::~BufferGraph(void)
+{
+  releaseTextures();
+  if(this->fbo)
+    glDeleteFramebuffers(1, &this->fbo);
+  for(size_t idx = 0; idx < passes.size(); idx++)
+    delete passes[idx].toy;
+}
+
+
+bool BufferGraph::initialize(void)
+{
+  //only what the image pass ends up reading
+  vector<int> pending(this->image.channels, this->image.channels + TOY_CHANNELS);
+  while(!pending.empty())
+    {
+      int idx = pending.back();
+      pending.pop_back();
+      if(idx < 0 || passes[idx].needed)
+        continue;
+      if(!passes[idx].toy)
+        {
+          cout << "Pass " << (char) ('A' + idx) << " is read but not defined"
+               << endl;
+          return false;
+        }
+      passes[idx].needed = true;
+      pending.insert(pending.end(), passes[idx].channels,
+                     passes[idx].channels + TOY_CHANNELS);
+    }
+
+  for(size_t idx = 0; idx < passes.size(); idx++)
+    if(passes[idx].needed && !passes[idx].toy->initialize())
+      {
+        cout << "Pass " << (char) ('A' + idx) << " failed to build" << endl;
+        return false;
+      }
+
+  plan();
+  return true;
+}
+
+
+void BufferGraph::plan(void)
+{
+  //dependency order; when what's left is a cycle, the first remaining pass
+  //goes next and reads the others' previous frame
+  order.clear();
+  vector<bool> placed(passes.size(), false);
+  vector<int> position(passes.size(), -1);
+  for(;;)
+    {
+      int next = -1, fallback = -1;
+      for(size_t idx = 0; idx < passes.size() && next < 0; idx++)
+        {
+          if(!passes[idx].needed || placed[idx])
+            continue;
+          if(fallback < 0)
+            fallback = idx;
+          bool ready = true;
+          for(int channel = 0; channel < TOY_CHANNELS; channel++)
+            {
+              int input = passes[idx].channels[channel];
+              if(input >= 0 && input != (int) idx && !placed[input])
+                ready = false;
+            }
+          if(ready)
+            next = idx;
+        }
+      if(next < 0)
+        next = fallback;
+      if(next < 0)
+        break;
+      placed[next] = true;
+      position[next] = order.size();
+      order.push_back(next);
+    }
+
+  //who reads what, and when
+  int image_position = order.size();
+  for(size_t idx = 0; idx < passes.size(); idx++)
+    passes[idx].start = passes[idx].end = position[idx];
+  for(int reader = 0; reader <= (int) order.size(); reader++)
+    {
+      const int* channels = reader < image_position ?
+        passes[order[reader]].channels : this->image.channels;
+      for(int channel = 0; channel < TOY_CHANNELS; channel++)
+        {
+          int input = channels[channel];
+          if(input < 0)
+            continue;
+          Pass& source = passes[input];
+          if(reader < image_position && input == order[reader])
+            source.feedback = true;
+          else if(source.start >= reader)
+            source.persistent = true;
+          else
+            source.end = max(source.end, reader);
+        }
+    }
+
+  //a pass is skippable when it's static and so is everything it reads
+  for(size_t idx = 0; idx < order.size(); idx++)
+    {
+      Pass& pass = passes[order[idx]];
+      pass.uses_mouse = pass.toy->uses("iMouse");
+      pass.uses_orientation = pass.toy->uses("iOrientation");
+      pass.skippable = !pass.feedback && !pass.toy->uses("iTime") &&
+        !pass.toy->uses("iGlobalTime") && !pass.toy->uses("iFrame");
+      for(int channel = 0; channel < TOY_CHANNELS; channel++)
+        {
+          int input = pass.channels[channel];
+          if(input >= 0 && (passes[input].start >= pass.start ||
+                            !passes[input].skippable))
+            pass.skippable = false;
+        }
+    }
+
+  //dedicated textures for everything that has to keep its contents; the
+  //rest share, greedily, whenever one's last read comes before the next's
+  //write
+  textures.clear();
+  vector<int> busy_until;
+  vector<bool> shared;
+  for(size_t idx = 0; idx < order.size(); idx++)
+    {
+      Pass& pass = passes[order[idx]];
+      if(pass.persistent || pass.skippable || pass.feedback)
+        {
+          for(int slot = 0; slot < (pass.feedback ? 2 : 1); slot++)
+            {
+              pass.slots[slot] = busy_until.size();
+              busy_until.push_back(-1);
+              shared.push_back(false);
+            }
+          continue;
+        }
+
+      pass.slots[0] = -1;
+      for(size_t slot = 0; slot < busy_until.size() && pass.slots[0] < 0; slot++)
+        if(shared[slot] && busy_until[slot] < pass.start)
+          pass.slots[0] = slot;
+      if(pass.slots[0] < 0)
+        {
+          pass.slots[0] = busy_until.size();
+          busy_until.push_back(0);
+          shared.push_back(true);
+        }
+      busy_until[pass.slots[0]] = pass.end;
+    }
+  textures.resize(busy_until.size(), 0);
+  planned = true;
+}
+
+unsigned int BufferGraph::unsharedTextureCount(void)
+{
+  unsigned int count = 0;
+  for(size_t idx = 0; idx < order.size(); idx++)
+    count += passes[order[idx]].feedback ? 2 : 1;
+  return count;
+}
+
+
+void BufferGraph::releaseTextures(void)
+{
+  for(size_t idx = 0; idx < textures.size(); idx++)
+    if(textures[idx])
+      glDeleteTextures(1, &textures[idx]);
+  fill(textures.begin(), textures.end(), 0);
+  texture_w = texture_h = 0;
+}
+
+void BufferGraph::allocate(int w, int h)
+{
+  releaseTextures();
+  if(!this->fbo)
+    glGenFramebuffers(1, &this->fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+  for(size_t idx = 0; idx < textures.size(); idx++)
+    {
+      glGenTextures(1, &textures[idx]);
+      glBindTexture(GL_TEXTURE_2D, textures[idx]);
+      //shadertoy buffers are float, so simulations can store state in them
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, 0);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                             GL_TEXTURE_2D, textures[idx], 0);
+      glClear(GL_COLOR_BUFFER_BIT);
+    }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  texture_w = w;
+  texture_h = h;
+  for(size_t idx = 0; idx < passes.size(); idx++)
+    passes[idx].drawn = false;
+}
+
+
+void BufferGraph::makeKey(Pass& pass, PassKey* key)
+{
+  memset(key, 0, sizeof(*key));
+  key->width = params->render_width;
+  key->height = params->render_height;
+  if(pass.uses_mouse)
+    memcpy(key->mouse, params->mouse, sizeof(key->mouse));
+  if(pass.uses_orientation)
+    key->orientation = toy_params->orientation;
+  for(int channel = 0; channel < TOY_CHANNELS; channel++)
+    if(pass.channels[channel] >= 0)
+      key->input_versions[channel] = passes[pass.channels[channel]].version;
+}
+
+void BufferGraph::bindChannels(ShaderToy* toy, const int* channels)
+{
+  for(int channel = 0; channel < TOY_CHANNELS; channel++)
+    if(channels[channel] >= 0 && passes[channels[channel]].needed)
+      toy->setChannel(channel, output(channels[channel]), texture_w,
+                      texture_h);
+    else
+      toy->setChannel(channel, 0, 0, 0);
+}
+
+
+void BufferGraph::render(void)
+{
+  if(!planned)
+    return;
+  GLint draw_fbo, viewport[4];
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+
+  int w = params->render_width > 0 ? params->render_width : 1;
+  int h = params->render_height > 0 ? params->render_height : 1;
+  if(w != texture_w || h != texture_h)
+    allocate(w, h);
+  glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+  glViewport(0, 0, w, h);
+
+  for(size_t idx = 0; idx < order.size(); idx++)
+    {
+      Pass& pass = passes[order[idx]];
+      PassKey key;
+      makeKey(pass, &key);
+      if(pass.skippable && pass.drawn &&
+         !memcmp(&key, &pass.last_key, sizeof(key)))
+        {
+          skips++;
+          continue;
+        }
+
+      //a feedback pass reads slot current and writes the other
+      bindChannels(pass.toy, pass.channels);
+      int target = pass.feedback ? 1 - pass.current : pass.current;
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                             GL_TEXTURE_2D, textures[pass.slots[target]], 0);
+      pass.toy->draw();
+
+      pass.current = target;
+      pass.version++;
+      pass.drawn = true;
+      pass.last_key = key;
+      runs++;
+    }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, draw_fbo);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  bindChannels(image_toy, this->image.channels);
+}
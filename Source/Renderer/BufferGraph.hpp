@@ -0,0 +1,123 @@
+/*******************************************************************************
+*  BufferGraph.hpp - shadertoy-style Buffer A-D passes feeding the image pass  *
+*******************************************************************************/
+
+#ifndef BUFFERGRAPH_HPP_
+#define BUFFERGRAPH_HPP_
+
+#include "GLShader.hpp"
+#include <vector>
+
+//Buffer A-D
+#define BUFFER_PASSES 4
+
+
+//one section of a multi-pass source
+struct PassSource
+{
+  std::string source;           //the common section, then this one
+  int channels[TOY_CHANNELS];   //buffer pass index read by each iChannel, or -1
+};
+
+
+//A multi-pass source is split into sections by lines reading
+//"// pass: <name>", where name is common, bufferA-bufferD (or A-D) or image.
+//Common is prepended to every other pass. Inside a section,
+//"// iChannel<N>: <buffer>" makes iChannelN sample that buffer.
+//
+//A buffer read by a pass that runs after it sees this frame's output; read by
+//itself or by a pass that runs before it, last frame's. Passes run in
+//dependency order, with cycles broken in A-D order. Passes the image pass
+//doesn't depend on aren't run at all.
+//
+//A pass that reads neither iTime, iGlobalTime nor iFrame and doesn't feed back
+//on itself is re-run only when its inputs, resolution, mouse or orientation
+//change; otherwise its last output is reused. Passes read only within the
+//frame they were drawn share textures whenever their lifetimes don't
+//overlap, so a chain A->B->C->image needs two buffers rather than three.
+class BufferGraph
+{
+public:
+  //false, leaving the outputs untouched, for a source without "// pass:"
+  //lines or without an image pass
+  static bool Parse(const std::string& toy_source,
+                    std::vector<PassSource>* buffers, PassSource* image);
+
+  //the image pass's source, or toy_source itself for a single pass shader
+  static std::string ImageSource(const std::string& toy_source);
+
+  //buffers are indexed A-D (empty sources for missing ones); image is the
+  //ShaderToy the image pass is drawn with
+  BufferGraph(const std::vector<PassSource>& buffers, const PassSource& image,
+              ShaderToy* image_toy, RendererParams* params,
+              ShaderToyParams* toy_params);
+  ~BufferGraph(void);
+
+  //builds every buffer pass the image depends on; can be called from a
+  //shared context
+  bool initialize(void);
+
+  //runs the buffer passes that need it and binds the image pass's channels.
+  //The draw framebuffer and viewport are left as they were
+  void render(void);
+
+  unsigned int passCount(void) { return order.size(); }
+  //textures allocated, and how many there would be without sharing
+  unsigned int textureCount(void) { return textures.size(); }
+  unsigned int unsharedTextureCount(void);
+  unsigned long long passesRun(void) { return runs; }
+  unsigned long long passesSkipped(void) { return skips; }
+
+private:
+  //what a pass's output depends on; equal keys mean an equal image
+  struct PassKey
+  {
+    GLint width, height;
+    GLfloat mouse[4];
+    GLfloat orientation;
+    unsigned int input_versions[TOY_CHANNELS];
+  };
+
+  struct Pass
+  {
+    ShaderToy* toy;
+    int channels[TOY_CHANNELS];
+    bool needed;       //the image depends on it
+    bool feedback;     //reads its own last output
+    bool persistent;   //output has to survive into the next frame
+    bool skippable;    //not time-dependent; keeps its own texture
+    bool uses_mouse, uses_orientation;
+    int start, end;    //positions in order it's written and last read
+
+    int slots[2];      //indices into textures; [1] only for feedback
+    int current;       //which of slots has the latest output
+    unsigned int version;
+    bool drawn;
+    PassKey last_key;
+  };
+
+  std::vector<Pass> passes;
+  PassSource image;
+  ShaderToy* image_toy;
+  RendererParams* params;
+  ShaderToyParams* toy_params;
+
+  //buffer indices, in the order they're drawn
+  std::vector<int> order;
+
+  GLuint fbo;
+  std::vector<GLuint> textures;
+  int texture_w, texture_h;
+  bool planned;
+
+  unsigned long long runs, skips;
+
+  void plan(void);
+  void allocate(int w, int h);
+  void releaseTextures(void);
+  GLuint output(int pass) { return textures[passes[pass].slots[passes[pass].current]]; }
+  void bindChannels(ShaderToy* toy, const int* channels);
+  void makeKey(Pass& pass, PassKey* key);
+};
+
+#endif /* BUFFERGRAPH_HPP_ */
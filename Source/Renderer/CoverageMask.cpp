@@ -0,0 +1,270 @@
+/*******************************************************************************
+*  CoverageMask.cpp - limits a ShaderToy draw to the part of the screen that   *
+*                     is actually shown                                        *
+*******************************************************************************/
+
+
+#include "CoverageMask.hpp"
+#include <sstream>
+#include <math.h>
+#include <string.h>
+
+using namespace std;
+
+
+//most segments a circle is split into; fewer are used when they'd already be
+//within half a pixel of the true edge
+#define CIRCLE_MAX_SEGMENTS 256
+#define CIRCLE_MIN_SEGMENTS 16
+
+static const char* coverage_directive = "coverage:";
+
+
+CoverageMask::CoverageMask(void)
+{
+  shape = COVER_FULL;
+  serial = 0;
+}
+
+
+bool CoverageMask::parse(const string& spec)
+{
+  istringstream in(spec);
+  string name;
+  if(!(in >> name))
+    return false;
+
+  vector<float> parsed;
+  float value;
+  while(in >> value)
+    parsed.push_back(value);
+  if(!in.eof())
+    return false;
+
+  if(name == "full" && parsed.empty())
+    shape = COVER_FULL;
+  else if(name == "letterbox" && parsed.size() == 1 && parsed[0] > 0.0f)
+    shape = COVER_LETTERBOX;
+  else if(name == "circle" && parsed.size() == 3 && parsed[2] > 0.0f)
+    shape = COVER_CIRCLE;
+  else if(name == "polygon" && parsed.size() >= 6 && parsed.size() % 2 == 0)
+    shape = COVER_POLYGON;
+  else if(name == "rects" && parsed.size() >= 4 && parsed.size() % 4 == 0)
+    shape = COVER_RECTS;
+  else
+    return false;
+
+  values = parsed;
+  serial++;
+  return true;
+}
+
+bool CoverageMask::FromSource(const string& toy_source, CoverageMask* mask)
+{
+  istringstream in(toy_source);
+  string line;
+  while(getline(in, line))
+    {
+      size_t pos = line.find_first_not_of(" \t");
+      if(pos == string::npos || line.compare(pos, 2, "//"))
+        continue;
+      pos = line.find_first_not_of(" \t", pos + 2);
+      if(pos == string::npos || line.compare(pos, strlen(coverage_directive),
+                                             coverage_directive))
+        continue;
+      return mask->parse(line.substr(pos + strlen(coverage_directive)));
+    }
+  return false;
+}
+
+
+//pixels to NDC
+static void addVertex(float x, float y, int w, int h, vector<GLfloat>* verts)
+{
+  verts->push_back(2.0f * x / w - 1.0f);
+  verts->push_back(2.0f * y / h - 1.0f);
+}
+
+static void addRect(float x0, float y0, float x1, float y1, int w, int h,
+                    vector<GLfloat>* verts)
+{
+  addVertex(x0, y0, w, h, verts);
+  addVertex(x1, y0, w, h, verts);
+  addVertex(x0, y1, w, h, verts);
+  addVertex(x0, y1, w, h, verts);
+  addVertex(x1, y0, w, h, verts);
+  addVertex(x1, y1, w, h, verts);
+}
+
+
+void CoverageMask::build(int w, int h, vector<GLfloat>* verts)
+{
+  verts->clear();
+  switch(shape)
+    {
+    case COVER_LETTERBOX:
+      {
+        float content_w = w, content_h = h;
+        if(values[0] > (float) w / h)
+          content_h = w / values[0];
+        else
+          content_w = h * values[0];
+        float x0 = (w - content_w) / 2, y0 = (h - content_h) / 2;
+        addRect(x0, y0, x0 + content_w, y0 + content_h, w, h, verts);
+        return;
+      }
+    case COVER_CIRCLE:
+      {
+        float cx = values[0] * w, cy = values[1] * h;
+        float r = values[2] * (w < h ? w : h);
+        //circumscribe so the disc is never cut short; enough segments that
+        //the overshoot stays under half a pixel
+        int segments = CIRCLE_MIN_SEGMENTS;
+        while(segments < CIRCLE_MAX_SEGMENTS &&
+              r * (1.0 / cos(M_PI / segments) - 1.0) > 0.5)
+          segments *= 2;
+        float outer = r / cos(M_PI / segments);
+        for(int idx = 0; idx < segments; idx++)
+          {
+            double a0 = 2.0 * M_PI * idx / segments;
+            double a1 = 2.0 * M_PI * (idx + 1) / segments;
+            addVertex(cx, cy, w, h, verts);
+            addVertex(cx + outer * cos(a0), cy + outer * sin(a0), w, h, verts);
+            addVertex(cx + outer * cos(a1), cy + outer * sin(a1), w, h, verts);
+          }
+        return;
+      }
+    case COVER_RECTS:
+      //overlapping rectangles just shade the overlap twice
+      for(size_t idx = 0; idx + 4 <= values.size(); idx += 4)
+        addRect(values[idx] * w, values[idx + 1] * h,
+                (values[idx] + values[idx + 2]) * w,
+                (values[idx + 1] + values[idx + 3]) * h, w, h, verts);
+      return;
+    case COVER_POLYGON:
+      if(triangulate(w, h, verts))
+        return;
+      //not a simple polygon; shade everything rather than guess
+      verts->clear();
+      break;
+    case COVER_FULL:
+      break;
+    }
+  addRect(0, 0, w, h, w, h, verts);
+}
+
+
+static double cross(float ax, float ay, float bx, float by, float cx, float cy)
+{
+  return (double) (bx - ax) * (cy - ay) - (double) (by - ay) * (cx - ax);
+}
+
+//ear clipping; O(n^2) but run only when the mask or target size changes
+bool CoverageMask::triangulate(int w, int h, vector<GLfloat>* verts)
+{
+  size_t count = values.size() / 2;
+  vector<float> xs(count), ys(count);
+  double area = 0.0;
+  for(size_t idx = 0; idx < count; idx++)
+    {
+      xs[idx] = values[2 * idx] * w;
+      ys[idx] = values[2 * idx + 1] * h;
+    }
+  for(size_t idx = 0; idx < count; idx++)
+    area += cross(0, 0, xs[idx], ys[idx], xs[(idx + 1) % count],
+                  ys[(idx + 1) % count]);
+
+  //remaining vertices, counter-clockwise
+  vector<size_t> ring;
+  for(size_t idx = 0; idx < count; idx++)
+    ring.push_back(area >= 0.0 ? idx : count - 1 - idx);
+
+  while(ring.size() > 3)
+    {
+      bool clipped = false;
+      for(size_t idx = 0; idx < ring.size() && !clipped; idx++)
+        {
+          size_t a = ring[(idx + ring.size() - 1) % ring.size()];
+          size_t b = ring[idx];
+          size_t c = ring[(idx + 1) % ring.size()];
+          if(cross(xs[a], ys[a], xs[b], ys[b], xs[c], ys[c]) <= 0.0)
+            continue;
+
+          bool ear = true;
+          for(size_t other = 0; other < ring.size() && ear; other++)
+            {
+              size_t p = ring[other];
+              if(p == a || p == b || p == c)
+                continue;
+              ear = !(cross(xs[a], ys[a], xs[b], ys[b], xs[p], ys[p]) >= 0.0 &&
+                      cross(xs[b], ys[b], xs[c], ys[c], xs[p], ys[p]) >= 0.0 &&
+                      cross(xs[c], ys[c], xs[a], ys[a], xs[p], ys[p]) >= 0.0);
+            }
+          if(!ear)
+            continue;
+
+          addVertex(xs[a], ys[a], w, h, verts);
+          addVertex(xs[b], ys[b], w, h, verts);
+          addVertex(xs[c], ys[c], w, h, verts);
+          ring.erase(ring.begin() + idx);
+          clipped = true;
+        }
+      if(!clipped)
+        return false;
+    }
+  addVertex(xs[ring[0]], ys[ring[0]], w, h, verts);
+  addVertex(xs[ring[1]], ys[ring[1]], w, h, verts);
+  addVertex(xs[ring[2]], ys[ring[2]], w, h, verts);
+  return true;
+}
+
+
+//area of triangle (x,y pairs in NDC) after clipping to the [-1,1] square
+static double clippedArea(const GLfloat* tri)
+{
+  vector<double> poly(tri, tri + 6);
+  for(int edge = 0; edge < 4 && !poly.empty(); edge++)
+    {
+      int axis = edge & 1;
+      double sign = edge < 2 ? 1.0 : -1.0;
+      vector<double> out;
+      size_t n = poly.size() / 2;
+      for(size_t idx = 0; idx < n; idx++)
+        {
+          const double* p = &poly[2 * idx];
+          const double* q = &poly[2 * ((idx + 1) % n)];
+          //inside when sign * coord <= 1
+          double dp = 1.0 - sign * p[axis], dq = 1.0 - sign * q[axis];
+          if(dp >= 0.0)
+            {
+              out.push_back(p[0]);
+              out.push_back(p[1]);
+            }
+          if((dp >= 0.0) != (dq >= 0.0))
+            {
+              double t = dp / (dp - dq);
+              out.push_back(p[0] + t * (q[0] - p[0]));
+              out.push_back(p[1] + t * (q[1] - p[1]));
+            }
+        }
+      poly.swap(out);
+    }
+
+  double area = 0.0;
+  size_t n = poly.size() / 2;
+  for(size_t idx = 0; idx < n; idx++)
+    area += poly[2 * idx] * poly[2 * ((idx + 1) % n) + 1] -
+      poly[2 * ((idx + 1) % n)] * poly[2 * idx + 1];
+  return fabs(area) / 2.0;
+}
+
+double CoverageMask::coverage(int w, int h)
+{
+  vector<GLfloat> verts;
+  build(w, h, &verts);
+  double area = 0.0;
+  for(size_t idx = 0; idx + 6 <= verts.size(); idx += 6)
+    area += clippedArea(&verts[idx]);
+  //the NDC square has area 4
+  return area / 4.0;
+}
@@ -0,0 +1,62 @@
+/*******************************************************************************
+*  CoverageMask.hpp - limits a ShaderToy draw to the part of the screen that   *
+*                     is actually shown                                        *
+*******************************************************************************/
+
+#ifndef COVERAGEMASK_HPP_
+#define COVERAGEMASK_HPP_
+
+#include "GLCommon.hpp"
+#include <vector>
+
+
+//The region a shader is drawn over, as triangles instead of a fullscreen
+//quad: fragments outside it are never rasterized, let alone shaded. Specs:
+//
+//  full                   the whole target (the default)
+//  letterbox A            the largest centered rectangle of aspect ratio A
+//  circle CX CY R         a disc centered at (CX, CY), in 0-1 target
+//                         coordinates from the bottom left, with radius R
+//                         times the target's shorter side
+//  polygon X Y X Y ...    a simple polygon (concave is fine) in 0-1 target
+//                         coordinates
+//  rects X Y W H ...      rectangles, corner and size in 0-1 target
+//                         coordinates from the bottom left; the monitors of
+//                         a window spanning several, say
+//
+//A shader can carry its own spec on a line of its source reading
+//"// coverage: <spec>".
+class CoverageMask
+{
+public:
+  CoverageMask(void);
+
+  //false, leaving the mask unchanged, if spec is malformed
+  bool parse(const std::string& spec);
+
+  //parses the first "// coverage:" line in a shadertoy source, if any
+  static bool FromSource(const std::string& toy_source, CoverageMask* mask);
+
+  bool full(void) { return shape == COVER_FULL; }
+
+  //GL_TRIANGLES, as x,y pairs in normalized device coordinates, covering the
+  //mask on a w x h target
+  void build(int w, int h, std::vector<GLfloat>* verts);
+
+  //fraction of a w x h target the triangles from build() cover
+  double coverage(int w, int h);
+
+  //bumped by every successful parse(), so users know to rebuild
+  unsigned int version(void) { return serial; }
+
+private:
+  enum {COVER_FULL, COVER_LETTERBOX, COVER_CIRCLE, COVER_POLYGON,
+        COVER_RECTS} shape;
+  std::vector<float> values;
+  unsigned int serial;
+
+  //appends triangles for the polygon in values, in target pixels
+  bool triangulate(int w, int h, std::vector<GLfloat>* verts);
+};
+
+#endif /* COVERAGEMASK_HPP_ */
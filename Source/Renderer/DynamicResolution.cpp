@@ -0,0 +1,150 @@
+/*******************************************************************************
+*  DynamicResolution.cpp - renders below window resolution and upscales, with *
+*                          a controller that picks the scale from frame times  *
+*******************************************************************************/
+
+
+#include "DynamicResolution.hpp"
+#include <math.h>
+
+using namespace std;
+
+
+//scales are rounded to this step so small corrections don't reallocate the
+//target every frame
+#define SCALE_STEP 0.05f
+
+//draw time as a fraction of the target above which the scale drops, and
+//below which it may rise
+#define SCALE_DOWN_THRESHOLD 0.95
+#define SCALE_UP_THRESHOLD 0.70
+
+//consecutive frames past a threshold before acting, and frames to wait after
+//any change for the smoothed time to settle
+#define SCALE_DOWN_FRAMES 3
+#define SCALE_UP_FRAMES 30
+#define SCALE_COOLDOWN_FRAMES 15
+
+//weight of the newest sample in the smoothed draw time
+#define SCALE_SMOOTHING 0.2
+
+
+ScaledTarget::ScaledTarget(void)
+{
+  fbo = 0;
+  color_rb = 0;
+  w = h = 0;
+}
+
+ScaledTarget::~ScaledTarget(void)
+{
+  if(fbo)
+    glDeleteFramebuffers(1, &fbo);
+  if(color_rb)
+    glDeleteRenderbuffers(1, &color_rb);
+}
+
+
+void ScaledTarget::bind(int window_w, int window_h, float scale, int* w,
+                        int* h)
+{
+  int want_w = (int) (window_w * scale + 0.5f);
+  int want_h = (int) (window_h * scale + 0.5f);
+  if(want_w < 1)
+    want_w = 1;
+  if(want_h < 1)
+    want_h = 1;
+
+  if(!fbo)
+    {
+      glGenFramebuffers(1, &fbo);
+      glGenRenderbuffers(1, &color_rb);
+    }
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  if(want_w != this->w || want_h != this->h)
+    {
+      this->w = want_w;
+      this->h = want_h;
+      glBindRenderbuffer(GL_RENDERBUFFER, color_rb);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, want_w, want_h);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                GL_RENDERBUFFER, color_rb);
+    }
+  glViewport(0, 0, this->w, this->h);
+  *w = this->w;
+  *h = this->h;
+}
+
+void ScaledTarget::present(GLuint dest_fbo, int window_w, int window_h)
+{
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dest_fbo);
+  glBlitFramebuffer(0, 0, w, h, 0, 0, window_w, window_h,
+                    GL_COLOR_BUFFER_BIT, GL_LINEAR);
+  glBindFramebuffer(GL_FRAMEBUFFER, dest_fbo);
+  glViewport(0, 0, window_w, window_h);
+}
+
+
+
+ResolutionController::ResolutionController(long long target_ns,
+                                           float min_scale, float max_scale)
+{
+  this->target = target_ns;
+  this->min_scale = min_scale;
+  this->max_scale = max_scale;
+  this->current = max_scale;
+  this->average_ns = 0.0;
+  this->over = this->under = this->cooldown = 0;
+  this->change_count = 0;
+}
+
+
+float ResolutionController::update(long long draw_ns)
+{
+  if(draw_ns <= 0)
+    return current;
+  average_ns = average_ns ?
+    average_ns + SCALE_SMOOTHING * (draw_ns - average_ns) : draw_ns;
+
+  if(cooldown)
+    {
+      cooldown--;
+      return current;
+    }
+
+  double load = average_ns / target;
+  over = load > SCALE_DOWN_THRESHOLD ? over + 1 : 0;
+  under = load < SCALE_UP_THRESHOLD ? under + 1 : 0;
+
+  if(over >= SCALE_DOWN_FRAMES && current > min_scale)
+    {
+      //draw time goes with pixel count, i.e. scale squared; aim for the
+      //middle of the band, and always at least a step down
+      float scale = current * sqrt((SCALE_DOWN_THRESHOLD + SCALE_UP_THRESHOLD) /
+                                   (2.0 * load));
+      change(scale < current - SCALE_STEP ? scale : current - SCALE_STEP);
+    }
+  else if(under >= SCALE_UP_FRAMES && current < max_scale)
+    change(current + SCALE_STEP);
+  return current;
+}
+
+void ResolutionController::change(float scale)
+{
+  scale = floorf(scale / SCALE_STEP + 0.5f) * SCALE_STEP;
+  if(scale < min_scale)
+    scale = min_scale;
+  if(scale > max_scale)
+    scale = max_scale;
+  over = under = 0;
+  cooldown = SCALE_COOLDOWN_FRAMES;
+  if(scale == current)
+    return;
+
+  //what we measured was at the old scale; rescale it rather than wait for
+  //fresh samples to wash it out
+  average_ns *= (scale * scale) / (current * current);
+  current = scale;
+  change_count++;
+}
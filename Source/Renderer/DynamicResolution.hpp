@@ -0,0 +1,67 @@
+/*******************************************************************************
+*  DynamicResolution.hpp - renders below window resolution and upscales, with *
+*                          a controller that picks the scale from frame times  *
+*******************************************************************************/
+
+#ifndef DYNAMICRESOLUTION_HPP_
+#define DYNAMICRESOLUTION_HPP_
+
+#include "GLCommon.hpp"
+
+
+//An offscreen color buffer scale times the window's size. The scene is drawn
+//into it and a single linear-filtered blit stretches it over the window.
+class ScaledTarget
+{
+public:
+  ScaledTarget(void);
+  ~ScaledTarget(void);
+
+  //binds the target, (re)allocated for the window size and scale, and sets
+  //the viewport to match. The drawn size is returned in *w, *h
+  void bind(int window_w, int window_h, float scale, int* w, int* h);
+
+  //stretches the target over dest_fbo, which is window_w x window_h, and
+  //leaves dest_fbo bound with the viewport covering it
+  void present(GLuint dest_fbo, int window_w, int window_h);
+
+private:
+  GLuint fbo;
+  GLuint color_rb;
+  int w, h;
+};
+
+
+//Feedback on the time each frame takes to draw (GPU time if available). The
+//scale drops as soon as a few frames in a row run over the target, sized so
+//the pixel count fits the budget, and creeps back up one step at a time only
+//after a longer run of frames well under it. The dead band between the two
+//thresholds and the cooldown after every change keep it from oscillating.
+class ResolutionController
+{
+public:
+  ResolutionController(long long target_ns, float min_scale, float max_scale);
+
+  //feeds one frame's draw time; returns the scale to draw the next frame at
+  float update(long long draw_ns);
+
+  float scale(void) { return current; }
+  unsigned int changes(void) { return change_count; }
+
+private:
+  long long target;
+  float min_scale, max_scale;
+  float current;
+
+  //smoothed draw time
+  double average_ns;
+
+  //consecutive frames above / below the band, and frames left before
+  //another change is allowed
+  int over, under, cooldown;
+  unsigned int change_count;
+
+  void change(float scale);
+};
+
+#endif /* DYNAMICRESOLUTION_HPP_ */
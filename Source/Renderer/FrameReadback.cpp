@@ -0,0 +1,134 @@
+/*******************************************************************************
+*  FrameReadback.cpp - asynchronous framebuffer readback through a ring of     *
+*                      pixel pack buffers                                      *
+*******************************************************************************/
+
+
+#include "FrameReadback.hpp"
+#include <string.h>
+
+using namespace std;
+
+
+PixelPackRing::PixelPackRing(unsigned int depth)
+  : slots(depth < 2 ? 2 : depth)
+{
+  for(size_t idx = 0; idx < slots.size(); idx++)
+    {
+      slots[idx].pbo = 0;
+      slots[idx].fence = 0;
+      slots[idx].tag = 0;
+    }
+  head = 0;
+  in_flight = 0;
+  w = h = 0;
+}
+
+PixelPackRing::~PixelPackRing(void)
+{
+  release();
+}
+
+
+void PixelPackRing::release(void)
+{
+  for(size_t idx = 0; idx < slots.size(); idx++)
+    {
+      if(slots[idx].fence)
+        glDeleteSync(slots[idx].fence);
+      if(slots[idx].pbo)
+        glDeleteBuffers(1, &slots[idx].pbo);
+      slots[idx].pbo = 0;
+      slots[idx].fence = 0;
+    }
+  head = 0;
+  in_flight = 0;
+}
+
+void PixelPackRing::resize(int w, int h)
+{
+  release();
+  this->w = w;
+  this->h = h;
+  for(size_t idx = 0; idx < slots.size(); idx++)
+    {
+      glGenBuffers(1, &slots[idx].pbo);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, slots[idx].pbo);
+      glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes(), 0, GL_STREAM_READ);
+    }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+bool PixelPackRing::queueRead(GLuint fbo, long long tag)
+{
+  if(full() || !slots[0].pbo)
+    return false;
+
+  Slot& slot = slots[(head + in_flight) % slots.size()];
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.tag = tag;
+  in_flight++;
+  return true;
+}
+
+
+readbackresult PixelPackRing::collect(bool wait, unsigned char* dest,
+                                      long long* tag)
+{
+  if(!in_flight)
+    return READBACK_NOT_READY;
+
+  Slot& slot = slots[head];
+  //the flush bit makes sure the fence has actually been submitted, otherwise
+  //waiting on it could block forever
+  GLenum status;
+  do
+    status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                              wait ? 1000000000 : 0);
+  while(wait && status == GL_TIMEOUT_EXPIRED);
+
+  if(status == GL_TIMEOUT_EXPIRED)
+    return READBACK_NOT_READY;
+  if(tag)
+    *tag = slot.tag;
+  //GL_WAIT_FAILED: the read will never be known to be done, so it's given
+  //up rather than left at the head of the ring for ever
+  if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+    {
+      pop();
+      return READBACK_FAILED;
+    }
+
+  void* pixels = 0;
+  if(dest)
+    {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+      pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes(),
+                                GL_MAP_READ_BIT);
+      if(pixels)
+        {
+          memcpy(dest, pixels, frameBytes());
+          glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+  pop();
+  return (!dest || pixels) ? READBACK_DONE : READBACK_FAILED;
+}
+
+void PixelPackRing::pop(void)
+{
+  Slot& slot = slots[head];
+  glDeleteSync(slot.fence);
+  slot.fence = 0;
+  head = (head + 1) % slots.size();
+  in_flight--;
+}
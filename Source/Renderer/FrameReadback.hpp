@@ -0,0 +1,71 @@
+/*******************************************************************************
+*  FrameReadback.hpp - asynchronous framebuffer readback through a ring of     *
+*                      pixel pack buffers                                      *
+*******************************************************************************/
+
+#ifndef FRAMEREADBACK_HPP_
+#define FRAMEREADBACK_HPP_
+
+#include "GLCommon.hpp"
+#include <vector>
+
+
+//what PixelPackRing::collect() did with the oldest read
+typedef enum {
+  READBACK_NOT_READY, //nothing in flight, or the GPU isn't done with it yet
+  READBACK_DONE,      //copied into dest (or discarded) and its slot freed
+  READBACK_FAILED     //the wait or the map failed; its slot is freed all the
+                      //same, and dest holds nothing
+} readbackresult;
+
+//glReadPixels into a bound GL_PIXEL_PACK_BUFFER returns immediately; the copy
+//happens on the GPU behind a fence. Keeping several buffers in flight means a
+//frame's pixels are only mapped once the GPU is done with them, typically a
+//frame or two later, so readback never stalls the frame being drawn.
+class PixelPackRing
+{
+public:
+  PixelPackRing(unsigned int depth);
+  ~PixelPackRing(void);
+
+  //(re)allocates every buffer for w x h RGBA8. Reads in flight are dropped
+  void resize(int w, int h);
+
+  //starts reading the color buffer of fbo into the next free slot; tag is
+  //handed back by collect(). Returns false when every slot is in flight
+  bool queueRead(GLuint fbo, long long tag);
+
+  //copies the oldest read into dest (width*height*4 bytes, bottom row first).
+  //If wait is false and the GPU hasn't finished that read, returns
+  //READBACK_NOT_READY and the read stays queued; otherwise it's taken off
+  //the ring and *tag set, whether or not it succeeded. A null dest discards
+  //the read
+  readbackresult collect(bool wait, unsigned char* dest, long long* tag);
+
+  unsigned int pending(void) { return in_flight; }
+  bool full(void) { return in_flight == slots.size(); }
+  int width(void) { return w; }
+  int height(void) { return h; }
+  size_t frameBytes(void) { return (size_t) w * h * 4; }
+
+private:
+  struct Slot
+  {
+    GLuint pbo;
+    GLsync fence;
+    long long tag;
+  };
+  std::vector<Slot> slots;
+
+  //oldest slot in flight and how many follow it
+  unsigned int head;
+  unsigned int in_flight;
+
+  int w, h;
+
+  void release(void);
+  //frees the oldest slot
+  void pop(void);
+};
+
+#endif /* FRAMEREADBACK_HPP_ */
@@ -0,0 +1,108 @@
+/*******************************************************************************
+*  FrameSink.cpp - writes rendered frames to a file or pipe as raw RGBA or     *
+*                  YUV4MPEG2                                                   *
+*******************************************************************************/
+
+
+#include "FrameSink.hpp"
+#include <string.h>
+
+using namespace std;
+
+
+FrameSink::FrameSink(FILE* out, sinkformat format, int width, int height,
+                     int fps)
+{
+  this->out = out;
+  this->format = format;
+  this->width = width;
+  this->height = height;
+  this->fps = fps;
+  this->header_written = false;
+}
+
+
+bool FrameSink::ParseFormat(const char* name, sinkformat* format)
+{
+  if(!strcmp(name, "rgba") || !strcmp(name, "raw"))
+    *format = SINK_RAW_RGBA;
+  else if(!strcmp(name, "y4m"))
+    *format = SINK_Y4M;
+  else
+    return false;
+  return true;
+}
+
+
+bool FrameSink::writeFrame(const unsigned char* pixels)
+{
+  return format == SINK_Y4M ? writeY4M(pixels) : writeRGBA(pixels);
+}
+
+
+bool FrameSink::writeRGBA(const unsigned char* pixels)
+{
+  //GL rows go bottom-up; write them top-down like every other raw format
+  size_t row_bytes = (size_t) width * 4;
+  for(int y = height - 1; y >= 0; y--)
+    if(fwrite(pixels + y * row_bytes, 1, row_bytes, out) != row_bytes)
+      return false;
+  return true;
+}
+
+
+static inline unsigned char clampByte(int v)
+{
+  return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+bool FrameSink::writeY4M(const unsigned char* pixels)
+{
+  if(!header_written)
+    {
+      fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+              width, height, fps);
+      header_written = true;
+    }
+
+  int cw = (width + 1) / 2, ch = (height + 1) / 2;
+  size_t luma_bytes = (size_t) width * height;
+  size_t chroma_bytes = (size_t) cw * ch;
+  scratch.resize(luma_bytes + 2 * chroma_bytes);
+  unsigned char* Y = &scratch[0];
+  unsigned char* Cb = Y + luma_bytes;
+  unsigned char* Cr = Cb + chroma_bytes;
+
+  //full-range BT.601 in 8.8 fixed point
+  for(int y = 0; y < height; y++)
+    {
+      const unsigned char* src = pixels + (size_t) (height - 1 - y) * width * 4;
+      unsigned char* dst = Y + (size_t) y * width;
+      for(int x = 0; x < width; x++, src += 4)
+        dst[x] = (77 * src[0] + 150 * src[1] + 29 * src[2] + 128) >> 8;
+    }
+
+  //chroma from the average of each 2x2 block (edge pixels repeat)
+  for(int cy = 0; cy < ch; cy++)
+    {
+      int y0 = height - 1 - 2 * cy;
+      int y1 = y0 > 0 ? y0 - 1 : y0;
+      const unsigned char* row0 = pixels + (size_t) y0 * width * 4;
+      const unsigned char* row1 = pixels + (size_t) y1 * width * 4;
+      for(int cx = 0; cx < cw; cx++)
+        {
+          int x0 = 2 * cx * 4;
+          int x1 = (2 * cx + 1 < width) ? x0 + 4 : x0;
+          int r = row0[x0] + row0[x1] + row1[x0] + row1[x1];
+          int g = row0[x0+1] + row0[x1+1] + row1[x0+1] + row1[x1+1];
+          int b = row0[x0+2] + row0[x1+2] + row1[x0+2] + row1[x1+2];
+          //sums are 4x the average, so shift by 10 instead of 8
+          Cb[cy * cw + cx] = clampByte(((-43 * r - 85 * g + 128 * b + 512) >> 10) + 128);
+          Cr[cy * cw + cx] = clampByte(((128 * r - 107 * g - 21 * b + 512) >> 10) + 128);
+        }
+    }
+
+  if(fputs("FRAME\n", out) < 0)
+    return false;
+  return fwrite(&scratch[0], 1, scratch.size(), out) == scratch.size();
+}
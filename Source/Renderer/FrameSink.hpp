@@ -0,0 +1,44 @@
+/*******************************************************************************
+*  FrameSink.hpp - writes rendered frames to a file or pipe as raw RGBA or     *
+*                  YUV4MPEG2                                                   *
+*******************************************************************************/
+
+#ifndef FRAMESINK_HPP_
+#define FRAMESINK_HPP_
+
+#include <stdio.h>
+#include <vector>
+
+
+typedef enum {
+  SINK_RAW_RGBA,  //width*height*4 bytes per frame, top row first
+  SINK_Y4M        //YUV4MPEG2, 4:2:0 full-range BT.601 (C420jpeg)
+} sinkformat;
+
+
+class FrameSink
+{
+public:
+  //out is not closed by the sink
+  FrameSink(FILE* out, sinkformat format, int width, int height, int fps);
+
+  //pixels are RGBA8 as read back from GL, bottom row first
+  bool writeFrame(const unsigned char* pixels);
+
+  //maps "rgba"/"raw" and "y4m"; returns false for anything else
+  static bool ParseFormat(const char* name, sinkformat* format);
+
+private:
+  FILE* out;
+  sinkformat format;
+  int width, height, fps;
+  bool header_written;
+
+  //scratch space for the flipped/converted frame
+  std::vector<unsigned char> scratch;
+
+  bool writeRGBA(const unsigned char* pixels);
+  bool writeY4M(const unsigned char* pixels);
+};
+
+#endif /* FRAMESINK_HPP_ */
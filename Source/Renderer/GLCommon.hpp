@@ -4,10 +4,12 @@
 *  Joshua Slocum                                                      8/23/12  *
 *******************************************************************************/
 
+#ifndef GLCOMMON_HPP_
+#define GLCOMMON_HPP_
 
 #include <GL/glew.h>
 #include <GL/glm.h>
 #include <GL/gl.h>
+#include <string>
 
-
-
+#endif /* GLCOMMON_HPP_ */
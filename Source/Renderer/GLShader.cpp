@@ -0,0 +1,519 @@
+/*******************************************************************************
+*  GLShader.cpp - classes for manipulating gl shaders                          *
+*                                                                              *
+*  Joshua Slocum                                                      8/23/12  *
+*******************************************************************************/
+
+
+#include "GLShader.hpp"
+#include "ProgramCache.hpp"
+#include "BufferGraph.hpp"
+#include <Portability/PublicInterfaces/LoopClock.hpp>
+#include <string.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <ctype.h>
+
+using namespace std;
+
+
+//uniform buffer binding point of the ToyGlobals block
+#define TOY_GLOBALS_BINDING 0
+
+
+static const char* toy_vert_source =
+  "#version 150\n"
+  "in vec2 position;\n"
+  "void main()\n"
+  "{\n"
+  "  gl_Position = vec4(position, 0.0, 1.0);\n"
+  "}\n";
+
+static const char* toy_frag_header =
+  "#version 150\n"
+  "layout(std140) uniform ToyGlobals\n"
+  "{\n"
+  "  vec3 iResolution;\n"
+  "  float iTime;\n"
+  "  vec4 iMouse;\n"
+  "  float iGlobalTime;\n"
+  "  int iFrame;\n"
+  "  float iOrientation;\n"
+  "};\n"
+  "uniform sampler2D iChannel0;\n"
+  "uniform sampler2D iChannel1;\n"
+  "uniform sampler2D iChannel2;\n"
+  "uniform sampler2D iChannel3;\n"
+  "uniform vec3 iChannelResolution[4];\n"
+  "out vec4 toy_FragColor;\n"
+  "#line 1\n";
+
+static const char* toy_frag_footer =
+  "\n"
+  "void main()\n"
+  "{\n"
+  "  mainImage(toy_FragColor, gl_FragCoord.xy);\n"
+  "}\n";
+
+
+ProgramCache* GLProgram::program_cache = 0;
+
+void GLProgram::SetProgramCache(ProgramCache* cache)
+{
+  program_cache = cache;
+}
+
+
+string GLProgram::Specialize(const string& source, const ShaderDefines& defines)
+{
+  if(defines.empty())
+    return source;
+
+  //#version has to stay first; only one opening the source is looked for
+  size_t insert = 0;
+  size_t version = source.find("#version");
+  if(version != string::npos &&
+     source.find_first_not_of(" \t\r\n", 0) == version)
+    {
+      insert = source.find('\n', version);
+      insert = insert == string::npos ? source.size() : insert + 1;
+    }
+  int line = 1;
+  for(size_t pos = 0; pos < insert; pos++)
+    line += source[pos] == '\n';
+
+  stringstream block;
+  if(insert && source[insert - 1] != '\n')
+    block << "\n";
+  for(size_t idx = 0; idx < defines.size(); idx++)
+    block << "#define " << defines[idx].first << " " << defines[idx].second
+          << "\n";
+  block << "#line " << line << "\n";
+  return source.substr(0, insert) + block.str() + source.substr(insert);
+}
+
+
+GLProgram::GLProgram(string vert_source, string frag_source,
+                     RendererParams* params)
+{
+  this->vert_source = vert_source;
+  this->frag_source = frag_source;
+  this->params = params;
+  this->program_id = 0;
+  this->vshader_id = 0;
+  this->fshader_id = 0;
+  this->from_cache = false;
+  this->compile_ns = this->link_ns = 0;
+}
+
+GLProgram::~GLProgram()
+{
+  if(this->program_id)
+    glDeleteProgram(this->program_id);
+  if(this->vshader_id)
+    glDeleteShader(this->vshader_id);
+  if(this->fshader_id)
+    glDeleteShader(this->fshader_id);
+}
+
+
+bool GLProgram::initialize(void)
+{
+  this->info_log.clear();
+  this->from_cache = false;
+  this->compile_ns = this->link_ns = 0;
+  if(this->program_id)
+    glDeleteProgram(this->program_id);
+  this->program_id = 0;
+
+  if(program_cache && program_cache->enabled())
+    {
+      this->program_id = glCreateProgram();
+      if(program_cache->load(this->vert_source, this->frag_source,
+                             this->program_id))
+        {
+          this->from_cache = true;
+          reflect();
+          return true;
+        }
+      glDeleteProgram(this->program_id);
+      this->program_id = 0;
+    }
+
+  //the status queries in compile() and link() wait for the driver
+  long long start = LoopClock::Now();
+  bool compiled = compile();
+  this->compile_ns = LoopClock::Now() - start;
+  if(!compiled)
+    return false;
+  start = LoopClock::Now();
+  bool linked = link();
+  this->link_ns = LoopClock::Now() - start;
+  if(!linked)
+    return false;
+  reflect();
+
+  if(program_cache)
+    program_cache->store(this->vert_source, this->frag_source,
+                         this->program_id);
+  return true;
+}
+
+bool GLProgram::verify(void)
+{
+  if(!this->program_id)
+    return false;
+
+  GLint status;
+  glValidateProgram(this->program_id);
+  glGetProgramiv(this->program_id, GL_VALIDATE_STATUS, &status);
+  return status == GL_TRUE;
+}
+
+
+bool GLProgram::compileShader(GLenum type, const string& source, GLuint* id)
+{
+  const GLchar* src = source.c_str();
+  *id = glCreateShader(type);
+  glShaderSource(*id, 1, &src, 0);
+  glCompileShader(*id);
+
+  GLint status, log_length;
+  glGetShaderiv(*id, GL_COMPILE_STATUS, &status);
+  glGetShaderiv(*id, GL_INFO_LOG_LENGTH, &log_length);
+  if(log_length > 1)
+    {
+      vector<GLchar> log(log_length);
+      glGetShaderInfoLog(*id, log_length, 0, &log[0]);
+      this->info_log += (type == GL_VERTEX_SHADER) ? "vertex: " : "fragment: ";
+      this->info_log += &log[0];
+    }
+  return status == GL_TRUE;
+}
+
+bool GLProgram::compile(void)
+{
+  bool vert_ok = compileShader(GL_VERTEX_SHADER, this->vert_source,
+                               &this->vshader_id);
+  bool frag_ok = compileShader(GL_FRAGMENT_SHADER, this->frag_source,
+                               &this->fshader_id);
+  if(!(vert_ok && frag_ok))
+    cout << "Shader compilation failed:\n" << this->info_log << endl;
+  return vert_ok && frag_ok;
+}
+
+bool GLProgram::link(void)
+{
+  this->program_id = glCreateProgram();
+  glAttachShader(this->program_id, this->vshader_id);
+  glAttachShader(this->program_id, this->fshader_id);
+  if(program_cache && program_cache->enabled())
+    glProgramParameteri(this->program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                        GL_TRUE);
+  glLinkProgram(this->program_id);
+
+  GLint status, log_length;
+  glGetProgramiv(this->program_id, GL_LINK_STATUS, &status);
+  glGetProgramiv(this->program_id, GL_INFO_LOG_LENGTH, &log_length);
+  if(log_length > 1)
+    {
+      vector<GLchar> log(log_length);
+      glGetProgramInfoLog(this->program_id, log_length, 0, &log[0]);
+      this->info_log += "link: ";
+      this->info_log += &log[0];
+    }
+  if(status != GL_TRUE)
+    {
+      cout << "Program link failed:\n" << this->info_log << endl;
+      return false;
+    }
+
+  //the program keeps what it needs; the shader objects can go
+  glDetachShader(this->program_id, this->vshader_id);
+  glDetachShader(this->program_id, this->fshader_id);
+  glDeleteShader(this->vshader_id);
+  glDeleteShader(this->fshader_id);
+  this->vshader_id = this->fshader_id = 0;
+  return true;
+}
+
+void GLProgram::reflect(void)
+{
+  this->active_uniforms.clear();
+  GLint count, max_length;
+  glGetProgramiv(this->program_id, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(this->program_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+  vector<GLchar> name(max_length > 0 ? max_length : 1);
+
+  for(GLuint idx = 0; idx < (GLuint) count; idx++)
+    {
+      ActiveUniform uniform;
+      GLsizei length;
+      glGetActiveUniform(this->program_id, idx, name.size(), &length,
+                         &uniform.size, &uniform.type, &name[0]);
+      uniform.name.assign(&name[0], length);
+      size_t bracket = uniform.name.find('[');
+      if(bracket != string::npos)
+        uniform.name.erase(bracket);
+      glGetActiveUniformsiv(this->program_id, 1, &idx, GL_UNIFORM_BLOCK_INDEX,
+                            &uniform.block);
+      glGetActiveUniformsiv(this->program_id, 1, &idx, GL_UNIFORM_OFFSET,
+                            &uniform.offset);
+      uniform.location = uniform.block < 0 ?
+        glGetUniformLocation(this->program_id, uniform.name.c_str()) : -1;
+      this->active_uniforms.push_back(uniform);
+    }
+}
+
+const ActiveUniform* GLProgram::findUniform(const string& name)
+{
+  for(size_t idx = 0; idx < this->active_uniforms.size(); idx++)
+    if(this->active_uniforms[idx].name == name)
+      return &this->active_uniforms[idx];
+  return 0;
+}
+
+bool GLProgram::use(void)
+{
+  if(!this->program_id)
+    return false;
+  glUseProgram(this->program_id);
+  return true;
+}
+
+
+
+
+ToyUniformBlock::ToyUniformBlock(void)
+{
+  glGenBuffers(1, &this->buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(Std140), 0, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  memset(&this->contents, 0, sizeof(this->contents));
+  this->written = false;
+  this->num_updates = this->num_writes = 0;
+}
+
+ToyUniformBlock::~ToyUniformBlock(void)
+{
+  glDeleteBuffers(1, &this->buffer);
+}
+
+void ToyUniformBlock::update(RendererParams* params, ShaderToyParams* toy_params)
+{
+  Std140 next;
+  memset(&next, 0, sizeof(next));
+  GLfloat seconds = params->current_time_ms / 1000.0f;
+  next.resolution[0] = (GLfloat) params->render_width;
+  next.resolution[1] = (GLfloat) params->render_height;
+  next.resolution[2] = 1.0f;
+  next.time = next.global_time = seconds;
+  //the mouse is tracked in window pixels; iMouse is in fragment coordinates
+  GLfloat mouse_scale = params->window_width ?
+    (GLfloat) params->render_width / params->window_width : 1.0f;
+  for(int idx = 0; idx < 4; idx++)
+    next.mouse[idx] = params->mouse[idx] * mouse_scale;
+  next.frame = params->frame;
+  next.orientation = toy_params->orientation;
+
+  num_updates++;
+  glBindBufferBase(GL_UNIFORM_BUFFER, TOY_GLOBALS_BINDING, this->buffer);
+  if(this->written && !memcmp(&next, &this->contents, sizeof(next)))
+    return;
+  this->contents = next;
+  this->written = true;
+  num_writes++;
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(next), &next);
+}
+
+
+
+ToyUniformBlock* ShaderToy::uniform_block = 0;
+
+void ShaderToy::SetUniformBlock(ToyUniformBlock* block)
+{
+  uniform_block = block;
+}
+
+
+string ShaderToy::WrapFragmentSource(const string& toy_source)
+{
+  return toy_frag_header + toy_source + toy_frag_footer;
+}
+
+ShaderToy::ShaderToy(string frag_source, RendererParams* params,
+                     ShaderToyParams* toy_params)
+  : GLProgram(toy_vert_source,
+              WrapFragmentSource(BufferGraph::ImageSource(frag_source)), params)
+{
+  this->toy_params = toy_params;
+  this->vao = 0;
+  this->vbo = 0;
+  CoverageMask::FromSource(frag_source, &this->mask);
+  this->mask_version = 0;
+  this->mask_w = this->mask_h = 0;
+  this->vertex_count = 0;
+  this->own_block = 0;
+  memset(this->channels, 0, sizeof(this->channels));
+  memset(this->channel_res, 0, sizeof(this->channel_res));
+
+  vector<PassSource> passes;
+  PassSource image;
+  this->graph = BufferGraph::Parse(frag_source, &passes, &image) ?
+    new BufferGraph(passes, image, this, params, toy_params) : 0;
+}
+
+ShaderToy::~ShaderToy(void)
+{
+  delete this->graph;
+  delete this->own_block;
+  if(this->vbo)
+    glDeleteBuffers(1, &this->vbo);
+  if(this->vao)
+    glDeleteVertexArrays(1, &this->vao);
+}
+
+
+bool ShaderToy::initialize(void)
+{
+  if(!GLProgram::initialize())
+    return false;
+
+  GLuint block = glGetUniformBlockIndex(this->program_id, "ToyGlobals");
+  if(block != GL_INVALID_INDEX)
+    glUniformBlockBinding(this->program_id, block, TOY_GLOBALS_BINDING);
+  static const char* channel_names[TOY_CHANNELS] =
+    {"iChannel0", "iChannel1", "iChannel2", "iChannel3"};
+  for(int channel = 0; channel < TOY_CHANNELS; channel++)
+    this->channel_samplers[channel].attach(findUniform(channel_names[channel]));
+  this->channel_resolution.attach(findUniform("iChannelResolution"));
+
+  return !this->graph || this->graph->initialize();
+}
+
+
+void ShaderToy::setChannel(int channel, GLuint texture, int w, int h)
+{
+  this->channels[channel] = texture;
+  this->channel_res[3 * channel] = (GLfloat) w;
+  this->channel_res[3 * channel + 1] = (GLfloat) h;
+  this->channel_res[3 * channel + 2] = 1.0f;
+}
+
+//whether name appears as an identifier in source, comments aside
+static bool mentions(const string& source, size_t from, const string& name)
+{
+  size_t pos = from;
+  while(pos < source.size())
+    {
+      if(!source.compare(pos, 2, "//"))
+        pos = source.find('\n', pos);
+      else if(!source.compare(pos, 2, "/*"))
+        pos = source.find("*/", pos + 2);
+      else if(isalpha(source[pos]) || source[pos] == '_')
+        {
+          size_t end = pos;
+          while(end < source.size() && (isalnum(source[end]) || source[end] == '_'))
+            end++;
+          if(!source.compare(pos, end - pos, name))
+            return true;
+          pos = end;
+          continue;
+        }
+      else
+        pos++;
+      if(pos == string::npos)
+        break;
+    }
+  return false;
+}
+
+bool ShaderToy::uses(const char* uniform)
+{
+  const ActiveUniform* active = findUniform(uniform);
+  if(!active)
+    return false;
+  //std140 block members are all active whether they're read or not, so for
+  //those go by the shader's own source instead
+  return active->block < 0 ||
+    mentions(this->frag_source, strlen(toy_frag_header), uniform);
+}
+
+
+void ShaderToy::draw(void)
+{
+  if(this->graph)
+    this->graph->render();
+  if(!use())
+    return;
+  activateBuffers();
+  setUniforms();
+  //what the mask leaves out would otherwise show whatever was there before
+  if(!this->mask.full())
+    glClear(GL_COLOR_BUFFER_BIT);
+  glDrawArrays(GL_TRIANGLES, 0, this->vertex_count);
+}
+
+
+bool ShaderToy::activateBuffers(void)
+{
+  if(!this->vao)
+    {
+      glGenVertexArrays(1, &this->vao);
+      glBindVertexArray(this->vao);
+      glGenBuffers(1, &this->vbo);
+      glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+
+      GLint position = glGetAttribLocation(this->program_id, "position");
+      glEnableVertexAttribArray(position);
+      glVertexAttribPointer(position, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    }
+  else
+    glBindVertexArray(this->vao);
+
+  //circles depend on the target's aspect, so rebuild on resize too
+  if(!this->vertex_count || this->mask_version != this->mask.version() ||
+     this->mask_w != this->params->render_width ||
+     this->mask_h != this->params->render_height)
+    {
+      this->mask_version = this->mask.version();
+      this->mask_w = this->params->render_width;
+      this->mask_h = this->params->render_height;
+
+      vector<GLfloat> verts;
+      this->mask.build(this->mask_w > 0 ? this->mask_w : 1,
+                       this->mask_h > 0 ? this->mask_h : 1, &verts);
+      glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+      glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(GLfloat), &verts[0],
+                   GL_STATIC_DRAW);
+      this->vertex_count = verts.size() / 2;
+    }
+
+  for(int channel = 0; channel < TOY_CHANNELS; channel++)
+    {
+      glActiveTexture(GL_TEXTURE0 + channel);
+      glBindTexture(GL_TEXTURE_2D, this->channels[channel]);
+    }
+  glActiveTexture(GL_TEXTURE0);
+  return true;
+}
+
+bool ShaderToy::setUniforms(void)
+{
+  ToyUniformBlock* block = uniform_block;
+  if(!block)
+    {
+      if(!this->own_block)
+        this->own_block = new ToyUniformBlock();
+      block = this->own_block;
+    }
+  block->update(this->params, this->toy_params);
+
+  //unit N holds iChannelN; see activateBuffers()
+  for(int channel = 0; channel < TOY_CHANNELS; channel++)
+    this->channel_samplers[channel].set(channel);
+  this->channel_resolution.set(this->channel_res);
+  return true;
+}
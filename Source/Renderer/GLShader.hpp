@@ -4,36 +4,97 @@
 *  Joshua Slocum                                                      8/23/12  *
 *******************************************************************************/
 
+#ifndef GLSHADER_HPP_
+#define GLSHADER_HPP_
 
-#include "GLCommon.h"
+#include "GLCommon.hpp"
+#include "CoverageMask.hpp"
+#include "Uniforms.hpp"
+#include <vector>
+#include <utility>
+
+class ProgramCache;
+class BufferGraph;
+
+//iChannel0-3
+#define TOY_CHANNELS 4
 
 
 struct RendererParams
 {
-  GLuint current_time_ms; 
+  GLuint current_time_ms;
+  GLuint frame;           //frames rendered so far
+  GLint window_width;     //size of the window, in pixels; mouse coordinates
+  GLint window_height;    //are relative to this
+  GLint render_width;     //size actually drawn at (iResolution); differs from
+  GLint render_height;    //the window's when rendering at a reduced scale
+  GLfloat mouse[4];       //shadertoy iMouse: xy = current, zw = click position
 };
 
+//NAME, VALUE pairs compiled into a program as #define NAME VALUE
+typedef std::vector<std::pair<std::string, std::string> > ShaderDefines;
+
 class GLProgram
 {
 public:
-  GLProgram(string vert_source, string frag_source, RendererParams* params)
-  ~GLProgram();
+  GLProgram(std::string vert_source, std::string frag_source,
+            RendererParams* params);
+  virtual ~GLProgram();
 
-  bool initialize(void);
+  //compiles and links the program, or loads it from the program cache when
+  //one is set; the info log is kept on failure
+  virtual bool initialize(void);
   bool verify(void);
-  
+
+  //true when the last initialize() was served from the program cache
+  bool fromCache(void) { return from_cache; }
+
+  //cache used by every program's initialize(); null disables caching
+  static void SetProgramCache(ProgramCache* cache);
+
+  //source with a #define for each of defines after its #version line (at
+  //the top without one), then a #line so the compiler's messages still
+  //count the source's own lines. The defines become part of the source, so
+  //each set is a program (and a program cache entry) of its own
+  static std::string Specialize(const std::string& source,
+                                const ShaderDefines& defines);
+
+  //compiler/linker output from the last initialize()
+  const std::string& getLog(void) { return info_log; }
+
+  //ns the last initialize() spent compiling and linking; 0 for a cache hit.
+  //Drivers that defer work to the first draw leave some of it out
+  long long compileTime(void) { return compile_ns; }
+  long long linkTime(void) { return link_ns; }
+
+  //the linked program's active uniform called name, or null
+  const ActiveUniform* findUniform(const std::string& name);
+
 protected:
   bool compile(void);
   bool link(void);
   bool use(void);
+  //fills active_uniforms from the linked program
+  void reflect(void);
 
   GLuint program_id;
   GLuint vshader_id;
   GLuint fshader_id;
 
+  std::string vert_source;
+  std::string frag_source;
+  std::string info_log;
+  RendererParams* params;
+  bool from_cache;
+  long long compile_ns, link_ns;
+  std::vector<ActiveUniform> active_uniforms;
+
   virtual bool activateBuffers(void) = 0;
   virtual bool setUniforms(void) = 0;
 private:
+  bool compileShader(GLenum type, const std::string& source, GLuint* id);
+
+  static ProgramCache* program_cache;
 };
 
 
@@ -45,18 +106,108 @@ struct ShaderToyParams
 };
 
 
+//The values every ShaderToy of a frame shares, as one std140 uniform block
+//(ToyGlobals) backed by a single buffer: a frame's worth of programs costs
+//one buffer write, made only when a value actually changed, instead of a
+//glUniform call per value per program. The layout has to match the block
+//declared in the ShaderToy fragment header.
+class ToyUniformBlock
+{
+public:
+  //call with a current context
+  ToyUniformBlock(void);
+  ~ToyUniformBlock(void);
+
+  //refreshes the block from the params and binds it for drawing
+  void update(RendererParams* params, ShaderToyParams* toy_params);
+
+  //update() calls, and how many of them wrote to the buffer
+  unsigned long long updates(void) { return num_updates; }
+  unsigned long long writes(void) { return num_writes; }
+
+private:
+  struct Std140
+  {
+    GLfloat resolution[3];  //iResolution
+    GLfloat time;           //iTime
+    GLfloat mouse[4];       //iMouse
+    GLfloat global_time;    //iGlobalTime
+    GLint frame;            //iFrame
+    GLfloat orientation;    //iOrientation
+    GLfloat padding;
+  };
+
+  GLuint buffer;
+  Std140 contents;
+  bool written;
+  unsigned long long num_updates;
+  unsigned long long num_writes;
+};
+
+
 class ShaderToy : public GLProgram
 {
 public:
-  ShaderToy(ShaderToyParams* toy_params);
+  //frag_source is a shadertoy-style fragment shader defining mainImage(),
+  //or several split by "// pass:" lines (see BufferGraph)
+  ShaderToy(std::string frag_source, RendererParams* params,
+            ShaderToyParams* toy_params);
   ~ShaderToy(void);
 
+  //also builds the buffer passes, if there are any
+  bool initialize(void);
+
+  //renders any buffer passes, then this one into the bound framebuffer
   void draw(void);
-  
+
+  //texture sampled as iChannel<channel>, or 0 for none; w x h is reported
+  //through iChannelResolution
+  void setChannel(int channel, GLuint texture, int w, int h);
+
+  //whether the linked program reads the named uniform; ToyGlobals members
+  //count when the source mentions them outside comments
+  bool uses(const char* uniform);
+
+  //null for a single pass shader
+  BufferGraph* buffers(void) { return this->graph; }
+
+  //the region drawn; starts as the source's "// coverage:" spec, if any,
+  //else the full target. Changes take effect on the next draw()
+  CoverageMask* coverage(void) { return &this->mask; }
+
+  //block shared by every ShaderToy's draw(); a ShaderToy drawn with none set
+  //makes its own
+  static void SetUniformBlock(ToyUniformBlock* block);
+
+  //wraps a shadertoy mainImage() shader with the uniform declarations and
+  //main() needed to compile it on its own
+  static std::string WrapFragmentSource(const std::string& toy_source);
+
 protected:
   bool activateBuffers(void);
   bool setUniforms(void);
 
 private:
-  VertexBuffer vb;
+  //triangles covering the mask, built for mask_version at mask_w x mask_h
+  GLuint vao;
+  GLuint vbo;
+  CoverageMask mask;
+  unsigned int mask_version;
+  int mask_w, mask_h;
+  GLsizei vertex_count;
+
+  ShaderToyParams* toy_params;
+
+  GLuint channels[TOY_CHANNELS];
+  GLfloat channel_res[TOY_CHANNELS * 3];
+
+  BufferGraph* graph;
+
+  Uniform<GL_SAMPLER_2D> channel_samplers[TOY_CHANNELS];
+  Uniform<GL_FLOAT_VEC3, TOY_CHANNELS> channel_resolution;
+  ToyUniformBlock* own_block;
+
+  static ToyUniformBlock* uniform_block;
 };
+
+#endif /* GLSHADER_HPP_ */
@@ -0,0 +1,96 @@
+/*******************************************************************************
+*  GpuTimer.cpp - GPU timer queries around the draw and the buffer swap, read  *
+*                 back a few frames late                                       *
+*******************************************************************************/
+
+
+#include "GpuTimer.hpp"
+
+using namespace std;
+
+
+GpuFrameTimer::GpuFrameTimer(unsigned int depth)
+  : slots(depth < 2 ? 2 : depth)
+{
+  head = 0;
+  in_flight = 0;
+  timing = false;
+  skipped_frames = 0;
+
+  //core since 3.3; zero bits means the implementation can't time anything
+  timer_bits = 0;
+  glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &timer_bits);
+  for(size_t idx = 0; idx < slots.size(); idx++)
+    if(supported())
+      glGenQueries(QUERIES_PER_FRAME, slots[idx].queries);
+}
+
+GpuFrameTimer::~GpuFrameTimer(void)
+{
+  if(!supported())
+    return;
+  for(size_t idx = 0; idx < slots.size(); idx++)
+    glDeleteQueries(QUERIES_PER_FRAME, slots[idx].queries);
+}
+
+
+void GpuFrameTimer::beginDraw(void)
+{
+  timing = supported() && in_flight < slots.size();
+  if(!timing)
+    {
+      if(supported())
+        skipped_frames++;
+      return;
+    }
+  glQueryCounter(current().queries[DRAW_BEGIN], GL_TIMESTAMP);
+}
+
+void GpuFrameTimer::endDraw(void)
+{
+  if(timing)
+    glQueryCounter(current().queries[DRAW_END], GL_TIMESTAMP);
+}
+
+void GpuFrameTimer::beginSwap(void)
+{
+  if(timing)
+    glQueryCounter(current().queries[SWAP_BEGIN], GL_TIMESTAMP);
+}
+
+void GpuFrameTimer::endSwap(void)
+{
+  if(!timing)
+    return;
+  glQueryCounter(current().queries[SWAP_END], GL_TIMESTAMP);
+  in_flight++;
+  timing = false;
+}
+
+
+long long GpuFrameTimer::collect(LoopClock* clock)
+{
+  long long draw_ns = 0;
+  while(in_flight)
+    {
+      Slot& slot = slots[head];
+      //queries complete in order, so the last one issued covers the others
+      GLint available = GL_FALSE;
+      glGetQueryObjectiv(slot.queries[SWAP_END], GL_QUERY_RESULT_AVAILABLE,
+                         &available);
+      if(!available)
+        break;
+
+      GLuint64 stamps[QUERIES_PER_FRAME];
+      for(int query = 0; query < QUERIES_PER_FRAME; query++)
+        glGetQueryObjectui64v(slot.queries[query], GL_QUERY_RESULT,
+                              &stamps[query]);
+      draw_ns = (long long) (stamps[DRAW_END] - stamps[DRAW_BEGIN]);
+      clock->RecordGpuTimes(draw_ns,
+                            (long long) (stamps[SWAP_END] - stamps[SWAP_BEGIN]));
+
+      head = (head + 1) % slots.size();
+      in_flight--;
+    }
+  return draw_ns;
+}
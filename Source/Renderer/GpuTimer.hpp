@@ -0,0 +1,65 @@
+/*******************************************************************************
+*  GpuTimer.hpp - GPU timer queries around the draw and the buffer swap, read  *
+*                 back a few frames late                                       *
+*******************************************************************************/
+
+#ifndef GPUTIMER_HPP_
+#define GPUTIMER_HPP_
+
+#include "GLCommon.hpp"
+#include <Portability/PublicInterfaces/LoopClock.hpp>
+#include <vector>
+
+
+//Each frame gets a slot of GL_TIMESTAMP counters either side of the draw and
+//of the swap. Timestamps rather than a GL_TIME_ELAPSED query for the draw,
+//since some drivers (llvmpipe) report a garbage first elapsed time, and a
+//query object can't span the swap anyway. Results are only read
+//once GL_QUERY_RESULT_AVAILABLE says so, normally a frame or two later, so
+//timing never stalls the CPU. If every slot is still waiting the frame just
+//goes untimed.
+class GpuFrameTimer
+{
+public:
+  GpuFrameTimer(unsigned int depth);
+  ~GpuFrameTimer(void);
+
+  //false when the context has no timer queries; every other call is then a
+  //no-op
+  bool supported(void) { return timer_bits > 0; }
+
+  void beginDraw(void);
+  void endDraw(void);
+  void beginSwap(void);
+  void endSwap(void);
+
+  //hands every finished frame, oldest first, to clock->RecordGpuTimes().
+  //Returns the newest frame's draw time, or 0 if none had finished
+  long long collect(LoopClock* clock);
+
+  //frames that went untimed because the ring was full
+  unsigned long long skipped(void) { return skipped_frames; }
+
+private:
+  enum {DRAW_BEGIN, DRAW_END, SWAP_BEGIN, SWAP_END, QUERIES_PER_FRAME};
+
+  struct Slot
+  {
+    GLuint queries[QUERIES_PER_FRAME];
+  };
+  std::vector<Slot> slots;
+
+  //oldest slot in flight and how many follow it
+  unsigned int head;
+  unsigned int in_flight;
+
+  //whether the current frame got a slot
+  bool timing;
+
+  GLint timer_bits;
+  unsigned long long skipped_frames;
+
+  Slot& current(void) { return slots[(head + in_flight) % slots.size()]; }
+};
+
+#endif /* GPUTIMER_HPP_ */
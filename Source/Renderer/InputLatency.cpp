@@ -0,0 +1,172 @@
+/*******************************************************************************
+*  InputLatency.cpp - how long input takes to reach the screen: from an       *
+*                     event's arrival to the swap of the first frame using it  *
+*******************************************************************************/
+
+
+#include "InputLatency.hpp"
+#include <iostream>
+#include <stdint.h>
+
+using namespace std;
+
+
+//server timestamps further behind arrival than this are taken to be on
+//another clock (a remote server, or one not using CLOCK_MONOTONIC)
+#define MAX_DELIVERY_MS 1000
+
+
+InputLatency::InputLatency(bool wait_for_present)
+{
+  this->wait_for_present = wait_for_present;
+  this->swaps = 0;
+  this->press_frame = 0;
+  this->pressed = false;
+}
+
+
+void InputLatency::consumed(const RendererEvent& event, unsigned int frame)
+{
+  if(event.type == SOFTWARE || event.type == NO_EVENT || !event.arrival_ns)
+    return;
+
+  Pending pending;
+  pending.arrival_ns = event.arrival_ns;
+  pending.consumed_ns = LoopClock::Now();
+  pending.begin_ns = pending.swap_ns = 0;
+  pending.swap = 0;
+  pending.frame = frame;
+  pending.motion = event.type == MOUSE_MOVE;
+
+  //X timestamps are 32 bit milliseconds; a local Xorg keeps them on
+  //CLOCK_MONOTONIC, so the low bits of arrival line up with them
+  pending.delivery_ms = -1;
+  if(event.server_time)
+    {
+      int32_t delta = (int32_t) ((uint32_t) (event.arrival_ns / 1000000) -
+                                 (uint32_t) event.server_time);
+      if(delta >= 0 && delta < MAX_DELIVERY_MS)
+        pending.delivery_ms = delta;
+    }
+
+  boost::mutex::scoped_lock guard(this->lock);
+  this->waiting.push_back(pending);
+
+  if(event.type == MOUSE_DOWN || event.type == KEY_DOWN)
+    {
+      this->press_frame = frame;
+      this->pressed = true;
+    }
+}
+
+bool InputLatency::pressedIn(unsigned int frame)
+{
+  boost::mutex::scoped_lock guard(this->lock);
+  return this->pressed && this->press_frame <= frame;
+}
+
+size_t InputLatency::pending(void)
+{
+  boost::mutex::scoped_lock guard(this->lock);
+  return this->waiting.size();
+}
+
+void InputLatency::begin(unsigned int frame)
+{
+  long long now = LoopClock::Now();
+  boost::mutex::scoped_lock guard(this->lock);
+  for(size_t idx = 0; idx < this->waiting.size(); idx++)
+    if(!this->waiting[idx].begin_ns && this->waiting[idx].frame <= frame)
+      this->waiting[idx].begin_ns = now;
+}
+
+void InputLatency::swapped(unsigned int frame, long long swap_ns)
+{
+  boost::mutex::scoped_lock guard(this->lock);
+  this->swaps++;
+  if(this->pressed && this->press_frame <= frame)
+    this->pressed = false;
+
+  size_t kept = 0;
+  for(size_t idx = 0; idx < this->waiting.size(); idx++)
+    {
+      Pending& event = this->waiting[idx];
+      if(!event.swap && event.frame <= frame)
+        {
+          if(!event.begin_ns)
+            event.begin_ns = swap_ns;
+          event.swap_ns = swap_ns;
+          event.swap = this->swaps;
+          if(!this->wait_for_present)
+            {
+              record(event, swap_ns);
+              continue;
+            }
+        }
+      this->waiting[kept++] = event;
+    }
+  this->waiting.resize(kept);
+}
+
+void InputLatency::presented(unsigned long long presents, long long present_ns)
+{
+  boost::mutex::scoped_lock guard(this->lock);
+  size_t kept = 0;
+  for(size_t idx = 0; idx < this->waiting.size(); idx++)
+    {
+      Pending& event = this->waiting[idx];
+      if(event.swap && event.swap <= presents)
+        {
+          //several swaps completing between calls are all put at the
+          //newest's vblank, so this is to within a refresh or so
+          this->displayed.Record(present_ns - event.swap_ns);
+          record(event, present_ns);
+          continue;
+        }
+      this->waiting[kept++] = event;
+    }
+  this->waiting.resize(kept);
+}
+
+
+void InputLatency::record(const Pending& event, long long shown_ns)
+{
+  this->queued.Record(event.consumed_ns - event.arrival_ns);
+  this->paced.Record(event.begin_ns - event.consumed_ns);
+  this->drawn.Record(event.swap_ns - event.begin_ns);
+  this->total[event.motion].Record(shown_ns - event.arrival_ns);
+  if(event.delivery_ms >= 0)
+    this->delivery.Record(event.delivery_ms * 1000000LL);
+}
+
+
+void InputLatency::printLeg(const char* name, TimeHistogram& times)
+{
+  if(!times.Count())
+    return;
+  cout << "  " << name << ": p50 " << times.Percentile(0.5) / 1e6
+       << " ms, p90 " << times.Percentile(0.9) / 1e6 << " ms, p99 "
+       << times.Percentile(0.99) / 1e6 << " ms, max " << times.Max() / 1e6
+       << " ms" << endl;
+}
+
+void InputLatency::print(void)
+{
+  boost::mutex::scoped_lock guard(this->lock);
+  unsigned long long events = this->total[0].Count() + this->total[1].Count();
+  if(!events)
+    {
+      cout << "No input reached the screen to measure latency with" << endl;
+      return;
+    }
+  cout << events << " input events to "
+       << (this->wait_for_present ? "present" : "swap complete") << ":"
+       << endl;
+  printLeg("presses", this->total[0]);
+  printLeg("motion", this->total[1]);
+  printLeg("server to arrival", this->delivery);
+  printLeg("arrival to consumed", this->queued);
+  printLeg("consumed to frame start", this->paced);
+  printLeg("frame start to swap", this->drawn);
+  printLeg("swap to present", this->displayed);
+}
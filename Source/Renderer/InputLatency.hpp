@@ -0,0 +1,90 @@
+/*******************************************************************************
+*  InputLatency.hpp - how long input takes to reach the screen: from an       *
+*                     event's arrival to the swap of the first frame using it  *
+*******************************************************************************/
+
+#ifndef INPUTLATENCY_HPP_
+#define INPUTLATENCY_HPP_
+
+#include <Portability/PublicInterfaces/RendererEvents.hpp>
+#include <Portability/PublicInterfaces/LoopClock.hpp>
+#include <boost/thread.hpp>
+#include <vector>
+
+
+//Each event's latency is split into legs, so a slow total can be pinned on
+//the queue (arrival to being consumed), on pacing (consumed to the frame
+//using it starting), on drawing (that frame's start to its swap) or on the
+//display (swap to scanout, with present timing). A swap only counts once it
+//has completed: when presented() says so if the backend has present timing,
+//otherwise swapped() is taken as completion, so the caller has to make sure
+//it is (glFinish()). Motion is kept apart from clicks and keys, since it's
+//what coalescing delays.
+//Frames are identified by any count that only goes up, as long as an event
+//is consumed with the number of the first frame that can show it. With a
+//render thread that's the input snapshot the frame drew from, so consumed()
+//may be called on the input thread while the render thread calls the rest.
+class InputLatency
+{
+public:
+  //with wait_for_present, events are only recorded once presented() says
+  //their frame reached the display
+  InputLatency(bool wait_for_present);
+
+  //input event applied to frame, the next to be drawn; anything that isn't
+  //input is ignored
+  void consumed(const RendererEvent& event, unsigned int frame);
+
+  //true if frame is the first to show a button or key press; for the flash
+  //test pattern
+  bool pressedIn(unsigned int frame);
+
+  //frame, and whatever it consumed, starts drawing now
+  void begin(unsigned int frame);
+
+  //frame's swap was issued, or completed without present timing, at
+  //swap_ns. Frames are swapped in order
+  void swapped(unsigned int frame, long long swap_ns);
+
+  //presents swaps since the first swapped() call have been shown, the
+  //newest at present_ns
+  void presented(unsigned long long presents, long long present_ns);
+
+  //events still waiting on their frame
+  size_t pending(void);
+
+  void print(void);
+
+private:
+  struct Pending
+  {
+    long long arrival_ns;
+    long long consumed_ns;
+    long long begin_ns;          //0 until the frame starts
+    long long swap_ns;           //0 until the frame is swapped
+    unsigned long long swap;     //1-based swap that shows it, 0 until known
+    unsigned int frame;
+    bool motion;
+    int delivery_ms;             //server timestamp to arrival, -1 if unknown
+  };
+  //guards everything below
+  boost::mutex lock;
+  std::vector<Pending> waiting;
+
+  bool wait_for_present;
+  unsigned long long swaps;
+  unsigned int press_frame;
+  bool pressed;
+
+  TimeHistogram queued;          //arrival to consumed
+  TimeHistogram paced;           //consumed to the frame starting
+  TimeHistogram drawn;           //frame start to swap
+  TimeHistogram displayed;       //swap to present, with present timing
+  TimeHistogram total[2];        //arrival to shown: presses, motion
+  TimeHistogram delivery;        //server timestamp to arrival, in whole ms
+
+  void record(const Pending& event, long long shown_ns);
+  static void printLeg(const char* name, TimeHistogram& times);
+};
+
+#endif /* INPUTLATENCY_HPP_ */
@@ -0,0 +1,173 @@
+/*******************************************************************************
+*  ProgramCache.cpp - on-disk cache of linked program binaries                 *
+*******************************************************************************/
+
+
+#include "ProgramCache.hpp"
+#include <Portability/PublicInterfaces/CacheFiles.hpp>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+//file layout: header, then `length` bytes of binary in `format`
+struct CacheHeader
+{
+  char magic[4];
+  GLuint version;
+  GLenum format;
+  GLint length;
+};
+
+static const char cache_magic[4] = { 'S', 'T', 'P', 'B' };
+static const GLuint cache_version = 1;
+
+
+//64-bit FNV-1a; collisions only cost a failed link and a recompile
+static unsigned long long fnv1a(const string& data, unsigned long long hash)
+{
+  for(size_t idx = 0; idx < data.size(); idx++)
+    {
+      hash ^= (unsigned char) data[idx];
+      hash *= 1099511628211ULL;
+    }
+  return hash;
+}
+
+
+string ProgramCache::DefaultDirectory(void)
+{
+  const char* dir = getenv("SHADERTOY_CACHE_DIR");
+  if(dir && *dir)
+    return dir;
+  dir = getenv("XDG_CACHE_HOME");
+  if(dir && *dir)
+    return string(dir) + "/shadertoy";
+  dir = getenv("HOME");
+  return string(dir ? dir : "/tmp") + "/.cache/shadertoy";
+}
+
+
+ProgramCache::ProgramCache(const string& directory)
+{
+  this->directory = directory;
+  this->num_hits = 0;
+  this->num_misses = 0;
+
+  GLint num_formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+  this->usable = num_formats > 0;
+  if(!this->usable)
+    {
+      cout << "Driver has no program binary formats; program cache disabled"
+           << endl;
+      return;
+    }
+
+  vector<GLint> formats(num_formats);
+  glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, &formats[0]);
+
+  stringstream id;
+  id << glGetString(GL_RENDERER) << '\n' << glGetString(GL_VERSION) << '\n';
+  for(GLint idx = 0; idx < num_formats; idx++)
+    id << formats[idx] << ' ';
+  this->driver_id = id.str();
+
+  MakeDirectories(directory);
+}
+
+
+string ProgramCache::pathFor(const string& vert_source,
+                             const string& frag_source)
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  hash = fnv1a(this->driver_id, hash);
+  hash = fnv1a(vert_source, hash);
+  //separator so moving text between the two sources changes the key
+  hash = fnv1a(string(1, '\0'), hash);
+  hash = fnv1a(frag_source, hash);
+
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.bin", hash);
+  return this->directory + name;
+}
+
+
+bool ProgramCache::load(const string& vert_source, const string& frag_source,
+                        GLuint program)
+{
+  if(!this->usable)
+    return false;
+
+  string path = pathFor(vert_source, frag_source);
+  boost::mutex::scoped_lock guard(this->lock);
+  FILE* fp = fopen(path.c_str(), "rb");
+  if(!fp)
+    {
+      this->num_misses++;
+      return false;
+    }
+
+  CacheHeader header;
+  vector<char> binary;
+  bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+    !memcmp(header.magic, cache_magic, sizeof(cache_magic)) &&
+    header.version == cache_version && header.length > 0;
+  if(ok)
+    {
+      binary.resize(header.length);
+      ok = fread(&binary[0], 1, header.length, fp) == (size_t) header.length;
+    }
+  fclose(fp);
+
+  GLint status = GL_FALSE;
+  if(ok)
+    {
+      glProgramBinary(program, header.format, &binary[0], header.length);
+      glGetProgramiv(program, GL_LINK_STATUS, &status);
+    }
+
+  if(status != GL_TRUE)
+    {
+      //truncated, or the driver no longer accepts it
+      cout << "Discarding stale program binary " << path << endl;
+      unlink(path.c_str());
+      this->num_misses++;
+      return false;
+    }
+
+  this->num_hits++;
+  return true;
+}
+
+
+bool ProgramCache::store(const string& vert_source, const string& frag_source,
+                         GLuint program)
+{
+  if(!this->usable)
+    return false;
+
+  CacheHeader header;
+  memcpy(header.magic, cache_magic, sizeof(cache_magic));
+  header.version = cache_version;
+  header.length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+  if(header.length <= 0)
+    return false;
+
+  vector<char> binary(header.length);
+  glGetProgramBinary(program, header.length, 0, &header.format, &binary[0]);
+
+  //written whole beside the entry and renamed over it, see ReplaceFile
+  string contents(reinterpret_cast<const char*>(&header), sizeof(header));
+  contents.append(&binary[0], header.length);
+  string path = pathFor(vert_source, frag_source);
+  boost::mutex::scoped_lock guard(this->lock);
+  return ReplaceFile(path, contents);
+}
@@ -0,0 +1,57 @@
+/*******************************************************************************
+*  ProgramCache.hpp - on-disk cache of linked program binaries                 *
+*******************************************************************************/
+
+#ifndef PROGRAMCACHE_HPP_
+#define PROGRAMCACHE_HPP_
+
+#include "GLCommon.hpp"
+#include <boost/thread.hpp>
+
+
+//Stores glGetProgramBinary blobs under a directory, one file per program.
+//The file name is a hash of both shader sources plus GL_RENDERER, GL_VERSION
+//and the driver's list of binary formats, so a driver update or a different
+//GPU never sees another's binaries. A blob the driver refuses to link is
+//deleted and reported as a miss, and the caller compiles from source.
+//load() and store() may be called from several threads at once (one render
+//thread per output, shader reloaders), each with its own current context.
+class ProgramCache
+{
+public:
+  //call with a current context; directory is created if needed
+  ProgramCache(const std::string& directory);
+
+  //false when the driver exposes no program binary formats
+  bool enabled(void) { return usable; }
+
+  //links program from a cached binary; returns false on a miss
+  bool load(const std::string& vert_source, const std::string& frag_source,
+            GLuint program);
+
+  //saves the binary of a successfully linked program
+  bool store(const std::string& vert_source, const std::string& frag_source,
+             GLuint program);
+
+  //$SHADERTOY_CACHE_DIR, else $XDG_CACHE_HOME/shadertoy, else
+  //~/.cache/shadertoy
+  static std::string DefaultDirectory(void);
+
+  unsigned int hits(void) { return num_hits; }
+  unsigned int misses(void) { return num_misses; }
+
+private:
+  //held over a load's or store's file and counter updates
+  boost::mutex lock;
+  std::string directory;
+  std::string driver_id;  //renderer, version and binary formats
+  bool usable;
+
+  unsigned int num_hits;
+  unsigned int num_misses;
+
+  std::string pathFor(const std::string& vert_source,
+                      const std::string& frag_source);
+};
+
+#endif /* PROGRAMCACHE_HPP_ */
@@ -0,0 +1,223 @@
+/*******************************************************************************
+*  ScreenCapture.cpp - services RENDERER_SCREENCAPTURE without stalling the    *
+*                      render loop                                             *
+*******************************************************************************/
+
+
+#include "ScreenCapture.hpp"
+#include <iostream>
+#include <stdio.h>
+#include <png.h>
+
+using namespace std;
+
+
+ScreenCapture::ScreenCapture(unsigned int readback_depth,
+                             unsigned int queue_depth)
+  : ring(readback_depth)
+{
+  this->queue_depth = queue_depth ? queue_depth : 1;
+  //one extra so the writer can hold a job while the queue is full
+  for(unsigned int idx = 0; idx <= this->queue_depth; idx++)
+    free_jobs.push_back(new Job());
+  writing = false;
+  stopping = false;
+  num_captured = 0;
+  num_dropped = 0;
+  writer = boost::thread(&ScreenCapture::writerLoop, this);
+}
+
+ScreenCapture::~ScreenCapture(void)
+{
+  //anything still in the ring was already requested, so finish it
+  while(ring.pending())
+    collectOne(true);
+
+  {
+    boost::mutex::scoped_lock guard(lock);
+    stopping = true;
+    work_ready.notify_all();
+  }
+  writer.join();
+
+  for(size_t idx = 0; idx < free_jobs.size(); idx++)
+    delete free_jobs[idx];
+  for(size_t idx = 0; idx < queue.size(); idx++)
+    delete queue[idx];
+}
+
+
+void ScreenCapture::request(const string& path)
+{
+  boost::mutex::scoped_lock guard(lock);
+  requested.push_back(path);
+}
+
+bool ScreenCapture::busy(void)
+{
+  boost::mutex::scoped_lock guard(lock);
+  return !requested.empty() || ring.pending() || !queue.empty() || writing;
+}
+
+
+void ScreenCapture::service(GLuint fbo, int w, int h)
+{
+  string path;
+  bool wanted;
+  {
+    boost::mutex::scoped_lock guard(lock);
+    wanted = !requested.empty();
+    if(wanted)
+      {
+        path = requested.front();
+        requested.pop_front();
+      }
+  }
+  if(!wanted && !ring.pending())
+    return;
+
+  long long start = LoopClock::Now();
+
+  if(w != ring.width() || h != ring.height())
+    {
+      while(ring.pending())
+        collectOne(true);
+      ring.resize(w, h);
+    }
+
+  //hand off whatever the GPU has finished with
+  while(ring.pending())
+    {
+      unsigned int before = ring.pending();
+      collectOne(false);
+      if(ring.pending() == before)
+        break;
+    }
+
+  if(wanted)
+    {
+      //with every slot in flight the oldest read is a couple of frames old
+      //and almost certainly done, so this wait is short
+      if(ring.full())
+        collectOne(true);
+      ring.queueRead(fbo, 0);
+      reading.push_back(path);
+    }
+
+  service_times.Record(LoopClock::Now() - start);
+}
+
+
+void ScreenCapture::collectOne(bool wait)
+{
+  Job* job = 0;
+  {
+    boost::mutex::scoped_lock guard(lock);
+    if(!free_jobs.empty())
+      {
+        job = free_jobs.back();
+        free_jobs.pop_back();
+      }
+  }
+
+  if(job)
+    job->pixels.resize(ring.frameBytes());
+  readbackresult result = ring.collect(wait, job ? &job->pixels[0] : 0, 0);
+  if(result == READBACK_NOT_READY)
+    {
+      //put the job back for next frame
+      if(job)
+        {
+          boost::mutex::scoped_lock guard(lock);
+          free_jobs.push_back(job);
+        }
+      return;
+    }
+
+  //the read is off the ring either way, so its path goes with it
+  string path = reading.front();
+  reading.pop_front();
+  if(!job || result == READBACK_FAILED)
+    {
+      num_dropped++;
+      cout << (job ? "Screen capture readback failed, dropped " :
+               "Screen capture queue full, dropped ") << path << endl;
+      if(job)
+        {
+          boost::mutex::scoped_lock guard(lock);
+          free_jobs.push_back(job);
+        }
+      return;
+    }
+
+  job->path = path;
+  job->w = ring.width();
+  job->h = ring.height();
+
+  boost::mutex::scoped_lock guard(lock);
+  queue.push_back(job);
+  work_ready.notify_one();
+}
+
+
+void ScreenCapture::writerLoop(void)
+{
+  boost::mutex::scoped_lock guard(lock);
+  for(;;)
+    {
+      while(queue.empty() && !stopping)
+        work_ready.wait(guard);
+      if(queue.empty())
+        break;
+
+      Job* job = queue.front();
+      queue.pop_front();
+      writing = true;
+
+      guard.unlock();
+      bool ok = WritePNG(job);
+      guard.lock();
+
+      writing = false;
+      if(ok)
+        num_captured++;
+      else
+        cout << "Failed to write screen capture " << job->path << endl;
+      free_jobs.push_back(job);
+    }
+}
+
+
+bool ScreenCapture::WritePNG(const Job* job)
+{
+  FILE* fp = fopen(job->path.c_str(), "wb");
+  if(!fp)
+    return false;
+
+  png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0);
+  png_infop info = png ? png_create_info_struct(png) : 0;
+  if(!info || setjmp(png_jmpbuf(png)))
+    {
+      png_destroy_write_struct(&png, info ? &info : 0);
+      fclose(fp);
+      return false;
+    }
+
+  png_init_io(png, fp);
+  //captures are frequent and big; trade a little size for a lot of speed
+  png_set_compression_level(png, 1);
+  png_set_filter(png, 0, PNG_FILTER_SUB);
+  png_set_IHDR(png, info, job->w, job->h, 8, PNG_COLOR_TYPE_RGB_ALPHA,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+               PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png, info);
+
+  //GL rows are bottom-up
+  size_t row_bytes = (size_t) job->w * 4;
+  for(int y = job->h - 1; y >= 0; y--)
+    png_write_row(png, (png_const_bytep) &job->pixels[y * row_bytes]);
+
+  png_write_end(png, 0);
+  png_destroy_write_struct(&png, &info);
+  return fclose(fp) == 0;
+}
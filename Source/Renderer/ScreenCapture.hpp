@@ -0,0 +1,81 @@
+/*******************************************************************************
+*  ScreenCapture.hpp - services RENDERER_SCREENCAPTURE without stalling the    *
+*                      render loop                                             *
+*******************************************************************************/
+
+#ifndef SCREENCAPTURE_HPP_
+#define SCREENCAPTURE_HPP_
+
+#include "GLCommon.hpp"
+#include "FrameReadback.hpp"
+#include <Portability/PublicInterfaces/LoopClock.hpp>
+#include <deque>
+#include <vector>
+#include <boost/thread.hpp>
+
+
+//Captures are read back through a PixelPackRing and handed to a writer thread
+//that does the PNG encode and the file write. The only work left on the render
+//thread is queuing glReadPixels and one memcpy out of a mapped buffer a frame
+//or two later. The writer queue is bounded: if the disk can't keep up, new
+//captures are dropped (and counted) rather than letting memory grow or the
+//render thread block.
+class ScreenCapture
+{
+public:
+  ScreenCapture(unsigned int readback_depth, unsigned int queue_depth);
+
+  //writes out everything already captured before returning
+  ~ScreenCapture(void);
+
+  //captures the next frame passed to service() to path (PNG). May be
+  //called from any thread
+  void request(const std::string& path);
+
+  //call once per frame after drawing into fbo and before swapping
+  void service(GLuint fbo, int w, int h);
+
+  bool busy(void);
+
+  unsigned long captured(void) { return num_captured; }
+  unsigned long dropped(void) { return num_dropped; }
+
+  //render-thread cost of each service() call that did any work
+  TimeHistogram& serviceTimes(void) { return service_times; }
+
+private:
+  struct Job
+  {
+    std::string path;
+    int w, h;
+    std::vector<unsigned char> pixels;
+  };
+
+  PixelPackRing ring;
+
+  //read but not yet collected
+  std::deque<std::string> reading;
+
+  //requested but not yet read, and the writer thread state, guarded by lock
+  boost::mutex lock;
+  std::deque<std::string> requested;
+  boost::condition_variable work_ready;
+  std::deque<Job*> queue;
+  std::vector<Job*> free_jobs;
+  unsigned int queue_depth;
+  bool writing;
+  bool stopping;
+  boost::thread writer;
+
+  unsigned long num_captured;
+  unsigned long num_dropped;
+  TimeHistogram service_times;
+
+  //moves the oldest read into the writer queue (or drops it)
+  void collectOne(bool wait);
+
+  void writerLoop(void);
+  static bool WritePNG(const Job* job);
+};
+
+#endif /* SCREENCAPTURE_HPP_ */
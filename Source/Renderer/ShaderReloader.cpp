@@ -0,0 +1,226 @@
+/*******************************************************************************
+*  ShaderReloader.cpp - rebuilds the ShaderToy program when its source file    *
+*                       changes, without stalling the render loop              *
+*******************************************************************************/
+
+
+#include "ShaderReloader.hpp"
+#include "ShaderVariants.hpp"
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+using namespace std;
+
+
+//editors save in several writes (or write, then rename); wait this long after
+//the first event so we compile the finished file once
+#define RELOAD_SETTLE_MS 50
+
+
+ShaderReloader::ShaderReloader(OpenGLManager* manager, const string& path,
+                               RendererParams* params,
+                               ShaderToyParams* toy_params)
+{
+  this->manager = manager;
+  this->shared = 0;
+  this->path = path;
+  this->params = params;
+  this->toy_params = toy_params;
+  this->inotify_fd = -1;
+  this->quality.store(0);
+  this->change_pending = false;
+  this->stopping = false;
+  this->ready = 0;
+  this->ready_fence = 0;
+  this->ready_tier = -1;
+  this->ready_fallback = false;
+
+  size_t slash = path.rfind('/');
+  this->directory = (slash == string::npos) ? "." : path.substr(0, slash + 1);
+  this->name = (slash == string::npos) ? path : path.substr(slash + 1);
+}
+
+ShaderReloader::~ShaderReloader(void)
+{
+  if(this->worker.joinable())
+    {
+      {
+        boost::mutex::scoped_lock guard(this->lock);
+        this->stopping = true;
+        this->changed.notify_all();
+      }
+      this->worker.join();
+    }
+
+  if(this->ready)
+    {
+      glDeleteSync(this->ready_fence);
+      delete this->ready;
+    }
+  delete this->shared;
+
+  if(this->inotify_fd >= 0)
+    {
+      this->manager->UnwatchFd(this->inotify_fd);
+      close(this->inotify_fd);
+    }
+}
+
+
+bool ShaderReloader::start(void)
+{
+  this->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(this->inotify_fd < 0 ||
+     inotify_add_watch(this->inotify_fd, this->directory.c_str(),
+                       IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0 ||
+     !this->manager->WatchFd(this->inotify_fd, this))
+    {
+      cout << "Unable to watch " << this->path << " for changes" << endl;
+      return false;
+    }
+
+  this->shared = this->manager->CreateSharedContext();
+  if(!this->shared)
+    return false;
+
+  this->worker = boost::thread(&ShaderReloader::workerLoop, this);
+  return true;
+}
+
+
+void ShaderReloader::FdReady(int fd)
+{
+  //aligned as the inotify man page asks
+  char buffer[4096]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  bool ours = false;
+
+  ssize_t length;
+  while((length = read(fd, buffer, sizeof(buffer))) > 0)
+    for(char* ptr = buffer; ptr < buffer + length; )
+      {
+        struct inotify_event* event = (struct inotify_event*) ptr;
+        if(event->len && this->name == event->name)
+          ours = true;
+        ptr += sizeof(struct inotify_event) + event->len;
+      }
+
+  if(ours)
+    {
+      boost::mutex::scoped_lock guard(this->lock);
+      this->change_pending = true;
+      this->changed.notify_one();
+    }
+}
+
+
+ShaderToy* ShaderReloader::takeReady(string* source, int* tier,
+                                     bool* fallback)
+{
+  boost::mutex::scoped_lock guard(this->lock);
+  if(!this->ready)
+    return 0;
+
+  //linked on the worker's context; only hand it over once the GPU is done
+  //with it so the first draw can't wait on the compile
+  GLenum status = glClientWaitSync(this->ready_fence, 0, 0);
+  if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+    return 0;
+
+  glDeleteSync(this->ready_fence);
+  ShaderToy* toy = this->ready;
+  source->swap(this->ready_source);
+  *tier = this->ready_tier;
+  *fallback = this->ready_fallback;
+  this->ready = 0;
+  this->ready_fence = 0;
+  return toy;
+}
+
+
+void ShaderReloader::workerLoop(void)
+{
+  if(!this->shared->MakeCurrent())
+    {
+      cout << "Unable to make the shader reload context current" << endl;
+      return;
+    }
+
+  for(;;)
+    {
+      {
+        boost::mutex::scoped_lock guard(this->lock);
+        while(!this->change_pending && !this->stopping)
+          this->changed.wait(guard);
+        if(this->stopping)
+          break;
+      }
+
+      boost::this_thread::sleep(boost::posix_time::milliseconds(RELOAD_SETTLE_MS));
+      {
+        boost::mutex::scoped_lock guard(this->lock);
+        this->change_pending = false;
+      }
+
+      ifstream in(this->path.c_str());
+      if(!in)
+        continue;
+      stringstream source;
+      source << in.rdbuf();
+
+      //with tiers, the one being drawn is built here rather than by the
+      //render thread's ShaderVariants once it's handed over
+      vector<ShaderVariant> variants;
+      int tier = -1;
+      string built_source = source.str();
+      if(ShaderVariants::Parse(built_source, &variants))
+        {
+          tier = max(0, min(this->quality.load(), (int) variants.size() - 1));
+          built_source = ShaderVariants::Source(built_source, variants[tier]);
+        }
+
+      ShaderToy* toy = new ShaderToy(built_source, this->params,
+                                     this->toy_params);
+      bool ok = toy->initialize();
+      bool fallback = false;
+      //as ShaderVariants does, a tier that doesn't build falls back to the
+      //source as written
+      if(!ok && tier >= 0)
+        {
+          cout << "Variant " << variants[tier].name << " of " << this->path
+               << " failed to build; trying it as written" << endl;
+          delete toy;
+          toy = new ShaderToy(source.str(), this->params, this->toy_params);
+          ok = toy->initialize();
+          fallback = true;
+        }
+      if(!ok)
+        {
+          cout << "Reload of " << this->path
+               << " failed; keeping the running shader" << endl;
+          delete toy;
+          continue;
+        }
+      GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      glFlush();
+
+      boost::mutex::scoped_lock guard(this->lock);
+      //an older rebuild the render thread never picked up is superseded
+      if(this->ready)
+        {
+          glDeleteSync(this->ready_fence);
+          delete this->ready;
+        }
+      this->ready = toy;
+      this->ready_fence = fence;
+      this->ready_source = source.str();
+      this->ready_tier = tier;
+      this->ready_fallback = fallback;
+    }
+
+  this->shared->Release();
+}
@@ -0,0 +1,78 @@
+/*******************************************************************************
+*  ShaderReloader.hpp - rebuilds the ShaderToy program when its source file    *
+*                       changes, without stalling the render loop              *
+*******************************************************************************/
+
+#ifndef SHADERRELOADER_HPP_
+#define SHADERRELOADER_HPP_
+
+#include "GLShader.hpp"
+#include <Portability/PublicInterfaces/OpenGLManager.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+
+
+//Watches the shader's directory with inotify (editors often save by renaming
+//a temp file over the original, which a watch on the file itself would lose)
+//through the manager's epoll set. Changes are compiled and linked on a worker
+//thread with its own shared context; the render thread only picks up the new
+//program once it has linked and the GPU has finished with it. A source with
+//"// variant:" tiers is built specialized for the tier being drawn (see
+//setQuality()), so switching to it costs the render thread nothing either. A
+//source that fails to compile is reported and the current program keeps
+//running.
+class ShaderReloader : public FdWatcher
+{
+public:
+  ShaderReloader(OpenGLManager* manager, const std::string& path,
+                 RendererParams* params, ShaderToyParams* toy_params);
+  ~ShaderReloader(void);
+
+  //call from the render thread; false if the file can't be watched or the
+  //platform can't share contexts
+  bool start(void);
+
+  //called on the thread waiting on the manager, which may not be the render
+  //thread; it only reads inotify_fd and flags the worker under lock
+  void FdReady(int fd);
+
+  //the ShaderVariants tier the render thread is drawing; rebuilds of a
+  //source with tiers are specialized for it. Any thread
+  void setQuality(int tier) { this->quality.store(tier); }
+
+  //a rebuilt program ready to draw with, or null. The caller owns it and
+  //should swap it in place of (and delete) the current one. *source is set
+  //to the file's text it was built from, and *tier to the variant it was
+  //specialized for, or -1 when the source has none. *fallback is set when
+  //that variant didn't build and the toy is the source as written
+  ShaderToy* takeReady(std::string* source, int* tier, bool* fallback);
+
+private:
+  OpenGLManager* manager;
+  SharedGLContext* shared;
+  std::string path;
+  std::string directory;
+  std::string name;
+  RendererParams* params;
+  ShaderToyParams* toy_params;
+
+  int inotify_fd;
+  boost::atomic<int> quality;
+
+  //guarded by lock
+  boost::mutex lock;
+  boost::condition_variable changed;
+  bool change_pending;
+  bool stopping;
+  ShaderToy* ready;
+  GLsync ready_fence;
+  std::string ready_source;
+  int ready_tier;
+  bool ready_fallback;
+
+  boost::thread worker;
+
+  void workerLoop(void);
+};
+
+#endif /* SHADERRELOADER_HPP_ */
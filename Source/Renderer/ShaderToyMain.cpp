@@ -1,9 +1,1502 @@
+/*******************************************************************************
+*  ShaderToyMain.cpp - runs a shadertoy fragment shader in a window, or        *
+*                      offline into a file/pipe                                *
+*                                                                              *
+*  Joshua Slocum                                                      8/23/12  *
+*******************************************************************************/
 
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <Portability/PublicInterfaces/OpenGLManager.hpp>
+#include <Portability/PublicInterfaces/RendererEvents.hpp>
+#include <Portability/PublicInterfaces/LoopClock.hpp>
+#include <Portability/PublicInterfaces/StateMailbox.hpp>
+#include "GLShader.hpp"
+#include "BufferGraph.hpp"
+#include "FrameReadback.hpp"
+#include "FrameSink.hpp"
+#include "ScreenCapture.hpp"
+#include "ProgramCache.hpp"
+#include "ShaderReloader.hpp"
+#include "GpuTimer.hpp"
+#include "DynamicResolution.hpp"
+#include "SoftwareRenderer.hpp"
+#include "InputLatency.hpp"
+#include "ShaderVariants.hpp"
+
+using namespace std;
+
+
+#define MAX_FRAMERATE 60.0
+//slots in the offline readback ring; three keeps the GPU two frames ahead
+#define READBACK_DEPTH 3
+//encoded-but-unwritten screen captures allowed before new ones are dropped
+#define CAPTURE_QUEUE_DEPTH 8
+//frames of GPU timer queries in flight before frames go untimed
+#define GPU_TIMER_DEPTH 4
+//lowest fraction of the window size --scale=auto will draw at
+#define MIN_RENDER_SCALE 0.4f
+
+
+class ShaderToyEventHandler : public RendererEventHandler
+{
+public:
+  void enqueueEvent(const RendererEvent& event) { pushEvent(event); }
+
+  //returns false when there are no events left
+  bool nextEvent(RendererEvent* event) { return popEvent(event); }
+
+protected:
+  bool popEvent(RendererEvent* event) { return pullEvent(event); }
+};
+
+typedef boost::shared_ptr<ShaderToyEventHandler> ShaderToyEventHandlerPtr;
+
+
+struct ToyOptions
+{
+  GLBackend backend;
+  int width, height;      //0 keeps the backend's default
+  string shader_path;
+
+  bool offline;
+  long frames;
+  int fps;
+  sinkformat format;
+  string output_path;     //"-" is stdout
+
+  bool program_cache;
+
+  float scale;            //fraction of the window size to draw at
+  bool auto_scale;        //let a ResolutionController choose scale
+
+  string coverage;        //CoverageMask spec; empty keeps the shader's own
+
+  int threads;            //software backend workers; 0 is one per core
+
+  vsyncmode vsync;
+
+  bool render_thread;     //draw on a thread of its own, see runThreaded()
+
+  bool latency;           //measure input to swap/present latency
+  bool latency_flash;     //and draw a white frame for every press
+
+  outputlayout outputs;   //how windows cover the display's monitors
+  bool list_outputs;      //print the monitors and exit
+
+  string quality;         //"// variant:" tier to start on; empty for the last
+  int quality_tier;       //its index, once the source has been read
+  bool quality_fallback;  //that tier doesn't build, so toys are built from
+                          //the source as written
+};
+
+
+static void usage(const char* argv0)
+{
+  cerr << "usage: " << argv0 << " [options] shader.frag\n"
+       << "       " << argv0 << " --list-outputs\n"
+       << "  --backend=x11|headless|software\n"
+       << "                           windowing backend (default: auto);\n"
+       << "                           software runs the shader's\n"
+       << "                           // kernel: on the CPU\n"
+       << "  --size=WxH               drawable size\n"
+       << "  --offline                render frames as fast as possible with a\n"
+       << "                           fixed timestep instead of opening a window\n"
+       << "  --frames=N               frames to render offline (default 300)\n"
+       << "  --fps=N                  offline timestep and y4m rate (default 60)\n"
+       << "  --format=rgba|y4m        offline output format (default y4m)\n"
+       << "  --output=PATH            offline output file, - for stdout\n"
+       << "  --no-program-cache       always compile shaders from source, and\n"
+       << "                           search every framebuffer config\n"
+       << "  --scale=F|auto           draw at F times the window size and\n"
+       << "                           upscale; auto adjusts F to hold the\n"
+       << "                           frame rate (default 1)\n"
+       << "  --coverage=SPEC          only draw inside SPEC: full, letterbox A,\n"
+       << "                           circle CX CY R, polygon X Y X Y ... or\n"
+       << "                           rects X Y W H ...\n"
+       << "                           (overrides the shader's // coverage:)\n"
+       << "  --vsync=off|on|adaptive  swap interval (default: the driver's)\n"
+       << "  --threads=N              software backend threads (default: one\n"
+       << "                           per core)\n"
+       << "  --single-thread          handle input and draw on one thread\n"
+       << "                           instead of giving drawing its own\n"
+       << "  --latency[=flash]        report input to screen latency; without\n"
+       << "                           present timing every swap is waited\n"
+       << "                           for. flash whites out the frame each\n"
+       << "                           click or key press first reaches\n"
+       << "  --outputs=single|span|each\n"
+       << "                           one window; one window over every\n"
+       << "                           monitor, drawing only where there are\n"
+       << "                           monitors; or one per monitor, each\n"
+       << "                           paced to its refresh (default single)\n"
+       << "  --list-outputs           print the monitors and exit\n"
+       << "  --quality=NAME           start on the shader's // variant: NAME\n"
+       << "                           (default: the last listed); F9 and F10\n"
+       << "                           step down and up through them\n";
+}
+
+static bool parseOptions(int argc, const char* argv[], ToyOptions* opts)
+{
+  opts->backend = GL_BACKEND_DEFAULT;
+  opts->width = opts->height = 0;
+  opts->offline = false;
+  opts->frames = 300;
+  opts->fps = 60;
+  opts->format = SINK_Y4M;
+  opts->output_path = "-";
+  opts->program_cache = true;
+  opts->scale = 1.0f;
+  opts->auto_scale = false;
+  opts->threads = 0;
+  opts->vsync = VSYNC_DEFAULT;
+  opts->render_thread = true;
+  opts->latency = opts->latency_flash = false;
+  opts->outputs = OUTPUTS_SINGLE;
+  opts->list_outputs = false;
+  opts->quality_tier = 0;
+  opts->quality_fallback = false;
+
+  for(int idx = 1; idx < argc; idx++)
+    {
+      const char* arg = argv[idx];
+      if(!strncmp(arg, "--backend=", 10))
+        opts->backend = OpenGLManager::ParseBackend(arg + 10);
+      else if(!strncmp(arg, "--size=", 7))
+        {
+          if(sscanf(arg + 7, "%dx%d", &opts->width, &opts->height) != 2 ||
+             opts->width <= 0 || opts->height <= 0)
+            return false;
+        }
+      else if(!strcmp(arg, "--offline"))
+        opts->offline = true;
+      else if(!strncmp(arg, "--frames=", 9))
+        opts->frames = atol(arg + 9);
+      else if(!strncmp(arg, "--fps=", 6))
+        opts->fps = atoi(arg + 6);
+      else if(!strncmp(arg, "--format=", 9))
+        {
+          if(!FrameSink::ParseFormat(arg + 9, &opts->format))
+            return false;
+        }
+      else if(!strncmp(arg, "--output=", 9))
+        opts->output_path = arg + 9;
+      else if(!strcmp(arg, "--no-program-cache"))
+        opts->program_cache = false;
+      else if(!strncmp(arg, "--coverage=", 11))
+        {
+          CoverageMask check;
+          opts->coverage = arg + 11;
+          if(!check.parse(opts->coverage))
+            return false;
+        }
+      else if(!strcmp(arg, "--scale=auto"))
+        opts->auto_scale = true;
+      else if(!strncmp(arg, "--scale=", 8))
+        {
+          opts->scale = atof(arg + 8);
+          if(opts->scale <= 0.0f || opts->scale > 1.0f)
+            return false;
+        }
+      else if(!strcmp(arg, "--vsync=off"))
+        opts->vsync = VSYNC_OFF;
+      else if(!strcmp(arg, "--vsync=on"))
+        opts->vsync = VSYNC_ON;
+      else if(!strcmp(arg, "--vsync=adaptive"))
+        opts->vsync = VSYNC_ADAPTIVE;
+      else if(!strncmp(arg, "--threads=", 10))
+        {
+          opts->threads = atoi(arg + 10);
+          if(opts->threads <= 0)
+            return false;
+        }
+      else if(!strcmp(arg, "--single-thread"))
+        opts->render_thread = false;
+      else if(!strcmp(arg, "--latency"))
+        opts->latency = true;
+      else if(!strcmp(arg, "--latency=flash"))
+        opts->latency = opts->latency_flash = true;
+      else if(!strcmp(arg, "--outputs=single"))
+        opts->outputs = OUTPUTS_SINGLE;
+      else if(!strcmp(arg, "--outputs=span"))
+        opts->outputs = OUTPUTS_SPAN;
+      else if(!strcmp(arg, "--outputs=each"))
+        opts->outputs = OUTPUTS_EACH;
+      else if(!strcmp(arg, "--list-outputs"))
+        opts->list_outputs = true;
+      else if(!strncmp(arg, "--quality=", 10))
+        opts->quality = arg + 10;
+      else if(arg[0] == '-' && arg[1] == '-')
+        return false;
+      else
+        opts->shader_path = arg;
+    }
+  return (opts->list_outputs || !opts->shader_path.empty()) &&
+    opts->fps > 0 && opts->frames > 0;
+}
+
+
+static bool readFile(const string& path, string* contents)
+{
+  ifstream in(path.c_str());
+  if(!in)
+    return false;
+  stringstream buffer;
+  buffer << in.rdbuf();
+  *contents = buffer.str();
+  return true;
+}
+
+//--outputs=span draws only where there are monitors: the outputs of the
+//window's screen, as rects in the box around them. Empty when they fill it
+static string spanCoverage(const vector<DisplayOutput>& outputs)
+{
+  if(outputs.empty())
+    return "";
+  int screen = outputs[0].screen;
+  int x1 = outputs[0].x, y1 = outputs[0].y;
+  int x2 = x1 + outputs[0].width, y2 = y1 + outputs[0].height;
+  long long area = 0;
+  for(size_t idx = 0; idx < outputs.size(); idx++)
+    if(outputs[idx].screen == screen)
+      {
+        x1 = min(x1, outputs[idx].x);
+        y1 = min(y1, outputs[idx].y);
+        x2 = max(x2, outputs[idx].x + outputs[idx].width);
+        y2 = max(y2, outputs[idx].y + outputs[idx].height);
+        area += (long long) outputs[idx].width * outputs[idx].height;
+      }
+  //mirrored outputs overlap, so this can overcount; that only means
+  //drawing the lot
+  if(area >= (long long) (x2 - x1) * (y2 - y1))
+    return "";
+
+  stringstream spec;
+  spec << "rects";
+  for(size_t idx = 0; idx < outputs.size(); idx++)
+    if(outputs[idx].screen == screen)
+      spec << " " << (double) (outputs[idx].x - x1) / (x2 - x1) << " "
+           << (double) (y2 - outputs[idx].y - outputs[idx].height) / (y2 - y1)
+           << " " << (double) outputs[idx].width / (x2 - x1) << " "
+           << (double) outputs[idx].height / (y2 - y1);
+  return spec.str();
+}
+
+static long long monotonicMs(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+//startup is measured from the top of main() to the first swap
+static long long launch_ms;
+static string program_source_desc;
+static string startup_desc;
+
+static void reportFirstFrame(void)
+{
+  //with a render thread per output, whichever swaps first
+  static boost::atomic<bool> reported(false);
+  if(reported.exchange(true))
+    return;
+  cerr << "First frame " << (monotonicMs() - launch_ms) << " ms after launch ("
+       << program_source_desc << ")" << endl;
+  cerr << "  " << startup_desc << endl;
+}
+
+
+//what input hands over to drawing. Only state, never deltas: with a render
+//thread, snapshots published faster than frames are drawn are skipped
+struct ToyInputState
+{
+  GLfloat mouse[4];            //as RendererParams::mouse
+  bool dragging;               //left button held; mouse[2] can't say, since
+                               //a press at x 0 leaves it 0
+  int window_width, window_height;
+  int quality;                 //ShaderVariants tier to draw
+  bool running;
+  unsigned int sequence;       //bumped for every snapshot; frames pass the
+                               //one they drew with to InputLatency
+};
+
+static void initInputState(OpenGLManager* manager, ToyInputState* input,
+                           int quality)
+{
+  memset(input, 0, sizeof(*input));
+  input->quality = quality;
+  input->window_width = manager->GetWindowWidth();
+  input->window_height = manager->GetWindowHeight();
+  input->running = true;
+}
+
+//what a toy for tier is built from: toy_source specialized for it when the
+//source has "// variant:" tiers, else toy_source as is
+static string tierSource(const string& toy_source, int tier)
+{
+  vector<ShaderVariant> variants;
+  if(!ShaderVariants::Parse(toy_source, &variants))
+    return toy_source;
+  return ShaderVariants::Source(toy_source, variants[max(0, min(tier,
+                                  (int) variants.size() - 1))]);
+}
+
+//picks up a resize the window system has reported
+static void updateWindowSize(OpenGLManager* manager, ToyInputState* input)
+{
+  if(!manager->WindowSizeChanged())
+    return;
+  input->window_width = manager->GetWindowWidth();
+  input->window_height = manager->GetWindowHeight();
+}
+
+
+//applies input events to *input, and hands them to latency (if any) as
+//consumed by the frames drawn from it; frame names screen captures, and
+//tiers is how many quality tiers there are to step through.
+//Clears input->running once the renderer has been asked to stop
+static void handleEvents(ShaderToyEventHandlerPtr handler,
+                         ToyInputState* input, ScreenCapture* capture,
+                         InputLatency* latency, int tiers, unsigned int frame)
+{
+  RendererEvent event;
+  while(input->running && handler->nextEvent(&event))
+    {
+      if(latency)
+        latency->consumed(event, input->sequence);
+      switch(event.type)
+        {
+        case MOUSE_DOWN:
+          if(event.data.press.which == MOUSE_LEFT)
+            {
+              //shadertoy convention: zw hold the click position while the
+              //button is down, and go negative once it is released
+              input->mouse[0] = input->mouse[2] =
+                event.data.press.where.window_x;
+              input->mouse[1] = input->mouse[3] = input->window_height -
+                event.data.press.where.window_y;
+              input->dragging = true;
+            }
+          break;
+        case MOUSE_UP:
+          if(event.data.press.which == MOUSE_LEFT && input->dragging)
+            {
+              input->mouse[2] = -input->mouse[2];
+              input->mouse[3] = -input->mouse[3];
+              input->dragging = false;
+            }
+          break;
+        case MOUSE_MOVE:
+          if(input->dragging)
+            {
+              input->mouse[0] = event.data.move.window_x;
+              input->mouse[1] = input->window_height -
+                event.data.move.window_y;
+            }
+          break;
+        case KEY_DOWN:
+          if(event.data.key.which == VMS_ESC)
+            input->running = false;
+          if(event.data.key.which == VMS_F9 && input->quality > 0)
+            input->quality--;
+          if(event.data.key.which == VMS_F10 && input->quality + 1 < tiers)
+            input->quality++;
+          if(event.data.key.which == VMS_F12 && capture)
+            {
+              char path[64];
+              snprintf(path, sizeof(path), "shadertoy-%06u.png", frame);
+              capture->request(path);
+            }
+          break;
+        case SOFTWARE:
+          if(event.data.message.msg_type == RENDERER_STOP)
+            input->running = false;
+          if(event.data.message.msg_type == RENDERER_SCREENCAPTURE && capture)
+            capture->request(*(tstring*) event.data.message.contents.heap);
+          event.releaseContents();
+          break;
+        default:
+          break;
+        }
+    }
+}
+
+
+static void printTimes(const char* name, const TimeSummary& times)
+{
+  if(!times.count)
+    return;
+  cout << "  " << name << ": p50 " << times.p50_ns / 1e6 << " ms, p90 "
+       << times.p90_ns / 1e6 << " ms, p99 " << times.p99_ns / 1e6
+       << " ms, max " << times.max_ns / 1e6 << " ms" << endl;
+}
+
+static void printStats(const FrameTimeStats& stats)
+{
+  if(!stats.frame.count)
+    return;
+  cout << stats.frame.count << " frames, " << stats.missed_deadlines
+       << " missed deadlines" << endl;
+  printTimes("frame", stats.frame);
+  printTimes("cpu", stats.cpu);
+  printTimes("gpu draw", stats.gpu_draw);
+  printTimes("gpu swap", stats.gpu_swap);
+}
+
+
+static void printTileStats(TileScheduler* scheduler)
+{
+  if(!scheduler->runs())
+    return;
+  cout << scheduler->threads() << " tile threads over " << scheduler->runs()
+       << " runs:" << endl;
+  for(int idx = 0; idx < scheduler->threads(); idx++)
+    {
+      const TileWorkerStats& stats = scheduler->stats(idx);
+      printf("  thread %2d: %5.1f%% busy, %llu tiles, %llu steals (%llu tiles)\n",
+             idx, scheduler->utilisation(idx) * 100.0, stats.tiles,
+             stats.steals, stats.stolen);
+    }
+}
+
+
+//intervals between frames reaching the display, from PresentTiming
+class PresentCadence
+{
+public:
+  PresentCadence(const PresentTiming& start)
+    : last_ns(start.last_present_ns), presents(start.presents),
+      missed(0), refresh_ns(start.refresh_ns) {}
+
+  void update(const PresentTiming& timing)
+  {
+    if(timing.presents == presents)
+      return;
+    long long interval = timing.last_present_ns - last_ns;
+    intervals.Record(interval);
+    //vblanks that went by without a new frame
+    long long vblanks = (interval + refresh_ns / 2) / refresh_ns;
+    if(vblanks > (long long) (timing.presents - presents))
+      missed += vblanks - (timing.presents - presents);
+    last_ns = timing.last_present_ns;
+    presents = timing.presents;
+  }
+
+  void print(void)
+  {
+    if(!intervals.Count())
+      return;
+    cout << intervals.Count() << " presents at " << 1e9 / refresh_ns
+         << " Hz, " << missed << " vblanks without a new frame" << endl;
+    cout << "  present interval: p50 " << intervals.Percentile(0.5) / 1e6
+         << " ms, p99 " << intervals.Percentile(0.99) / 1e6 << " ms, max "
+         << intervals.Max() / 1e6 << " ms" << endl;
+  }
+
+private:
+  TimeHistogram intervals;
+  long long last_ns;
+  unsigned long long presents;
+  unsigned long long missed;
+  long long refresh_ns;
+};
+
+
+//the drawing half of an interactive run. Everything here uses the GL
+//context, so it's built, run and destroyed on the thread that has it
+//current. *toy, built from toy_source (specialized for opts.quality_tier if
+//it has tiers), is replaced whenever the shader file is edited and rebuilds
+//cleanly
+class ToyFrameLoop
+{
+public:
+  ToyFrameLoop(OpenGLManager* manager, ShaderToy** toy,
+               RendererParams* params, ShaderToyParams* toy_params,
+               const string& toy_source, const ToyOptions& opts);
+  ~ToyFrameLoop(void);
+
+  //request() may be called from any thread
+  ScreenCapture* capture(void) { return &this->captures; }
+  //null unless latency is being measured
+  InputLatency* latency(void) { return this->latency_stats; }
+  unsigned int framesDrawn(void) { return this->frames_drawn.load(); }
+  //quality tiers the current source has; 0 for none
+  int qualityTiers(void) { return this->tiers.load(); }
+
+  //draws and swaps a frame showing input
+  void draw(const ToyInputState& input);
+
+  //ms to sleep before the next frame when there's no frame timer
+  int sleepTime(void) { return this->clock.EstimateSleepTime(MAX_FRAMERATE); }
+
+  void report(void);
+
+private:
+  OpenGLManager* manager;
+  ShaderToy** toy;
+  RendererParams* params;
+  ShaderToyParams* toy_params;
+  const ToyOptions& opts;
+
+  LoopClock clock;
+  GpuFrameTimer gpu_timer;
+  //draws go straight to the window unless scaling was asked for
+  ScaledTarget scaled;
+  ResolutionController* controller;
+  float scale;
+  ScreenCapture captures;
+  ShaderReloader reloader;
+  long long start_ms;
+
+  //the source's "// variant:" tiers; with any, the input's tier is drawn
+  //instead of *toy itself, which is the tier it was built for
+  ShaderVariants* variants;
+  int tier;                        //-1 until the first draw picks one
+  ShaderToy* tier_toy;             //variants->get(tier)
+  boost::atomic<int> tiers;
+
+  //with present timing, animation runs on when frames will be seen rather
+  //than when they're drawn, so uneven draw times don't show as judder
+  PresentTiming timing;
+  bool present_timing;
+  PresentCadence* cadence;
+  InputLatency* latency_stats;
+  unsigned long long first_present;
+
+  boost::atomic<unsigned int> frames_drawn;
+};
+
+ToyFrameLoop::ToyFrameLoop(OpenGLManager* manager, ShaderToy** toy,
+                           RendererParams* params,
+                           ShaderToyParams* toy_params,
+                           const string& toy_source, const ToyOptions& opts)
+  : manager(manager), toy(toy), params(params), toy_params(toy_params),
+    opts(opts), gpu_timer(GPU_TIMER_DEPTH), captures(READBACK_DEPTH, CAPTURE_QUEUE_DEPTH),
+    reloader(manager, opts.shader_path, params, toy_params)
+{
+  this->clock.SetFrameBudget((long long) (1e9 / MAX_FRAMERATE));
+  this->controller = opts.auto_scale ?
+    new ResolutionController((long long) (1e9 / MAX_FRAMERATE),
+                             MIN_RENDER_SCALE, 1.0f) : 0;
+  this->scale = this->controller ? this->controller->scale() : opts.scale;
+  this->reloader.start();
+  this->start_ms = monotonicMs();
+  this->variants = new ShaderVariants(toy_source, params, toy_params,
+                                      opts.coverage);
+  this->tier = -1;
+  this->tier_toy = 0;
+  this->tiers.store(this->variants->count());
+  if(this->variants->count())
+    {
+      this->variants->adopt(opts.quality_tier, *toy, opts.quality_fallback);
+      this->tier = opts.quality_tier;
+      this->tier_toy = *toy;
+      this->reloader.setQuality(this->tier);
+    }
+
+  if(opts.vsync != VSYNC_DEFAULT && !manager->SetSwapInterval(opts.vsync))
+    cout << "This backend can't set that vsync mode" << endl;
+  this->present_timing = manager->GetPresentTiming(&this->timing);
+  this->cadence = new PresentCadence(this->present_timing ? this->timing :
+                                     PresentTiming());
+  this->latency_stats = opts.latency ?
+    new InputLatency(this->present_timing) : 0;
+  this->first_present = this->present_timing ? this->timing.presents : 0;
+  this->frames_drawn.store(params->frame);
+}
+
+ToyFrameLoop::~ToyFrameLoop(void)
+{
+  delete this->cadence;
+  delete this->latency_stats;
+  delete this->controller;
+  delete this->variants;
+}
+
+
+void ToyFrameLoop::draw(const ToyInputState& input)
+{
+  this->clock.LoopStart();
+  InputLatency* latency = this->latency_stats;
+  if(latency)
+    latency->begin(input.sequence);
+  if(input.window_width != this->params->window_width ||
+     input.window_height != this->params->window_height)
+    {
+      this->params->window_width = input.window_width;
+      this->params->window_height = input.window_height;
+      glViewport(0, 0, this->params->window_width,
+                 this->params->window_height);
+    }
+  memcpy(this->params->mouse, input.mouse, sizeof(this->params->mouse));
+
+  string reloaded_source;
+  int reloaded_tier;
+  bool reloaded_fallback;
+  ShaderToy* reloaded = this->reloader.takeReady(&reloaded_source,
+                                                 &reloaded_tier,
+                                                 &reloaded_fallback);
+  if(reloaded)
+    {
+      delete *this->toy;
+      *this->toy = reloaded;
+      if(!this->opts.coverage.empty())
+        (*this->toy)->coverage()->parse(this->opts.coverage);
+      cout << "Reloaded " << this->opts.shader_path << endl;
+      //the reloader built the tier being drawn; the new source's others are
+      //built as they're first drawn
+      delete this->variants;
+      this->variants = new ShaderVariants(reloaded_source, this->params,
+                                          this->toy_params, this->opts.coverage);
+      this->tier = reloaded_tier;
+      this->tier_toy = 0;
+      this->tiers.store(this->variants->count());
+      if(reloaded_tier >= 0)
+        {
+          this->variants->adopt(reloaded_tier, reloaded, reloaded_fallback);
+          this->tier_toy = reloaded;
+        }
+    }
+
+  ShaderToy* drawn = *this->toy;
+  if(this->variants->count())
+    {
+      int tier = max(0, min(input.quality, (int) this->variants->count() - 1));
+      if(tier != this->tier)
+        {
+          //only a tier's first use compiles; after that this is a lookup
+          bool cold = !this->variants->warm(tier);
+          this->tier_toy = this->variants->get(tier);
+          this->tier = tier;
+          this->reloader.setQuality(tier);
+          cout << "Quality " << this->variants->variant(tier).name;
+          if(this->variants->failed(tier))
+            cout << " doesn't build; drawing "
+                 << (this->tier_toy ? "the source as written" :
+                     "the running shader");
+          else if(cold)
+            cout << ", built in " << this->variants->lastBuildTime() / 1e6
+                 << " ms";
+          cout << endl;
+        }
+      if(this->tier_toy)
+        drawn = this->tier_toy;
+    }
+
+  if(this->present_timing && this->manager->GetPresentTiming(&this->timing))
+    {
+      this->cadence->update(this->timing);
+      if(latency)
+        latency->presented(this->timing.presents - this->first_present,
+                           this->timing.last_present_ns);
+      GLuint display_ms = (GLuint) (this->timing.predicted_ns / 1000000 -
+                                    this->start_ms);
+      //a shorter swap queue can move the prediction back; time can't
+      if(display_ms > this->params->current_time_ms || !this->params->frame)
+        this->params->current_time_ms = display_ms;
+    }
+  else
+    this->params->current_time_ms = (GLuint) (monotonicMs() - this->start_ms);
+  this->gpu_timer.beginDraw();
+  if(this->scale < 1.0f)
+    {
+      this->scaled.bind(this->params->window_width,
+                        this->params->window_height, this->scale,
+                        &this->params->render_width,
+                        &this->params->render_height);
+      drawn->draw();
+      this->scaled.present(this->manager->GetDefaultFramebuffer(),
+                           this->params->window_width,
+                           this->params->window_height);
+    }
+  else
+    {
+      this->params->render_width = this->params->window_width;
+      this->params->render_height = this->params->window_height;
+      drawn->draw();
+    }
+  this->gpu_timer.endDraw();
+  //a photodiode on the screen can check the numbers against this
+  if(this->opts.latency_flash && latency->pressedIn(input.sequence))
+    {
+      glBindFramebuffer(GL_FRAMEBUFFER, this->manager->GetDefaultFramebuffer());
+      glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT);
+    }
+  this->captures.service(this->manager->GetDefaultFramebuffer(),
+                         this->params->window_width,
+                         this->params->window_height);
+  this->gpu_timer.beginSwap();
+  this->manager->SwapFrameBuffers();
+  this->gpu_timer.endSwap();
+  if(latency)
+    {
+      //without present timing, the swap having executed is as close to the
+      //screen as can be seen
+      if(!this->present_timing)
+        glFinish();
+      latency->swapped(input.sequence, LoopClock::Now());
+    }
+  long long gpu_draw_ns = this->gpu_timer.collect(&this->clock);
+  reportFirstFrame();
+  this->params->frame++;
+  this->frames_drawn.store(this->params->frame);
+
+  if(this->clock.LoopEnd())
+    hfPrintf("%.1f fps at %.2f scale", this->clock.GetFR(), this->scale);
+  if(this->controller)
+    this->scale = this->controller->update(this->gpu_timer.supported() ?
+                                           gpu_draw_ns :
+                                           this->clock.LastLoopTime());
+}
+
+void ToyFrameLoop::report(void)
+{
+  printStats(this->clock.GetStats());
+  if(this->present_timing)
+    this->cadence->print();
+  if(this->latency_stats)
+    this->latency_stats->print();
+  TimeHistogram& capture_times = this->captures.serviceTimes();
+  if(capture_times.Count())
+    cout << this->captures.captured() << " screen captures written, "
+         << this->captures.dropped() << " dropped; render thread cost p50 "
+         << capture_times.Percentile(0.5) / 1e6 << " ms, max "
+         << capture_times.Max() / 1e6 << " ms over "
+         << capture_times.Count() << " frames" << endl;
+  if((*this->toy)->buffers())
+    cout << "Buffer passes: " << (*this->toy)->buffers()->passesRun()
+         << " run, " << (*this->toy)->buffers()->passesSkipped()
+         << " skipped as unchanged" << endl;
+  if(this->controller)
+    cout << "Render scale " << this->controller->scale() << " after "
+         << this->controller->changes() << " changes" << endl;
+}
+
+
+//input and drawing on one thread: frames are drawn when the manager's frame
+//timer fires, and input wakes the loop straight away so it's consumed as it
+//arrives, not a frame later
+static int runInteractive(OpenGLManager* manager,
+                          ShaderToyEventHandlerPtr handler,
+                          ShaderToy** toy, RendererParams* params,
+                          ShaderToyParams* toy_params,
+                          const ToyOptions& opts, const string& toy_source)
+{
+  ToyFrameLoop loop(manager, toy, params, toy_params, toy_source, opts);
+  bool paced = manager->StartFramePacing(MAX_FRAMERATE);
+  if(!paced)
+    cout << "No frame timer available; pacing with sleep" << endl;
+
+  ToyInputState input;
+  initInputState(manager, &input, opts.quality_tier);
+  while(input.running)
+    {
+      unsigned int wake = manager->WaitForWake();
+      if(manager->HandleWindowEvents())
+        {
+          WindowEventStats events = manager->LastEventStats();
+          hfPrintf("frame %u: %u window events, %u coalesced%s", params->frame,
+                   events.raw, events.coalesced,
+                   events.truncated ? ", more queued" : "");
+        }
+      input.sequence++;
+      updateWindowSize(manager, &input);
+      handleEvents(handler, &input, loop.capture(), loop.latency(),
+                   loop.qualityTiers(), params->frame);
+      if(!input.running || !(wake & WAKE_FRAME))
+        continue;
+
+      loop.draw(input);
+      if(!paced)
+        usleep(loop.sleepTime() * 1000);
+    }
+
+  loop.report();
+  return 0;
+}
+
+
+//owns the GL context for runThreaded(): builds a ToyFrameLoop, then draws
+//a frame with the newest input snapshot every time the detached frame timer
+//fires, until a snapshot says to stop. With build_toy, the toy is built
+//from source (and deleted) on the render thread too, in its context; label
+//heads its report when there are several
+class RenderThread
+{
+public:
+  RenderThread(OpenGLManager* manager, ShaderToy** toy,
+               RendererParams* params, ShaderToyParams* toy_params,
+               const ToyOptions& opts, const ToyInputState& initial,
+               const string& source, bool build_toy = false,
+               const string& label = "")
+    : manager(manager), toy(toy), params(params), toy_params(toy_params),
+      opts(opts), mailbox(initial), source(source), build_toy(build_toy),
+      label(label), loop(0), ready(false) {}
+
+  //call with the context released on this thread. Returns the frame loop
+  //once the render thread has built it, or null if it couldn't build the
+  //toy
+  ToyFrameLoop* start(void)
+  {
+    this->thread = boost::thread(&RenderThread::run, this);
+    boost::mutex::scoped_lock guard(this->lock);
+    while(!this->ready)
+      this->built.wait(guard);
+    return this->loop;
+  }
+
+  //never blocks, however long the frame being drawn takes
+  void post(const ToyInputState& input) { this->mailbox.publish(input); }
+
+  //once a snapshot with running cleared has been posted; the context is
+  //released again when this returns
+  void join(void) { this->thread.join(); }
+
+private:
+  OpenGLManager* manager;
+  ShaderToy** toy;
+  RendererParams* params;
+  ShaderToyParams* toy_params;
+  const ToyOptions& opts;
+  StateMailbox<ToyInputState> mailbox;
+  const string& source;
+  bool build_toy;
+  string label;
+
+  boost::mutex lock;
+  boost::condition_variable built;
+  ToyFrameLoop* loop;
+  bool ready;
+  boost::thread thread;
+
+  //reports from several threads come out one at a time
+  static boost::mutex report_lock;
+
+  //builds *toy from source; false, with the start() handshake done, if it
+  //doesn't compile
+  bool buildToy(void)
+  {
+    *this->toy = new ShaderToy(this->opts.quality_fallback ? this->source :
+                               tierSource(this->source, this->opts.quality_tier),
+                               this->params, this->toy_params);
+    if(!this->opts.coverage.empty())
+      (*this->toy)->coverage()->parse(this->opts.coverage);
+    if((*this->toy)->initialize())
+      return true;
+    delete *this->toy;
+    *this->toy = 0;
+    boost::mutex::scoped_lock guard(this->lock);
+    this->ready = true;
+    this->built.notify_one();
+    return false;
+  }
+
+  void run(void)
+  {
+    this->manager->SetContextCurrent();
+    if(this->build_toy && !buildToy())
+      {
+        this->manager->UnsetContextCurrent();
+        return;
+      }
+    {
+      ToyFrameLoop frames(this->manager, this->toy, this->params,
+                          this->toy_params, this->source, this->opts);
+      {
+        boost::mutex::scoped_lock guard(this->lock);
+        this->loop = &frames;
+        this->ready = true;
+        this->built.notify_one();
+      }
+
+      ToyInputState input;
+      while(true)
+        {
+          this->manager->WaitForFrame();
+          this->mailbox.latest(&input);
+          if(!input.running)
+            break;
+          frames.draw(input);
+        }
+      boost::mutex::scoped_lock guard(report_lock);
+      if(!this->label.empty())
+        cout << this->label << ":" << endl;
+      frames.report();
+    }
+    if(this->build_toy)
+      {
+        delete *this->toy;
+        *this->toy = 0;
+      }
+    this->manager->UnsetContextCurrent();
+  }
+};
+
+boost::mutex RenderThread::report_lock;
+
+
+//the render thread owns the GL context and only ever waits on the frame
+//timer; this thread owns the window system connection and the event queue,
+//and posts what input has done to the render thread as it arrives. A slow
+//frame can't hold up input, and a burst of input can't hold up a frame
+static int runThreaded(OpenGLManager* manager,
+                       ShaderToyEventHandlerPtr handler,
+                       ShaderToy** toy, RendererParams* params,
+                       ShaderToyParams* toy_params, const ToyOptions& opts,
+                       const string& toy_source)
+{
+  if(!manager->StartFramePacing(MAX_FRAMERATE, true))
+    {
+      cout << "No frame timer available; drawing on the input thread" << endl;
+      return runInteractive(manager, handler, toy, params, toy_params, opts,
+                            toy_source);
+    }
+
+  ToyInputState input;
+  initInputState(manager, &input, opts.quality_tier);
+  RenderThread renderer(manager, toy, params, toy_params, opts, input,
+                        toy_source);
+  manager->UnsetContextCurrent();
+  ToyFrameLoop* loop = renderer.start();
+
+  while(input.running)
+    {
+      manager->WaitForWake();
+      if(manager->HandleWindowEvents())
+        {
+          WindowEventStats events = manager->LastEventStats();
+          hfPrintf("snapshot %u: %u window events, %u coalesced%s",
+                   input.sequence, events.raw, events.coalesced,
+                   events.truncated ? ", more queued" : "");
+        }
+      input.sequence++;
+      updateWindowSize(manager, &input);
+      handleEvents(handler, &input, loop->capture(), loop->latency(),
+                   loop->qualityTiers(), loop->framesDrawn());
+      renderer.post(input);
+    }
+
+  renderer.join();
+  //whatever's left (deleting the toy) happens back on this thread
+  manager->SetContextCurrent();
+  return 0;
+}
+
+
+//--outputs=each: a render thread per output, each drawing its own copy of
+//the toy in its own window and context, paced by a frame timer at that
+//output's refresh rate so none waits on another's vblank. Input is read
+//here as in runThreaded() and posted to all of them, the mouse scaled to
+//each window; captures and latency follow the first output
+static int runOutputs(OpenGLManager* manager,
+                      ShaderToyEventHandlerPtr handler,
+                      ShaderToy** toy, RendererParams* params,
+                      ShaderToyParams* toy_params, const ToyOptions& opts,
+                      const string& toy_source)
+{
+  const vector<DisplayOutput>& outputs = manager->GetOutputs();
+  double hz = !outputs.empty() && outputs[0].refresh_hz > 0.0 ?
+    outputs[0].refresh_hz : MAX_FRAMERATE;
+  if(!manager->StartFramePacing(hz, true))
+    return runThreaded(manager, handler, toy, params, toy_params, opts,
+                       toy_source);
+
+  struct Output
+  {
+    OpenGLManager* manager;
+    ShaderToy* toy;
+    RendererParams params;
+    ShaderToyParams toy_params;
+    ToyInputState input;
+    RenderThread* thread;
+    string name;
+  };
+  //only the first output's latency is measured
+  ToyOptions output_opts = opts;
+  output_opts.latency = output_opts.latency_flash = false;
+  vector<Output> others;
+  for(size_t idx = 1; idx < outputs.size(); idx++)
+    {
+      Output output;
+      output.manager = manager->CreateOutputManager(idx);
+      if(!output.manager)
+        {
+          cout << "Not drawing on output " << outputs[idx].name << endl;
+          continue;
+        }
+      output.manager->StartFramePacing(outputs[idx].refresh_hz > 0.0 ?
+                                       outputs[idx].refresh_hz :
+                                       MAX_FRAMERATE, true);
+      output.toy = 0;
+      memset(&output.params, 0, sizeof(output.params));
+      output.toy_params = *toy_params;
+      output.thread = 0;
+      output.name = outputs[idx].name;
+      others.push_back(output);
+    }
+  //each toy updates a uniform block of its own, in its own context
+  ShaderToy::SetUniformBlock(0);
+
+  ToyInputState input;
+  initInputState(manager, &input, opts.quality_tier);
+  RenderThread renderer(manager, toy, params, toy_params, opts, input,
+                        toy_source, false,
+                        outputs.empty() ? "" : outputs[0].name);
+  manager->UnsetContextCurrent();
+  ToyFrameLoop* loop = renderer.start();
+  //one at a time, so only the first compiles and the rest load its binary
+  //from the program cache
+  size_t drawing = 0;
+  for(size_t idx = 0; idx < others.size(); idx++)
+    {
+      Output& output = others[idx];
+      initInputState(output.manager, &output.input, opts.quality_tier);
+      output.thread = new RenderThread(output.manager, &output.toy,
+                                       &output.params, &output.toy_params,
+                                       output_opts, output.input, toy_source,
+                                       true, output.name);
+      output.thread->start();
+      drawing += output.toy != 0;
+    }
+  cout << "Drawing on " << drawing + 1 << " outputs" << endl;
+
+  while(input.running)
+    {
+      manager->WaitForWake();
+      manager->HandleWindowEvents();
+      input.sequence++;
+      updateWindowSize(manager, &input);
+      handleEvents(handler, &input, loop->capture(), loop->latency(),
+                   loop->qualityTiers(), loop->framesDrawn());
+      renderer.post(input);
+      for(size_t idx = 0; idx < others.size(); idx++)
+        {
+          Output& output = others[idx];
+          updateWindowSize(output.manager, &output.input);
+          int width = output.input.window_width;
+          int height = output.input.window_height;
+          output.input = input;
+          output.input.window_width = width;
+          output.input.window_height = height;
+          if(input.window_width > 0 && input.window_height > 0)
+            for(int axis = 0; axis < 4; axis++)
+              output.input.mouse[axis] *= (axis % 2 ? (float) height /
+                                           input.window_height :
+                                           (float) width / input.window_width);
+          output.thread->post(output.input);
+        }
+    }
+
+  renderer.join();
+  for(size_t idx = 0; idx < others.size(); idx++)
+    {
+      others[idx].thread->join();
+      delete others[idx].thread;
+      delete others[idx].manager;
+    }
+  manager->SetContextCurrent();
+  return 0;
+}
+
+
+//waits for the oldest frame in ring and copies it to pixels; a frame that
+//can't be read back ends the run rather than going out as a stale copy
+static bool collectFrame(PixelPackRing* ring, vector<unsigned char>* pixels)
+{
+  long long frame = 0;
+  if(ring->collect(true, &(*pixels)[0], &frame) == READBACK_DONE)
+    return true;
+  cerr << "Readback of frame " << frame << " failed" << endl;
+  return false;
+}
+
+//renders opts.frames frames on a fixed 1/fps timestep. The only thing that
+//limits throughput is the backend: readback of frame N overlaps the drawing
+//of frames N+1 and N+2
+static int runOffline(OpenGLManager* manager, ShaderToy* toy,
+                      RendererParams* params, const ToyOptions& opts,
+                      FILE* out)
+{
+  params->window_width = manager->GetWindowWidth();
+  params->window_height = manager->GetWindowHeight();
+  params->render_width = params->window_width;
+  params->render_height = params->window_height;
+  glViewport(0, 0, params->window_width, params->window_height);
+
+  PixelPackRing ring(READBACK_DEPTH);
+  ring.resize(params->window_width, params->window_height);
+  FrameSink sink(out, opts.format, params->window_width,
+                 params->window_height, opts.fps);
+  vector<unsigned char> pixels(ring.frameBytes());
+
+  long long start_ms = monotonicMs();
+  for(long frame = 0; frame < opts.frames; frame++)
+    {
+      params->frame = frame;
+      params->current_time_ms = (GLuint) ((frame * 1000LL) / opts.fps);
+
+      glBindFramebuffer(GL_FRAMEBUFFER, manager->GetDefaultFramebuffer());
+      toy->draw();
+
+      if(ring.full())
+        {
+          if(!collectFrame(&ring, &pixels))
+            return 1;
+          if(!sink.writeFrame(&pixels[0]))
+            {
+              cerr << "Output closed after " << frame << " frames" << endl;
+              return 1;
+            }
+        }
+      //read before the swap: a window's back buffer is undefined after it
+      ring.queueRead(manager->GetDefaultFramebuffer(), frame);
+      manager->SwapFrameBuffers();
+      if(!frame)
+        {
+          glFinish();
+          reportFirstFrame();
+        }
+    }
+
+  while(ring.pending())
+    {
+      if(!collectFrame(&ring, &pixels) || !sink.writeFrame(&pixels[0]))
+        return 1;
+    }
+  fflush(out);
+
+  long long elapsed_ms = monotonicMs() - start_ms;
+  cerr << "Rendered " << opts.frames << " frames at " << params->window_width
+       << "x" << params->window_height << " in " << elapsed_ms << " ms ("
+       << (elapsed_ms ? opts.frames * 1000.0 / elapsed_ms : 0.0)
+       << " fps, " << (elapsed_ms ? (opts.frames * 1000.0 / opts.fps) /
+                       elapsed_ms : 0.0) << "x realtime)" << endl;
+  return 0;
+}
+
+
+//draws with a CPU kernel instead of a GL program: interactively, or
+//offline to out like runOffline()
+static int runSoftware(OpenGLManager* manager,
+                       ShaderToyEventHandlerPtr handler,
+                       SoftwareRenderer* renderer, RendererParams* params,
+                       ShaderToyParams* toy_params, const ToyOptions& opts,
+                       FILE* out)
+{
+  SoftwareFramebuffer fb;
+  manager->GetSoftwareFramebuffer(&fb);
+  params->window_width = manager->GetWindowWidth();
+  params->window_height = manager->GetWindowHeight();
+
+  if(opts.offline)
+    {
+      FrameSink sink(out, opts.format, fb.width, fb.height, opts.fps);
+      vector<unsigned char> rgba((size_t) fb.width * fb.height * 4);
+      long long start_ms = monotonicMs();
+      for(long frame = 0; frame < opts.frames; frame++)
+        {
+          params->frame = frame;
+          params->current_time_ms = (GLuint) ((frame * 1000LL) / opts.fps);
+          renderer->render(params, toy_params, fb);
+          reportFirstFrame();
+          SoftwareRenderer::ToRGBA(fb, &rgba[0], renderer->getScheduler());
+          if(!sink.writeFrame(&rgba[0]))
+            {
+              cerr << "Output closed after " << frame << " frames" << endl;
+              return 1;
+            }
+        }
+      fflush(out);
+
+      long long elapsed_ms = monotonicMs() - start_ms;
+      cerr << "Rendered " << opts.frames << " frames at " << fb.width << "x"
+           << fb.height << " in " << elapsed_ms << " ms ("
+           << (elapsed_ms ? opts.frames * 1000.0 / elapsed_ms : 0.0)
+           << " fps, " << (elapsed_ms ? opts.frames * (double) fb.width *
+                           fb.height / (elapsed_ms * 1000.0) : 0.0)
+           << " Mpix/s)" << endl;
+      printTileStats(renderer->getScheduler());
+      return 0;
+    }
+
+  LoopClock clock;
+  clock.SetFrameBudget((long long) (1e9 / MAX_FRAMERATE));
+  long long start_ms = monotonicMs();
+  bool paced = manager->StartFramePacing(MAX_FRAMERATE);
+  //a put image is done with once it's been handed to the server
+  InputLatency* latency = opts.latency ? new InputLatency(false) : 0;
+
+  ToyInputState input;
+  initInputState(manager, &input, opts.quality_tier);
+  while(input.running)
+    {
+      unsigned int wake = manager->WaitForWake();
+      manager->HandleWindowEvents();
+      input.sequence++;
+      updateWindowSize(manager, &input);
+      handleEvents(handler, &input, 0, latency, 0, params->frame);
+      if(!input.running || !(wake & WAKE_FRAME))
+        continue;
+
+      clock.LoopStart();
+      if(latency)
+        latency->begin(input.sequence);
+      params->window_width = input.window_width;
+      params->window_height = input.window_height;
+      memcpy(params->mouse, input.mouse, sizeof(params->mouse));
+      //the manager may hand out a different buffer each frame
+      manager->GetSoftwareFramebuffer(&fb);
+      params->current_time_ms = (GLuint) (monotonicMs() - start_ms);
+      renderer->render(params, toy_params, fb);
+      if(opts.latency_flash && latency->pressedIn(input.sequence))
+        for(int y = 0; y < fb.height; y++)
+          for(int x = 0; x < fb.width; x++)
+            fb.pixels[(size_t) y * fb.stride + x] = 0xffffffff;
+      manager->SwapFrameBuffers();
+      if(latency)
+        latency->swapped(input.sequence, LoopClock::Now());
+      reportFirstFrame();
+      params->frame++;
+
+      if(clock.LoopEnd())
+        hfPrintf("%.1f fps", clock.GetFR());
+      if(!paced)
+        usleep(clock.EstimateSleepTime(MAX_FRAMERATE) * 1000);
+    }
+
+  printStats(clock.GetStats());
+  printTileStats(renderer->getScheduler());
+  if(latency)
+    latency->print();
+  delete latency;
+  return 0;
+}
 
 
 int main( int argc, const char* argv[] )
 {
-  cout << "\nHello World\nShader Toy v0.1 initializing...\n";
+  launch_ms = monotonicMs();
+  ToyOptions opts;
+  if(!parseOptions(argc, argv, &opts))
+    {
+      usage(argv[0]);
+      return 1;
+    }
+
+  //when frames go to stdout, everything else that would print there (the GL
+  //managers log to cout) is pointed at stderr instead
+  FILE* out = 0;
+  if(opts.offline)
+    {
+      if(opts.output_path == "-")
+        {
+          out = fdopen(dup(STDOUT_FILENO), "wb");
+          dup2(STDERR_FILENO, STDOUT_FILENO);
+        }
+      else
+        out = fopen(opts.output_path.c_str(), "wb");
+      if(!out)
+        {
+          cerr << "Unable to open " << opts.output_path << endl;
+          return 1;
+        }
+      if(opts.backend == GL_BACKEND_DEFAULT)
+        opts.backend = GL_BACKEND_HEADLESS;
+    }
+
+  if(opts.list_outputs)
+    {
+      vector<DisplayOutput> outputs;
+      if(!OpenGLManager::ListOutputs(&outputs))
+        {
+          cerr << "Unable to open X display" << endl;
+          return 1;
+        }
+      for(size_t idx = 0; idx < outputs.size(); idx++)
+        {
+          const DisplayOutput& output = outputs[idx];
+          printf("%-12s %dx%d+%d+%d screen %d", output.name.c_str(),
+                 output.width, output.height, output.x, output.y,
+                 output.screen);
+          if(output.refresh_hz > 0.0)
+            printf(" %.2f Hz", output.refresh_hz);
+          printf("\n");
+        }
+      return 0;
+    }
+
+  cout << "\nShader Toy v0.1 initializing...\n";
+
+  string toy_source;
+  if(!readFile(opts.shader_path, &toy_source))
+    {
+      cerr << "Unable to read " << opts.shader_path << endl;
+      return 1;
+    }
+  vector<ShaderVariant> variants;
+  if(ShaderVariants::Parse(toy_source, &variants))
+    {
+      opts.quality_tier = variants.size() - 1;
+      for(size_t idx = 0; idx < variants.size(); idx++)
+        if(variants[idx].name == opts.quality)
+          opts.quality_tier = idx;
+      if(!opts.quality.empty() && variants[opts.quality_tier].name != opts.quality)
+        {
+          cerr << opts.shader_path << " has no variant " << opts.quality << endl;
+          return 1;
+        }
+    }
+  else if(!opts.quality.empty())
+    {
+      cerr << opts.shader_path << " has no // variant: lines" << endl;
+      return 1;
+    }
+
+  ShaderToyEventHandlerPtr handler(new ShaderToyEventHandler());
+  OpenGLManager* manager = OpenGLManager::GetGLManager(handler, handler,
+                                                       opts.backend);
+  if(opts.program_cache)
+    manager->SetConfigCachePath(ProgramCache::DefaultDirectory() + "/fbconfig");
+  manager->SetOutputLayout(opts.outputs);
+  long long init_start_ms = monotonicMs();
+  if(!manager->init(false))
+    {
+      cerr << "Unable to initialize OpenGL" << endl;
+      return 1;
+    }
+  {
+    stringstream desc;
+    desc << "startup: " << (init_start_ms - launch_ms) << " ms before init";
+    const vector<StartupPhase>& phases = manager->GetStartupPhases();
+    for(size_t idx = 0; idx < phases.size(); idx++)
+      {
+        char ms[32];
+        snprintf(ms, sizeof(ms), " %.1f ms", phases[idx].ns / 1e6);
+        desc << ", " << phases[idx].name << ms;
+      }
+    startup_desc = desc.str();
+  }
+  //windows laid out over outputs are the outputs' size
+  if(opts.width && opts.outputs == OUTPUTS_SINGLE)
+    manager->RequestWindowSize(opts.width, opts.height);
+  if(opts.outputs == OUTPUTS_SPAN && opts.coverage.empty())
+    opts.coverage = spanCoverage(manager->GetOutputs());
+
+  RendererParams params;
+  memset(&params, 0, sizeof(params));
+  ShaderToyParams toy_params;
+  toy_params.orientation = 0.0f;
+
+  //no GL: the shader's CPU kernel is drawn instead
+  SoftwareFramebuffer software_fb;
+  if(manager->GetSoftwareFramebuffer(&software_fb))
+    {
+      int result = 1;
+      string kernel;
+      if(!SoftwareRenderer::FromSource(toy_source, &kernel))
+        cerr << opts.shader_path << " has no // kernel: line to run on the "
+             << "software backend" << endl;
+      else
+        {
+          SoftwareRenderer renderer(kernel);
+          TileScheduler scheduler(opts.threads);
+          renderer.setScheduler(&scheduler);
+          if(!renderer.valid())
+            cerr << "No CPU kernel named " << kernel << endl;
+          else
+            {
+              stringstream desc;
+              desc << "kernel " << kernel << ", "
+                   << SoftwareRenderer::IsaName(renderer.isa()) << " on "
+                   << scheduler.threads() << " threads";
+              program_source_desc = desc.str();
+              result = runSoftware(manager, handler, &renderer, &params,
+                                   &toy_params, opts, out);
+            }
+        }
+      if(out)
+        fclose(out);
+      delete manager;
+      return result;
+    }
+
+  ProgramCache* cache = 0;
+  if(opts.program_cache)
+    {
+      cache = new ProgramCache(ProgramCache::DefaultDirectory());
+      GLProgram::SetProgramCache(cache);
+    }
+
+  //shared by every toy drawn, including reloads and buffer passes
+  ToyUniformBlock* uniform_block = new ToyUniformBlock();
+  ShaderToy::SetUniformBlock(uniform_block);
+
+  int result = 1;
+  {
+    //the starting tier; offline draws it throughout, interactive runs hand
+    //it to their ShaderVariants as that tier's program
+    ShaderToy* toy = new ShaderToy(tierSource(toy_source, opts.quality_tier),
+                                   &params, &toy_params);
+    if(!opts.coverage.empty())
+      toy->coverage()->parse(opts.coverage);
+    long long program_start_ms = monotonicMs();
+    bool program_ok = toy->initialize();
+    //as in ShaderVariants, a tier that doesn't build falls back to the
+    //source as written
+    if(!program_ok && !variants.empty())
+      {
+        cout << "Quality " << variants[opts.quality_tier].name
+             << " doesn't build; drawing " << opts.shader_path
+             << " as written" << endl;
+        delete toy;
+        toy = new ShaderToy(toy_source, &params, &toy_params);
+        if(!opts.coverage.empty())
+          toy->coverage()->parse(opts.coverage);
+        program_ok = toy->initialize();
+        opts.quality_fallback = true;
+      }
+
+    stringstream desc;
+    desc << "program " << (toy->fromCache() ? "loaded from cache" :
+                           (cache ? "compiled, cache miss" :
+                            "compiled, cache disabled"))
+         << " in " << (monotonicMs() - program_start_ms) << " ms";
+    program_source_desc = desc.str();
+    if(program_ok && toy->buffers())
+      cout << toy->buffers()->passCount() << " buffer passes in "
+           << toy->buffers()->textureCount() << " textures ("
+           << toy->buffers()->unsharedTextureCount() << " unshared)" << endl;
+
+    if(program_ok && opts.offline)
+      result = runOffline(manager, toy, &params, opts, out);
+    else if(program_ok && opts.outputs == OUTPUTS_EACH &&
+            manager->GetOutputs().size() > 1)
+      result = runOutputs(manager, handler, &toy, &params, &toy_params, opts,
+                          toy_source);
+    else if(program_ok)
+      result = opts.render_thread ?
+        runThreaded(manager, handler, &toy, &params, &toy_params, opts,
+                    toy_source) :
+        runInteractive(manager, handler, &toy, &params, &toy_params, opts,
+                       toy_source);
+    delete toy;
+  }
+
+  ShaderToy::SetUniformBlock(0);
+  delete uniform_block;
+  GLProgram::SetProgramCache(0);
+  delete cache;
+  if(out)
+    fclose(out);
+  delete manager;
+  return result;
 }
@@ -0,0 +1,177 @@
+/*******************************************************************************
+*  ShaderVariants.cpp - a ShaderToy's quality tiers, as #define sets compiled  *
+*                       into specialized programs on first use                 *
+*******************************************************************************/
+
+
+#include "ShaderVariants.hpp"
+#include <Portability/PublicInterfaces/LoopClock.hpp>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+
+using namespace std;
+
+
+static const char* variant_directive = "variant:";
+
+
+ShaderVariants::ShaderVariants(const string& toy_source,
+                               RendererParams* params,
+                               ShaderToyParams* toy_params,
+                               const string& coverage)
+  : toy_source(toy_source), coverage(coverage), params(params),
+    toy_params(toy_params), fallback(0), fallback_tried(false), adopted(0),
+    build_ns(0)
+{
+  Parse(toy_source, &this->variants);
+}
+
+ShaderVariants::~ShaderVariants(void)
+{
+  for(map<string, ShaderToy*>::iterator toy = this->built.begin();
+      toy != this->built.end(); toy++)
+    if(toy->second != this->adopted && toy->second != this->fallback)
+      delete toy->second;
+  if(this->fallback != this->adopted)
+    delete this->fallback;
+}
+
+
+bool ShaderVariants::Parse(const string& toy_source,
+                           vector<ShaderVariant>* variants)
+{
+  variants->clear();
+  istringstream in(toy_source);
+  string line;
+  while(getline(in, line))
+    {
+      size_t pos = line.find_first_not_of(" \t");
+      if(pos == string::npos || line.compare(pos, 2, "//"))
+        continue;
+      pos = line.find_first_not_of(" \t", pos + 2);
+      if(pos == string::npos || line.compare(pos, strlen(variant_directive),
+                                             variant_directive))
+        continue;
+
+      istringstream fields(line.substr(pos + strlen(variant_directive)));
+      ShaderVariant variant;
+      if(!(fields >> variant.name))
+        continue;
+      //a bare NAME is defined as 1; a NAME given twice keeps the last value,
+      //since GLSL won't take a redefinition
+      string define;
+      while(fields >> define)
+        {
+          size_t equals = define.find('=');
+          string name = define.substr(0, equals);
+          string value = equals == string::npos ? "1" : define.substr(equals + 1);
+          if(name.empty())
+            continue;
+          size_t idx = 0;
+          while(idx < variant.defines.size() && variant.defines[idx].first != name)
+            idx++;
+          if(idx < variant.defines.size())
+            variant.defines[idx].second = value;
+          else
+            variant.defines.push_back(make_pair(name, value));
+        }
+      variants->push_back(variant);
+    }
+  return !variants->empty();
+}
+
+string ShaderVariants::Source(const string& toy_source,
+                              const ShaderVariant& variant)
+{
+  return GLProgram::Specialize(toy_source, variant.defines);
+}
+
+string ShaderVariants::Key(const ShaderDefines& defines)
+{
+  vector<string> pairs;
+  for(size_t idx = 0; idx < defines.size(); idx++)
+    pairs.push_back(defines[idx].first + "=" + defines[idx].second);
+  sort(pairs.begin(), pairs.end());
+  string key;
+  for(size_t idx = 0; idx < pairs.size(); idx++)
+    key += (idx ? " " : "") + pairs[idx];
+  return key;
+}
+
+
+int ShaderVariants::find(const string& name)
+{
+  for(size_t idx = 0; idx < this->variants.size(); idx++)
+    if(this->variants[idx].name == name)
+      return idx;
+  return -1;
+}
+
+bool ShaderVariants::warm(size_t index)
+{
+  return index < this->variants.size() &&
+    this->built.count(Key(this->variants[index].defines));
+}
+
+bool ShaderVariants::failed(size_t index)
+{
+  return index < this->variants.size() &&
+    this->failed_keys.count(Key(this->variants[index].defines));
+}
+
+void ShaderVariants::adopt(size_t index, ShaderToy* toy, bool fallback)
+{
+  if(index >= this->variants.size())
+    return;
+  string key = Key(this->variants[index].defines);
+  this->built[key] = toy;
+  this->adopted = toy;
+  if(fallback)
+    {
+      this->failed_keys.insert(key);
+      this->fallback = toy;
+      this->fallback_tried = true;
+    }
+}
+
+ShaderToy* ShaderVariants::build(const string& source, const string& what)
+{
+  ShaderToy* toy = new ShaderToy(source, this->params, this->toy_params);
+  if(!this->coverage.empty())
+    toy->coverage()->parse(this->coverage);
+  if(toy->initialize())
+    return toy;
+  cout << what << " failed to build" << endl;
+  delete toy;
+  return 0;
+}
+
+ShaderToy* ShaderVariants::get(size_t index)
+{
+  if(index >= this->variants.size())
+    return 0;
+  const ShaderVariant& variant = this->variants[index];
+  string key = Key(variant.defines);
+  map<string, ShaderToy*>::iterator found = this->built.find(key);
+  if(found != this->built.end())
+    return found->second;
+
+  long long start = LoopClock::Now();
+  ShaderToy* toy = build(Source(this->toy_source, variant),
+                         "Variant " + variant.name + " (" + key + ")");
+  if(!toy)
+    {
+      this->failed_keys.insert(key);
+      if(!this->fallback_tried)
+        {
+          this->fallback = build(this->toy_source, "The source as written");
+          this->fallback_tried = true;
+        }
+      toy = this->fallback;
+    }
+  this->build_ns = LoopClock::Now() - start;
+  this->built[key] = toy;
+  return toy;
+}
@@ -0,0 +1,105 @@
+/*******************************************************************************
+*  ShaderVariants.hpp - a ShaderToy's quality tiers, as #define sets compiled  *
+*                       into specialized programs on first use                 *
+*******************************************************************************/
+
+#ifndef SHADERVARIANTS_HPP_
+#define SHADERVARIANTS_HPP_
+
+#include "GLShader.hpp"
+#include <map>
+#include <set>
+
+
+//one tier of a source
+struct ShaderVariant
+{
+  std::string name;
+  ShaderDefines defines;
+};
+
+
+//A source lists its tiers on lines reading
+//"// variant: <name> NAME=VALUE NAME=VALUE ...", lowest quality first:
+//  // variant: low STEPS=32 AO_SAMPLES=2
+//  // variant: high STEPS=128 AO_SAMPLES=8
+//and gives each tunable a default under #ifndef so it still builds as
+//written. A variant is the source with its defines injected (see
+//GLProgram::Specialize()), so step counts and loop bounds reach the driver
+//as constants it can unroll and fold instead of uniforms it can't.
+//
+//Each variant's ShaderToy is built the first time it's asked for and kept,
+//keyed by its define set (tiers with the same defines share one), so
+//switching to a tier costs a compile once and nothing after. A variant that
+//doesn't build falls back to the source as written, built once for all such
+//tiers. Built programs go through the program cache like any other, so a
+//tier compiled by an earlier run only costs a binary load.
+class ShaderVariants
+{
+public:
+  //coverage, when not empty, overrides every variant's "// coverage:" spec
+  ShaderVariants(const std::string& toy_source, RendererParams* params,
+                 ShaderToyParams* toy_params,
+                 const std::string& coverage = "");
+  ~ShaderVariants(void);
+
+  //the "// variant:" lines of toy_source; false if there are none
+  static bool Parse(const std::string& toy_source,
+                    std::vector<ShaderVariant>* variants);
+
+  //toy_source specialized for variant
+  static std::string Source(const std::string& toy_source,
+                            const ShaderVariant& variant);
+
+  //the cache key of a define set; order doesn't matter
+  static std::string Key(const ShaderDefines& defines);
+
+  size_t count(void) { return variants.size(); }
+  const ShaderVariant& variant(size_t index) { return variants[index]; }
+
+  //index of the variant called name, or -1
+  int find(const std::string& name);
+
+  //variant index's toy, built in the current context if this is the first
+  //time. If it doesn't build (reported once, not retried), the toy of the
+  //source as written; null if that doesn't build either
+  ShaderToy* get(size_t index);
+
+  //whether get(index) returns without building anything
+  bool warm(size_t index);
+
+  //whether variant index was found not to build, so get(index) falls back
+  bool failed(size_t index);
+
+  //has get(index) return toy, already built from variant index's Source()
+  //elsewhere (at startup, or by a reload), instead of building its own; with
+  //fallback, the variant didn't build and toy is the source as written.
+  //Call once, before any get(); the caller keeps ownership
+  void adopt(size_t index, ShaderToy* toy, bool fallback = false);
+
+  //ns the last get() that built a program spent on it
+  long long lastBuildTime(void) { return build_ns; }
+
+private:
+  std::string toy_source;
+  std::string coverage;
+  RendererParams* params;
+  ShaderToyParams* toy_params;
+  std::vector<ShaderVariant> variants;
+
+  //by Key(); a define set in failed_keys maps to fallback
+  std::map<std::string, ShaderToy*> built;
+  std::set<std::string> failed_keys;
+  //toy_source as written, once a variant has needed it; null if it didn't
+  //build
+  ShaderToy* fallback;
+  bool fallback_tried;
+  //the one toy here that isn't ours to delete
+  ShaderToy* adopted;
+  long long build_ns;
+
+  //builds source with the coverage override; null, reported, on failure
+  ShaderToy* build(const std::string& source, const std::string& what);
+};
+
+#endif /* SHADERVARIANTS_HPP_ */
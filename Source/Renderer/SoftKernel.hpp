@@ -0,0 +1,268 @@
+/*******************************************************************************
+*  SoftKernel.hpp - packet types and GLSL-style math for CPU fragment kernels  *
+*******************************************************************************/
+
+#ifndef SOFTKERNEL_HPP_
+#define SOFTKERNEL_HPP_
+
+#include <math.h>
+#include <string.h>
+
+
+//Everything a kernel calls is forced inline into the per-ISA span functions
+//in SoftwareRenderer.cpp, which are compiled for AVX2, SSE or NEON. That is
+//what lets one kernel source, written against vfloat<W>, become code for
+//each instruction set without being compiled separately for each.
+#define SOFT_INLINE inline __attribute__((always_inline))
+
+
+template <class T> struct same_type { typedef T type; };
+
+template <int W> struct vfloat;
+
+//per-lane result of a comparison: all ones or all zeros
+template <int W>
+struct vmask
+{
+  typedef int raw __attribute__((vector_size(W * sizeof(int))));
+  raw m;
+
+  friend SOFT_INLINE vmask operator&(vmask a, vmask b) { vmask r; r.m = a.m & b.m; return r; }
+  friend SOFT_INLINE vmask operator|(vmask a, vmask b) { vmask r; r.m = a.m | b.m; return r; }
+  friend SOFT_INLINE vmask operator~(vmask a) { vmask r; r.m = ~a.m; return r; }
+};
+
+//W floats operated on in lockstep, one per pixel
+template <int W>
+struct vfloat
+{
+  typedef float raw __attribute__((vector_size(W * sizeof(float))));
+  typedef typename vmask<W>::raw iraw;
+  raw v;
+
+  SOFT_INLINE vfloat(void) {}
+  SOFT_INLINE vfloat(float s) { raw zero = {}; v = zero + s; }
+  static SOFT_INLINE vfloat of(raw r) { vfloat f; f.v = r; return f; }
+
+  //0, 1, ... W-1. Lanes are reached through arrays; GCC won't subscript a
+  //vector whose size depends on a template parameter
+  static SOFT_INLINE vfloat lanes(void)
+  {
+    float values[W];
+    for(int idx = 0; idx < W; idx++)
+      values[idx] = idx;
+    vfloat f;
+    memcpy(&f.v, values, sizeof(values));
+    return f;
+  }
+
+  friend SOFT_INLINE vfloat operator+(vfloat a, vfloat b) { return of(a.v + b.v); }
+  friend SOFT_INLINE vfloat operator-(vfloat a, vfloat b) { return of(a.v - b.v); }
+  friend SOFT_INLINE vfloat operator*(vfloat a, vfloat b) { return of(a.v * b.v); }
+  friend SOFT_INLINE vfloat operator/(vfloat a, vfloat b) { return of(a.v / b.v); }
+  friend SOFT_INLINE vfloat operator-(vfloat a) { return of(-a.v); }
+  SOFT_INLINE vfloat& operator+=(vfloat b) { v += b.v; return *this; }
+  SOFT_INLINE vfloat& operator-=(vfloat b) { v -= b.v; return *this; }
+  SOFT_INLINE vfloat& operator*=(vfloat b) { v *= b.v; return *this; }
+
+  friend SOFT_INLINE vmask<W> operator<(vfloat a, vfloat b) { vmask<W> r; r.m = a.v < b.v; return r; }
+  friend SOFT_INLINE vmask<W> operator>(vfloat a, vfloat b) { vmask<W> r; r.m = a.v > b.v; return r; }
+  friend SOFT_INLINE vmask<W> operator<=(vfloat a, vfloat b) { vmask<W> r; r.m = a.v <= b.v; return r; }
+  friend SOFT_INLINE vmask<W> operator>=(vfloat a, vfloat b) { vmask<W> r; r.m = a.v >= b.v; return r; }
+};
+
+
+//GLSL built-ins, per lane. Anything taking vfloat<W> also takes a float
+//for its non-leading arguments
+
+//mask ? a : b
+template <int W>
+SOFT_INLINE vfloat<W> select(vmask<W> mask, vfloat<W> a,
+                             typename same_type<vfloat<W> >::type b)
+{
+  return vfloat<W>::of(mask.m ? a.v : b.v);
+}
+
+//true if any lane of mask is set
+template <int W>
+SOFT_INLINE bool any(vmask<W> mask)
+{
+  int lanes[W], bits = 0;
+  memcpy(lanes, &mask.m, sizeof(lanes));
+  for(int idx = 0; idx < W; idx++)
+    bits |= lanes[idx];
+  return bits != 0;
+}
+
+template <int W>
+SOFT_INLINE vfloat<W> floor(vfloat<W> x)
+{
+  typedef typename vfloat<W>::iraw iraw;
+  typedef typename vfloat<W>::raw raw;
+  //truncation rounds negatives up; pull those back down
+  raw zero = {};
+  raw t = __builtin_convertvector(__builtin_convertvector(x.v, iraw), raw);
+  return vfloat<W>::of(t - (t > x.v ? zero + 1.0f : zero));
+}
+
+template <int W>
+SOFT_INLINE vfloat<W> fract(vfloat<W> x) { return x - floor(x); }
+
+template <int W>
+SOFT_INLINE vfloat<W> abs(vfloat<W> x)
+{
+  typedef typename vfloat<W>::iraw iraw;
+  typedef typename vfloat<W>::raw raw;
+  return vfloat<W>::of((raw) ((iraw) x.v & 0x7fffffff));
+}
+
+template <int W>
+SOFT_INLINE vfloat<W> min(vfloat<W> a, typename same_type<vfloat<W> >::type b)
+{
+  return vfloat<W>::of(a.v < b.v ? a.v : b.v);
+}
+
+template <int W>
+SOFT_INLINE vfloat<W> max(vfloat<W> a, typename same_type<vfloat<W> >::type b)
+{
+  return vfloat<W>::of(a.v > b.v ? a.v : b.v);
+}
+
+template <int W>
+SOFT_INLINE vfloat<W> clamp(vfloat<W> x, typename same_type<vfloat<W> >::type lo,
+                            typename same_type<vfloat<W> >::type hi)
+{
+  return min(max(x, lo), hi);
+}
+
+template <int W>
+SOFT_INLINE vfloat<W> mix(vfloat<W> a, typename same_type<vfloat<W> >::type b,
+                          typename same_type<vfloat<W> >::type t)
+{
+  return a + (b - a) * t;
+}
+
+template <int W>
+SOFT_INLINE vfloat<W> step(typename same_type<vfloat<W> >::type edge, vfloat<W> x)
+{
+  return select(x < edge, vfloat<W>(0.0f), 1.0f);
+}
+
+template <int W>
+SOFT_INLINE vfloat<W> smoothstep(typename same_type<vfloat<W> >::type e0,
+                                 typename same_type<vfloat<W> >::type e1,
+                                 vfloat<W> x)
+{
+  vfloat<W> t = clamp((x - e0) / (e1 - e0), 0.0f, 1.0f);
+  return t * t * (vfloat<W>(3.0f) - t * 2.0f);
+}
+
+//a lane at a time, which the vectorizer turns back into one instruction
+template <int W>
+SOFT_INLINE vfloat<W> sqrt(vfloat<W> x)
+{
+  float lanes[W];
+  memcpy(lanes, &x.v, sizeof(lanes));
+  for(int idx = 0; idx < W; idx++)
+    lanes[idx] = __builtin_sqrtf(lanes[idx]);
+  memcpy(&x.v, lanes, sizeof(lanes));
+  return x;
+}
+
+//range reduced to [-pi/2, pi/2], then a degree 11 Taylor polynomial: error
+//under 1e-7 there, and no table lookups to break the lockstep
+template <int W>
+SOFT_INLINE vfloat<W> sin(vfloat<W> x)
+{
+  const float two_pi_hi = 6.28125f, two_pi_lo = 1.9353071795864769e-3f;
+  vfloat<W> k = floor(x * (float) (0.5 / M_PI) + 0.5f);
+  x = x - k * two_pi_hi - k * two_pi_lo;
+  x = select(x > (float) M_PI_2, vfloat<W>((float) M_PI) - x, x);
+  x = select(x < (float) -M_PI_2, vfloat<W>((float) -M_PI) - x, x);
+
+  vfloat<W> x2 = x * x;
+  vfloat<W> p = x2 * (-1.0f / 39916800.0f) + (1.0f / 362880.0f);
+  p = p * x2 + (-1.0f / 5040.0f);
+  p = p * x2 + (1.0f / 120.0f);
+  p = p * x2 + (-1.0f / 6.0f);
+  return x + x * x2 * p;
+}
+
+template <int W>
+SOFT_INLINE vfloat<W> cos(vfloat<W> x) { return sin(x + (float) M_PI_2); }
+
+
+template <int W>
+struct vec2
+{
+  vfloat<W> x, y;
+
+  SOFT_INLINE vec2(void) {}
+  SOFT_INLINE vec2(vfloat<W> x, vfloat<W> y) : x(x), y(y) {}
+
+  friend SOFT_INLINE vec2 operator+(vec2 a, vec2 b) { return vec2(a.x + b.x, a.y + b.y); }
+  friend SOFT_INLINE vec2 operator-(vec2 a, vec2 b) { return vec2(a.x - b.x, a.y - b.y); }
+  friend SOFT_INLINE vec2 operator*(vec2 a, vec2 b) { return vec2(a.x * b.x, a.y * b.y); }
+  friend SOFT_INLINE vec2 operator/(vec2 a, vec2 b) { return vec2(a.x / b.x, a.y / b.y); }
+  friend SOFT_INLINE vec2 operator*(vec2 a, vfloat<W> s) { return vec2(a.x * s, a.y * s); }
+};
+
+template <int W>
+struct vec3
+{
+  vfloat<W> x, y, z;
+
+  SOFT_INLINE vec3(void) {}
+  SOFT_INLINE vec3(vfloat<W> s) : x(s), y(s), z(s) {}
+  SOFT_INLINE vec3(vfloat<W> x, vfloat<W> y, vfloat<W> z) : x(x), y(y), z(z) {}
+
+  friend SOFT_INLINE vec3 operator+(vec3 a, vec3 b) { return vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+  friend SOFT_INLINE vec3 operator-(vec3 a, vec3 b) { return vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+  friend SOFT_INLINE vec3 operator*(vec3 a, vec3 b) { return vec3(a.x * b.x, a.y * b.y, a.z * b.z); }
+  friend SOFT_INLINE vec3 operator*(vec3 a, vfloat<W> s) { return vec3(a.x * s, a.y * s, a.z * s); }
+  friend SOFT_INLINE vec3 operator-(vec3 a) { return vec3(-a.x, -a.y, -a.z); }
+};
+
+template <int W>
+SOFT_INLINE vfloat<W> dot(vec2<W> a, vec2<W> b) { return a.x * b.x + a.y * b.y; }
+
+template <int W>
+SOFT_INLINE vfloat<W> dot(vec3<W> a, vec3<W> b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+template <int W>
+SOFT_INLINE vfloat<W> length(vec2<W> a) { return sqrt(dot(a, a)); }
+
+template <int W>
+SOFT_INLINE vfloat<W> length(vec3<W> a) { return sqrt(dot(a, a)); }
+
+template <int W>
+SOFT_INLINE vec3<W> normalize(vec3<W> a) { return a * (vfloat<W>(1.0f) / length(a)); }
+
+template <int W>
+SOFT_INLINE vec3<W> mix(vec3<W> a, vec3<W> b, vfloat<W> t)
+{
+  return vec3<W>(mix(a.x, b.x, t), mix(a.y, b.y, t), mix(a.z, b.z, t));
+}
+
+
+//the shadertoy uniforms a kernel sees
+struct KernelUniforms
+{
+  float resolution[3];   //iResolution
+  float time;            //iTime / iGlobalTime, seconds
+  float mouse[4];        //iMouse
+  int frame;             //iFrame
+  float orientation;     //iOrientation
+};
+
+//A kernel is a class with
+//
+//  template <int W>
+//  static SOFT_INLINE vec3<W> mainImage(vec2<W> fragCoord,
+//                                       const KernelUniforms& u);
+//
+//returning the color of W horizontally adjacent pixels (unclamped; alpha is
+//always 1). Control flow that differs between pixels has to be written with
+//select() and any(), as on a GPU.
+
+#endif /* SOFTKERNEL_HPP_ */
@@ -0,0 +1,136 @@
+/*******************************************************************************
+*  SoftKernels.hpp - the built-in CPU fragment kernels                         *
+*******************************************************************************/
+
+#ifndef SOFTKERNELS_HPP_
+#define SOFTKERNELS_HPP_
+
+#include "SoftKernel.hpp"
+
+
+//Each kernel mirrors a GLSL shader; a shader names its CPU twin with a
+//"// kernel: <name>" line, which the software backend runs in its place.
+//New kernels also need an entry in SoftwareRenderer.cpp's table.
+
+
+//uv in red and green, blue pulsing with time
+struct GradientKernel
+{
+  template <int W>
+  static SOFT_INLINE vec3<W> mainImage(vec2<W> fragCoord, const KernelUniforms& u)
+  {
+    return vec3<W>(fragCoord.x / u.resolution[0], fragCoord.y / u.resolution[1],
+                   vfloat<W>(0.5f + 0.5f * sinf(u.time)));
+  }
+};
+
+
+//the classic sum of sines, a dozen transcendental calls a pixel
+struct PlasmaKernel
+{
+  template <int W>
+  static SOFT_INLINE vec3<W> mainImage(vec2<W> fragCoord, const KernelUniforms& u)
+  {
+    vec2<W> uv = fragCoord * vfloat<W>(8.0f / u.resolution[1]);
+    vfloat<W> t = u.time;
+    vfloat<W> v = sin(uv.x + t) + sin((uv.y + t) * 0.5f) +
+      sin((uv.x + uv.y + t) * 0.5f);
+    vfloat<W> cx = uv.x + sin(t * 0.33f) * 4.0f;
+    vfloat<W> cy = uv.y + cos(t * 0.5f) * 4.0f;
+    v += sin(sqrt(cx * cx + cy * cy + 1.0f) + t);
+    v = v * 0.5f;
+    return vec3<W>(sin(v * (float) M_PI) * 0.5f + 0.5f,
+                   sin(v * (float) M_PI + 2.0f) * 0.5f + 0.5f,
+                   sin(v * (float) M_PI + 4.0f) * 0.5f + 0.5f);
+  }
+};
+
+
+//60 products of sines; uniformly expensive everywhere
+struct WavesKernel
+{
+  template <int W>
+  static SOFT_INLINE vec3<W> mainImage(vec2<W> fragCoord, const KernelUniforms& u)
+  {
+    vfloat<W> ux = fragCoord.x / u.resolution[0];
+    vfloat<W> uy = fragCoord.y / u.resolution[1];
+    vfloat<W> v = 0.0f;
+    for(int i = 0; i < 60; i++)
+      v += sin(ux * (float) i + u.time) * cos(uy * (float) i);
+    return vec3<W>(v * 0.02f + 0.5f);
+  }
+};
+
+
+//sphere-traced spheres over a plane. Rays that graze the plane or miss
+//everything take many more steps than the rest, so the cost per pixel is
+//very uneven across the screen
+struct RaymarchKernel
+{
+  enum { MAX_STEPS = 96 };
+
+  template <int W>
+  static SOFT_INLINE vfloat<W> scene(vec3<W> p, float time)
+  {
+    vfloat<W> d = p.y + 1.0f;
+    for(int idx = 0; idx < 3; idx++)
+      {
+        float a = time * 0.7f + idx * 2.0944f;
+        vec3<W> c(vfloat<W>(1.4f * cosf(a)), vfloat<W>(0.1f * idx),
+                  vfloat<W>(1.4f * sinf(a) + 1.0f));
+        d = min(d, length(p - c) - 0.5f);
+      }
+    return d;
+  }
+
+  template <int W>
+  static SOFT_INLINE vec3<W> mainImage(vec2<W> fragCoord, const KernelUniforms& u)
+  {
+    vfloat<W> px = (fragCoord.x * 2.0f - u.resolution[0]) / u.resolution[1];
+    vfloat<W> py = (fragCoord.y * 2.0f - u.resolution[1]) / u.resolution[1];
+    vec3<W> ro(vfloat<W>(0.0f), vfloat<W>(0.2f), vfloat<W>(-3.0f));
+    vec3<W> rd = normalize(vec3<W>(px, py, vfloat<W>(1.5f)));
+
+    //lanes stop where they hit or leave the scene; the packet stops when
+    //every lane has
+    vfloat<W> t = 0.0f;
+    vmask<W> hit = vfloat<W>(1.0f) < 0.0f;
+    for(int step = 0; step < MAX_STEPS; step++)
+      {
+        vmask<W> active = ~hit & (t < 20.0f);
+        if(!any(active))
+          break;
+        vfloat<W> d = scene(ro + rd * t, u.time);
+        hit = hit | (active & (d < 0.001f));
+        t = select(active, t + d, t);
+      }
+
+    vec3<W> sky = mix(vec3<W>(vfloat<W>(0.9f), vfloat<W>(0.9f), vfloat<W>(1.0f)),
+                      vec3<W>(vfloat<W>(0.3f), vfloat<W>(0.5f), vfloat<W>(0.9f)),
+                      clamp(py, 0.0f, 1.0f));
+    if(!any(hit))
+      return sky;
+
+    //central differences for the normal, then one diffuse light
+    vec3<W> p = ro + rd * t;
+    const float e = 0.001f;
+    vec3<W> n(scene(p + vec3<W>(vfloat<W>(e), 0.0f, 0.0f), u.time) -
+              scene(p - vec3<W>(vfloat<W>(e), 0.0f, 0.0f), u.time),
+              scene(p + vec3<W>(0.0f, vfloat<W>(e), 0.0f), u.time) -
+              scene(p - vec3<W>(0.0f, vfloat<W>(e), 0.0f), u.time),
+              scene(p + vec3<W>(0.0f, 0.0f, vfloat<W>(e)), u.time) -
+              scene(p - vec3<W>(0.0f, 0.0f, vfloat<W>(e)), u.time));
+    n = normalize(n);
+    vec3<W> light = normalize(vec3<W>(vfloat<W>(0.6f), vfloat<W>(0.8f),
+                                      vfloat<W>(-0.4f)));
+    vfloat<W> diffuse = clamp(dot(n, light), 0.0f, 1.0f);
+    vfloat<W> fog = clamp(t * 0.06f, 0.0f, 1.0f);
+    vec3<W> lit = vec3<W>(diffuse * 0.8f + 0.2f) *
+      vec3<W>(vfloat<W>(1.0f), vfloat<W>(0.8f), vfloat<W>(0.6f));
+    lit = mix(lit, sky, fog);
+    return vec3<W>(select(hit, lit.x, sky.x), select(hit, lit.y, sky.y),
+                   select(hit, lit.z, sky.z));
+  }
+};
+
+#endif /* SOFTKERNELS_HPP_ */
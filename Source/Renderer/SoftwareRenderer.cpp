@@ -0,0 +1,267 @@
+/*******************************************************************************
+*  SoftwareRenderer.cpp - runs a CPU fragment kernel over a software           *
+*                         framebuffer                                          *
+*******************************************************************************/
+
+
+#include "SoftwareRenderer.hpp"
+#include "SoftKernels.hpp"
+#include <sstream>
+#include <string.h>
+
+using namespace std;
+
+
+static const char* kernel_directive = "kernel:";
+
+
+//W pixels of color to 0xAARRGGBB
+template <int W>
+static SOFT_INLINE void pack(vec3<W> color, unsigned int* out)
+{
+  typedef typename vfloat<W>::iraw iraw;
+  iraw r = __builtin_convertvector((clamp(color.x, 0.0f, 1.0f) * 255.0f + 0.5f).v, iraw);
+  iraw g = __builtin_convertvector((clamp(color.y, 0.0f, 1.0f) * 255.0f + 0.5f).v, iraw);
+  iraw b = __builtin_convertvector((clamp(color.z, 0.0f, 1.0f) * 255.0f + 0.5f).v, iraw);
+  iraw pixel = (r << 16) | (g << 8) | b | (int) 0xff000000;
+  memcpy(out, &pixel, sizeof(pixel));
+}
+
+template <class Kernel, int W>
+static SOFT_INLINE void shadeSpan(const KernelUniforms& u, int x0, int x1,
+                                  float frag_y, unsigned int* out)
+{
+  vec2<W> coord;
+  coord.y = frag_y;
+  vfloat<W> lanes = vfloat<W>::lanes() + 0.5f;
+  int x = x0;
+  for(; x + W <= x1; x += W)
+    {
+      coord.x = lanes + (float) x;
+      pack<W>(Kernel::template mainImage<W>(coord, u), out + (x - x0));
+    }
+  if(x < x1)
+    {
+      unsigned int tail[W];
+      coord.x = lanes + (float) x;
+      pack<W>(Kernel::template mainImage<W>(coord, u), tail);
+      memcpy(out + (x - x0), tail, (x1 - x) * sizeof(unsigned int));
+    }
+}
+
+
+//one entry point per ISA and kernel. The target attributes are what make
+//the inlined vfloat<W> operations come out as that ISA's instructions
+template <class Kernel>
+static void spanScalar(const KernelUniforms& u, int x0, int x1, float y,
+                       unsigned int* out)
+{
+  shadeSpan<Kernel, 1>(u, x0, x1, y, out);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+template <class Kernel>
+__attribute__((target("sse2")))
+static void spanSSE(const KernelUniforms& u, int x0, int x1, float y,
+                    unsigned int* out)
+{
+  shadeSpan<Kernel, 4>(u, x0, x1, y, out);
+}
+
+template <class Kernel>
+__attribute__((target("avx2,fma")))
+static void spanAVX2(const KernelUniforms& u, int x0, int x1, float y,
+                     unsigned int* out)
+{
+  shadeSpan<Kernel, 8>(u, x0, x1, y, out);
+}
+#define SOFT_SPANS(Kernel) \
+  {spanScalar<Kernel>, spanSSE<Kernel>, spanAVX2<Kernel>, 0}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+template <class Kernel>
+static void spanNEON(const KernelUniforms& u, int x0, int x1, float y,
+                     unsigned int* out)
+{
+  shadeSpan<Kernel, 4>(u, x0, x1, y, out);
+}
+#define SOFT_SPANS(Kernel) \
+  {spanScalar<Kernel>, 0, 0, spanNEON<Kernel>}
+
+#else
+#define SOFT_SPANS(Kernel) \
+  {spanScalar<Kernel>, 0, 0, 0}
+#endif
+
+
+struct SoftKernelEntry
+{
+  const char* name;
+  SoftSpanFunc spans[SOFT_ISA_COUNT];
+};
+
+static const SoftKernelEntry kernels[] =
+  {
+    {"gradient", SOFT_SPANS(GradientKernel)},
+    {"plasma", SOFT_SPANS(PlasmaKernel)},
+    {"waves", SOFT_SPANS(WavesKernel)},
+    {"raymarch", SOFT_SPANS(RaymarchKernel)},
+  };
+
+static const char* isa_names[SOFT_ISA_COUNT] = {"scalar", "sse", "avx2", "neon"};
+
+
+bool SoftwareRenderer::FromSource(const string& toy_source, string* kernel)
+{
+  istringstream in(toy_source);
+  string line;
+  while(getline(in, line))
+    {
+      size_t pos = line.find_first_not_of(" \t");
+      if(pos == string::npos || line.compare(pos, 2, "//"))
+        continue;
+      pos = line.find_first_not_of(" \t", pos + 2);
+      if(pos == string::npos || line.compare(pos, strlen(kernel_directive),
+                                             kernel_directive))
+        continue;
+      istringstream name(line.substr(pos + strlen(kernel_directive)));
+      return (bool) (name >> *kernel);
+    }
+  return false;
+}
+
+void SoftwareRenderer::KernelNames(vector<string>* names)
+{
+  names->clear();
+  for(size_t idx = 0; idx < sizeof(kernels) / sizeof(kernels[0]); idx++)
+    names->push_back(kernels[idx].name);
+}
+
+bool SoftwareRenderer::Supported(softisa isa)
+{
+  if(isa >= SOFT_ISA_COUNT || !kernels[0].spans[isa])
+    return false;
+#if defined(__x86_64__) || defined(__i386__)
+  if(isa == SOFT_ISA_AVX2)
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  if(isa == SOFT_ISA_SSE)
+    return __builtin_cpu_supports("sse2");
+#endif
+  return true;
+}
+
+const char* SoftwareRenderer::IsaName(softisa isa)
+{
+  return isa < SOFT_ISA_COUNT ? isa_names[isa] : "best";
+}
+
+
+SoftwareRenderer::SoftwareRenderer(const string& kernel, softisa isa)
+{
+  this->span = 0;
+  this->scheduler = 0;
+  if(isa == SOFT_ISA_BEST)
+    {
+      isa = SOFT_ISA_SCALAR;
+      for(int idx = SOFT_ISA_SCALAR + 1; idx < SOFT_ISA_COUNT; idx++)
+        if(Supported((softisa) idx))
+          isa = (softisa) idx;
+    }
+  this->chosen_isa = isa;
+  if(!Supported(isa))
+    return;
+  for(size_t idx = 0; idx < sizeof(kernels) / sizeof(kernels[0]); idx++)
+    if(kernel == kernels[idx].name)
+      this->span = kernels[idx].spans[isa];
+}
+
+
+KernelUniforms SoftwareRenderer::MakeUniforms(RendererParams* params,
+                                              ShaderToyParams* toy_params)
+{
+  KernelUniforms u;
+  u.resolution[0] = (float) params->render_width;
+  u.resolution[1] = (float) params->render_height;
+  u.resolution[2] = 1.0f;
+  u.time = params->current_time_ms / 1000.0f;
+  float mouse_scale = params->window_width ?
+    (float) params->render_width / params->window_width : 1.0f;
+  for(int idx = 0; idx < 4; idx++)
+    u.mouse[idx] = params->mouse[idx] * mouse_scale;
+  u.frame = params->frame;
+  u.orientation = toy_params->orientation;
+  return u;
+}
+
+void SoftwareRenderer::render(RendererParams* params,
+                              ShaderToyParams* toy_params,
+                              const SoftwareFramebuffer& fb)
+{
+  params->render_width = fb.width;
+  params->render_height = fb.height;
+  if(!this->scheduler)
+    {
+      renderRect(MakeUniforms(params, toy_params), fb, 0, 0, fb.width,
+                 fb.height);
+      return;
+    }
+  this->frame_uniforms = MakeUniforms(params, toy_params);
+  this->frame_fb = fb;
+  this->scheduler->run(fb.width, fb.height, this);
+}
+
+void SoftwareRenderer::runTile(int x0, int y0, int x1, int y1, int worker)
+{
+  renderRect(this->frame_uniforms, this->frame_fb, x0, y0, x1, y1);
+}
+
+void SoftwareRenderer::renderRect(const KernelUniforms& u,
+                                  const SoftwareFramebuffer& fb,
+                                  int x0, int y0, int x1, int y1)
+{
+  if(!this->span)
+    return;
+  //rows are stored top first; fragment coordinates count from the bottom
+  for(int y = y0; y < y1; y++)
+    this->span(u, x0, x1, fb.height - y - 0.5f,
+               fb.pixels + (size_t) y * fb.stride + x0);
+}
+
+
+//converts a rectangle of the framebuffer, flipping it as it goes
+class RGBAConversion : public TileJob
+{
+public:
+  RGBAConversion(const SoftwareFramebuffer& fb, unsigned char* rgba)
+    : fb(fb), rgba(rgba) {}
+
+  void runTile(int x0, int y0, int x1, int y1, int worker)
+  {
+    for(int y = y0; y < y1; y++)
+      {
+        const unsigned int* row = fb.pixels + (size_t) (fb.height - 1 - y) * fb.stride;
+        unsigned char* out = rgba + ((size_t) y * fb.width + x0) * 4;
+        for(int x = x0; x < x1; x++, out += 4)
+          {
+            out[0] = row[x] >> 16;
+            out[1] = row[x] >> 8;
+            out[2] = row[x];
+            out[3] = row[x] >> 24;
+          }
+      }
+  }
+
+private:
+  const SoftwareFramebuffer& fb;
+  unsigned char* rgba;
+};
+
+void SoftwareRenderer::ToRGBA(const SoftwareFramebuffer& fb,
+                              unsigned char* rgba, TileScheduler* scheduler)
+{
+  RGBAConversion conversion(fb, rgba);
+  if(scheduler)
+    scheduler->run(fb.width, fb.height, &conversion);
+  else
+    conversion.runTile(0, 0, fb.width, fb.height, 0);
+}
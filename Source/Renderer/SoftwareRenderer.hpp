@@ -0,0 +1,88 @@
+/*******************************************************************************
+*  SoftwareRenderer.hpp - runs a CPU fragment kernel over a software           *
+*                         framebuffer                                          *
+*******************************************************************************/
+
+#ifndef SOFTWARERENDERER_HPP_
+#define SOFTWARERENDERER_HPP_
+
+#include <Portability/PublicInterfaces/OpenGLManager.hpp>
+#include "GLShader.hpp"
+#include "SoftKernel.hpp"
+#include "TileScheduler.hpp"
+#include <string>
+#include <vector>
+
+
+//instruction sets a kernel is compiled for; each is W pixels at a time
+typedef enum {
+  SOFT_ISA_SCALAR,  //W = 1, plain C++
+  SOFT_ISA_SSE,     //W = 4, x86 SSE2
+  SOFT_ISA_AVX2,    //W = 8, x86 AVX2 + FMA
+  SOFT_ISA_NEON,    //W = 4, ARM NEON
+  SOFT_ISA_COUNT,
+  SOFT_ISA_BEST = SOFT_ISA_COUNT  //the widest this CPU runs
+} softisa;
+
+//shades pixels [x0, x1) of the row at fragment y into out[0 .. x1-x0)
+typedef void (*SoftSpanFunc)(const KernelUniforms& u, int x0, int x1,
+                             float frag_y, unsigned int* out);
+
+
+//Draws a built-in kernel (see SoftKernels.hpp) in place of a GLSL shader.
+//The kernel is picked by the shader's "// kernel: <name>" line, so one
+//shader file runs on either backend. Given a TileScheduler, frames are
+//drawn a tile per job across its threads.
+class SoftwareRenderer : public TileJob
+{
+public:
+  //the name on the first "// kernel:" line of a shadertoy source, if any
+  static bool FromSource(const std::string& toy_source, std::string* kernel);
+
+  static void KernelNames(std::vector<std::string>* names);
+
+  //false for ISAs this build or CPU can't run
+  static bool Supported(softisa isa);
+  static const char* IsaName(softisa isa);
+
+  SoftwareRenderer(const std::string& kernel, softisa isa = SOFT_ISA_BEST);
+
+  //false when there's no such kernel or the ISA isn't supported
+  bool valid(void) { return span != 0; }
+  softisa isa(void) { return chosen_isa; }
+
+  //null, the default, draws on the calling thread
+  void setScheduler(TileScheduler* scheduler) { this->scheduler = scheduler; }
+  TileScheduler* getScheduler(void) { return this->scheduler; }
+
+  //the iResolution etc. a frame of params is drawn with
+  static KernelUniforms MakeUniforms(RendererParams* params,
+                                     ShaderToyParams* toy_params);
+
+  //draws the whole framebuffer, at its size rather than params'
+  void render(RendererParams* params, ShaderToyParams* toy_params,
+              const SoftwareFramebuffer& fb);
+
+  //draws rows [y0, y1) and columns [x0, x1) of fb
+  void renderRect(const KernelUniforms& u, const SoftwareFramebuffer& fb,
+                  int x0, int y0, int x1, int y1);
+
+  //one tile of the frame render() is drawing
+  void runTile(int x0, int y0, int x1, int y1, int worker);
+
+  //converts fb to RGBA8 bottom row first, as FrameSink expects; across
+  //scheduler's threads if there is one
+  static void ToRGBA(const SoftwareFramebuffer& fb, unsigned char* rgba,
+                     TileScheduler* scheduler = 0);
+
+private:
+  SoftSpanFunc span;
+  softisa chosen_isa;
+  TileScheduler* scheduler;
+
+  //what the tiles of the frame in progress draw
+  KernelUniforms frame_uniforms;
+  SoftwareFramebuffer frame_fb;
+};
+
+#endif /* SOFTWARERENDERER_HPP_ */
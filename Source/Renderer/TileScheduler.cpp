@@ -0,0 +1,218 @@
+/*******************************************************************************
+*  TileScheduler.cpp - spreads per-pixel CPU work over a pool of pinned        *
+*                      threads, a tile at a time                               *
+*******************************************************************************/
+
+
+#include "TileScheduler.hpp"
+#include <Portability/PublicInterfaces/LoopClock.hpp>
+#include <iostream>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+using namespace std;
+
+
+//the CPUs this process is allowed on, in order
+static vector<int> allowedCpus(void)
+{
+  vector<int> cpus;
+  cpu_set_t set;
+  if(!sched_getaffinity(0, sizeof(set), &set))
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      if(CPU_ISSET(cpu, &set))
+        cpus.push_back(cpu);
+  return cpus;
+}
+
+
+TileScheduler::TileScheduler(int threads, int tile_width, int tile_height)
+{
+  this->tile_width = tile_width;
+  this->tile_height = tile_height;
+  this->stealing = true;
+  this->job = 0;
+  this->width = this->height = this->columns = 0;
+  this->generation = 0;
+  this->running = 0;
+  this->stopping = false;
+
+  vector<int> cpus = allowedCpus();
+  if(threads <= 0)
+    threads = cpus.empty() ? 1 : (int) cpus.size();
+  for(int idx = 0; idx < threads; idx++)
+    this->workers.push_back(new Worker());
+  resetStats();
+
+  for(int idx = 0; idx < threads; idx++)
+    {
+      Worker* worker = this->workers[idx];
+      worker->thread = boost::thread(&TileScheduler::workerLoop, this, idx);
+      //more threads than CPUs wrap around, which is only useful for testing
+      if(cpus.empty())
+        continue;
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpus[idx % cpus.size()], &set);
+      if(pthread_setaffinity_np(worker->thread.native_handle(), sizeof(set),
+                                &set))
+        cout << "Unable to pin tile worker " << idx << endl;
+    }
+}
+
+TileScheduler::~TileScheduler(void)
+{
+  {
+    boost::mutex::scoped_lock guard(this->lock);
+    this->stopping = true;
+    this->start_work.notify_all();
+  }
+  for(size_t idx = 0; idx < this->workers.size(); idx++)
+    {
+      this->workers[idx]->thread.join();
+      delete this->workers[idx];
+    }
+}
+
+
+void TileScheduler::run(int width, int height, TileJob* job)
+{
+  int columns = (width + this->tile_width - 1) / this->tile_width;
+  int rows = (height + this->tile_height - 1) / this->tile_height;
+  int count = columns * rows;
+  if(count <= 0)
+    return;
+  long long start = LoopClock::Now();
+
+  //the workers are all waiting, so the deques can be refilled unlocked;
+  //waking them below publishes the writes
+  size_t threads = this->workers.size();
+  for(size_t idx = 0; idx < threads; idx++)
+    {
+      Worker* worker = this->workers[idx];
+      int first = (int) (count * idx / threads);
+      int last = (int) (count * (idx + 1) / threads);
+      worker->tiles.resize(last - first);
+      for(int tile = first; tile < last; tile++)
+        worker->tiles[tile - first] = tile;
+      worker->head = 0;
+      worker->tail = last - first;
+    }
+  this->job = job;
+  this->width = width;
+  this->height = height;
+  this->columns = columns;
+
+  {
+    boost::mutex::scoped_lock guard(this->lock);
+    this->running = (int) threads;
+    this->generation++;
+    this->start_work.notify_all();
+    while(this->running)
+      this->finished.wait(guard);
+  }
+  this->job = 0;
+
+  this->wall_ns += LoopClock::Now() - start;
+  this->run_count++;
+}
+
+
+double TileScheduler::utilisation(int worker)
+{
+  return this->wall_ns ?
+    (double) this->workers[worker]->stats.busy_ns / this->wall_ns : 0.0;
+}
+
+void TileScheduler::resetStats(void)
+{
+  for(size_t idx = 0; idx < this->workers.size(); idx++)
+    memset(&this->workers[idx]->stats, 0, sizeof(TileWorkerStats));
+  this->wall_ns = 0;
+  this->run_count = 0;
+}
+
+
+void TileScheduler::workerLoop(int index)
+{
+  unsigned int seen = 0;
+  while(true)
+    {
+      {
+        boost::mutex::scoped_lock guard(this->lock);
+        while(this->generation == seen && !this->stopping)
+          this->start_work.wait(guard);
+        if(this->stopping)
+          return;
+        seen = this->generation;
+      }
+
+      work(index);
+
+      boost::mutex::scoped_lock guard(this->lock);
+      if(--this->running == 0)
+        this->finished.notify_one();
+    }
+}
+
+void TileScheduler::work(int index)
+{
+  Worker* self = this->workers[index];
+  int tile;
+  while(pop(self, &tile) ||
+        (this->stealing && steal(index) && pop(self, &tile)))
+    {
+      int x0 = (tile % this->columns) * this->tile_width;
+      int y0 = (tile / this->columns) * this->tile_height;
+      int x1 = min(x0 + this->tile_width, this->width);
+      int y1 = min(y0 + this->tile_height, this->height);
+
+      long long start = LoopClock::Now();
+      this->job->runTile(x0, y0, x1, y1, index);
+      self->stats.busy_ns += LoopClock::Now() - start;
+      self->stats.tiles++;
+    }
+}
+
+bool TileScheduler::pop(Worker* self, int* tile)
+{
+  boost::mutex::scoped_lock guard(self->lock);
+  if(self->head == self->tail)
+    return false;
+  *tile = self->tiles[self->head++];
+  return true;
+}
+
+bool TileScheduler::steal(int index)
+{
+  //tiles only ever move between deques, never appear, so one pass finding
+  //every deque empty means the run is done, apart from tiles being run
+  Worker* self = this->workers[index];
+  int threads = (int) this->workers.size();
+  for(int offset = 1; offset < threads; offset++)
+    {
+      Worker* victim = this->workers[(index + offset) % threads];
+      vector<int> taken;
+      {
+        boost::mutex::scoped_lock guard(victim->lock);
+        size_t left = victim->tail - victim->head;
+        if(!left)
+          continue;
+        //the back half, furthest from where the victim is working
+        size_t take = (left + 1) / 2;
+        taken.assign(victim->tiles.begin() + (victim->tail - take),
+                     victim->tiles.begin() + victim->tail);
+        victim->tail -= take;
+      }
+
+      boost::mutex::scoped_lock guard(self->lock);
+      self->tiles.swap(taken);
+      self->head = 0;
+      self->tail = self->tiles.size();
+      self->stats.steals++;
+      self->stats.stolen += self->tail;
+      return true;
+    }
+  return false;
+}
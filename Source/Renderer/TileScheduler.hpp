@@ -0,0 +1,108 @@
+/*******************************************************************************
+*  TileScheduler.hpp - spreads per-pixel CPU work over a pool of pinned        *
+*                      threads, a tile at a time                               *
+*******************************************************************************/
+
+#ifndef TILESCHEDULER_HPP_
+#define TILESCHEDULER_HPP_
+
+#include <boost/thread.hpp>
+#include <vector>
+
+//a 64x32 tile of 32 bit pixels is 8KB: a whole tile's output, and a
+//kernel's working set besides, stays in L1. Rows are 4 cache lines long
+#define TILE_DEFAULT_WIDTH 64
+#define TILE_DEFAULT_HEIGHT 32
+
+
+//work done one tile at a time, from any of the pool's threads at once
+class TileJob
+{
+public:
+  virtual ~TileJob(void) {}
+
+  //processes columns [x0, x1) of rows [y0, y1); worker is the index of the
+  //calling thread, for per-thread scratch space
+  virtual void runTile(int x0, int y0, int x1, int y1, int worker) = 0;
+};
+
+
+//what one worker has done since the last resetStats()
+struct TileWorkerStats
+{
+  unsigned long long tiles;   //tiles run
+  unsigned long long steals;  //raids on another worker's deque that got work
+  unsigned long long stolen;  //tiles those raids took
+  long long busy_ns;          //time spent inside runTile()
+};
+
+
+//Splits an image into tiles and deals them out in contiguous runs, one per
+//worker, so neighbouring tiles (and their cache lines) stay on one core.
+//Each worker works front to back through its own deque; one that runs dry
+//takes the back half of another's, so regions of expensive pixels (the
+//grazing rays of a raymarcher, say) end up shared out without any tuning.
+//The threads are started once, pinned a core each, and wait between runs.
+class TileScheduler
+{
+public:
+  //threads 0 is one per core this process may run on
+  TileScheduler(int threads = 0, int tile_width = TILE_DEFAULT_WIDTH,
+                int tile_height = TILE_DEFAULT_HEIGHT);
+  ~TileScheduler(void);
+
+  //runs job over every tile of a width x height image; returns once all
+  //of them are done. Not reentrant
+  void run(int width, int height, TileJob* job);
+
+  int threads(void) { return (int) this->workers.size(); }
+
+  //off, each worker only runs the tiles it was dealt; for comparison
+  void setStealing(bool stealing) { this->stealing = stealing; }
+
+  const TileWorkerStats& stats(int worker) { return this->workers[worker]->stats; }
+  //fraction of the time spent in run() that worker spent running tiles
+  double utilisation(int worker);
+  unsigned long long runs(void) { return this->run_count; }
+  void resetStats(void);
+
+private:
+  struct Worker
+  {
+    //guards head and tail, against the owner and thieves
+    boost::mutex lock;
+    //the tiles still to run are tiles[head, tail)
+    std::vector<int> tiles;
+    size_t head, tail;
+    TileWorkerStats stats;
+    boost::thread thread;
+    //keeps a neighbour's counters off this worker's cache lines
+    char padding[64];
+  };
+  std::vector<Worker*> workers;
+  int tile_width, tile_height;
+  bool stealing;
+
+  //the run in progress; set before the workers are woken
+  TileJob* job;
+  int width, height, columns;
+
+  //guarded by lock
+  boost::mutex lock;
+  boost::condition_variable start_work;
+  boost::condition_variable finished;
+  unsigned int generation;
+  int running;
+  bool stopping;
+
+  long long wall_ns;
+  unsigned long long run_count;
+
+  void workerLoop(int index);
+  void work(int index);
+  bool pop(Worker* self, int* tile);
+  //moves half of another worker's tiles to index's (empty) deque
+  bool steal(int index);
+};
+
+#endif /* TILESCHEDULER_HPP_ */
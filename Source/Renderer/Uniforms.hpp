@@ -0,0 +1,124 @@
+/*******************************************************************************
+*  Uniforms.hpp - reflected program uniforms and typed, dirty-tracked handles  *
+*******************************************************************************/
+
+#ifndef UNIFORMS_HPP_
+#define UNIFORMS_HPP_
+
+#include "GLCommon.hpp"
+#include <string.h>
+
+
+//one entry of a linked program's active uniform list
+struct ActiveUniform
+{
+  std::string name;   //arrays without their "[0]"
+  GLint location;     //-1 for uniform block members
+  GLenum type;
+  GLint size;         //array length, 1 for non-arrays
+  GLint block;        //uniform block index, or -1
+  GLint offset;       //byte offset within the block, or -1
+};
+
+
+//component type, component count and upload call for each GL uniform type
+template <GLenum Type> struct UniformTraits;
+
+template <> struct UniformTraits<GL_FLOAT>
+{
+  typedef GLfloat component;
+  enum { components = 1 };
+  static void upload(GLint loc, GLsizei n, const GLfloat* v) { glUniform1fv(loc, n, v); }
+};
+
+template <> struct UniformTraits<GL_FLOAT_VEC2>
+{
+  typedef GLfloat component;
+  enum { components = 2 };
+  static void upload(GLint loc, GLsizei n, const GLfloat* v) { glUniform2fv(loc, n, v); }
+};
+
+template <> struct UniformTraits<GL_FLOAT_VEC3>
+{
+  typedef GLfloat component;
+  enum { components = 3 };
+  static void upload(GLint loc, GLsizei n, const GLfloat* v) { glUniform3fv(loc, n, v); }
+};
+
+template <> struct UniformTraits<GL_FLOAT_VEC4>
+{
+  typedef GLfloat component;
+  enum { components = 4 };
+  static void upload(GLint loc, GLsizei n, const GLfloat* v) { glUniform4fv(loc, n, v); }
+};
+
+template <> struct UniformTraits<GL_INT>
+{
+  typedef GLint component;
+  enum { components = 1 };
+  static void upload(GLint loc, GLsizei n, const GLint* v) { glUniform1iv(loc, n, v); }
+};
+
+template <> struct UniformTraits<GL_SAMPLER_2D>
+{
+  typedef GLint component;
+  enum { components = 1 };
+  static void upload(GLint loc, GLsizei n, const GLint* v) { glUniform1iv(loc, n, v); }
+};
+
+
+//A handle on one uniform (or array of Count) of a program, checked against
+//the program's reflection when attached. The program keeps uniform values
+//between uses, so set() only calls glUniform when the value differs from
+//the one last uploaded. Setting an unattached handle does nothing, which is
+//what the compiler optimizing a uniform out should mean.
+template <GLenum Type, int Count = 1>
+class Uniform
+{
+public:
+  typedef typename UniformTraits<Type>::component component;
+  enum { components = UniformTraits<Type>::components };
+
+  Uniform(void) : location(-1), count(0), uploaded(false) {}
+
+  //false, leaving the handle unattached, for a null, block member or
+  //differently typed uniform. Arrays the linker trimmed get what's left
+  bool attach(const ActiveUniform* uniform)
+  {
+    location = -1;
+    uploaded = false;
+    if(!uniform || uniform->block >= 0 || uniform->type != Type)
+      return false;
+    location = uniform->location;
+    count = uniform->size < Count ? uniform->size : Count;
+    return true;
+  }
+
+  bool attached(void) { return location >= 0; }
+
+  //Count * components values, for the program in use
+  void set(const component* value)
+  {
+    if(location < 0 ||
+       (uploaded && !memcmp(value, last, count * components * sizeof(component))))
+      return;
+    memcpy(last, value, count * components * sizeof(component));
+    uploaded = true;
+    UniformTraits<Type>::upload(location, count, value);
+  }
+
+  void set(component value)
+  {
+    typedef char scalar_uniforms_only[components * Count == 1 ? 1 : -1];
+    (void) sizeof(scalar_uniforms_only);
+    set(&value);
+  }
+
+private:
+  GLint location;
+  GLsizei count;
+  bool uploaded;
+  component last[components * Count];
+};
+
+#endif /* UNIFORMS_HPP_ */